@@ -19,11 +19,12 @@
  */
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "animations-dbus-client-effect.h"
 #include "animations-dbus-errors.h"
-#include "animations-dbus-main-context-private.h"
 #include "animations-dbus-objects.h"
+#include "animations-dbus-settings-channel.h"
 
 struct _AnimationsDbusClientEffect
 {
@@ -33,6 +34,11 @@ struct _AnimationsDbusClientEffect
 typedef struct _AnimationsDbusClientEffectPrivate
 {
   AnimationsDbusAnimatableSurface *proxy;
+
+  /* Only set once a settings channel was opened. The keys map
+   * setting names to their index in the channel, plus one. */
+  AnimationsDbusSettingsChannel   *settings_channel;
+  GHashTable                      *settings_channel_keys;  /* (key-type: utf8) (value-type: guint) */
 } AnimationsDbusClientEffectPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (AnimationsDbusClientEffect,
@@ -120,22 +126,260 @@ animations_dbus_client_effect_change_setting (AnimationsDbusClientEffect  *clien
                                               GVariant                    *value,
                                               GError                     **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-
-  animations_dbus_client_effect_change_setting_async (client_effect,
-                                                      name,
-                                                      value,
-                                                      NULL,
-                                                      animations_dbus_got_async_func_result,
-                                                      &result);
-
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
-
-  return animations_dbus_client_effect_change_setting_finish (client_effect,
-                                                              g_steal_pointer (&result),
-                                                              error);
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+
+  return animations_dbus_animation_effect_call_change_setting_sync (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                                    name,
+                                                                    g_variant_new_variant (value),
+                                                                    NULL,
+                                                                    error);
+}
+
+gboolean
+animations_dbus_client_effect_change_settings_finish (AnimationsDbusClientEffect  *client_effect G_GNUC_UNUSED,
+                                                      GAsyncResult                *result,
+                                                      GError                     **error)
+{
+  g_autoptr(GTask) task = G_TASK (result);
+  return g_task_propagate_boolean (task, error);
+}
+
+static void
+on_animations_dbus_client_effect_changed_settings (GObject      *source G_GNUC_UNUSED,
+                                                   GAsyncResult *result,
+                                                   gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AnimationsDbusClientEffect *client_effect =
+    ANIMATIONS_DBUS_CLIENT_EFFECT (g_task_get_task_data (task));
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_animation_effect_call_change_settings_finish (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                                     result,
+                                                                     &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+void
+animations_dbus_client_effect_change_settings_async (AnimationsDbusClientEffect *client_effect,
+                                                     GVariant                   *settings,
+                                                     GCancellable               *cancellable,
+                                                     GAsyncReadyCallback         callback,
+                                                     gpointer                    user_data)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  GTask *task = g_task_new (client_effect, cancellable, callback, user_data);
+
+  g_task_set_task_data (task, client_effect, NULL);
+
+  animations_dbus_animation_effect_call_change_settings (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                         settings,
+                                                         cancellable,
+                                                         on_animations_dbus_client_effect_changed_settings,
+                                                         task);
+}
+
+gboolean
+animations_dbus_client_effect_change_settings (AnimationsDbusClientEffect  *client_effect,
+                                               GVariant                    *settings,
+                                               GError                     **error)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+
+  return animations_dbus_animation_effect_call_change_settings_sync (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                                     settings,
+                                                                     NULL,
+                                                                     error);
+}
+
+static gboolean
+open_settings_channel_from_reply (AnimationsDbusClientEffect  *client_effect,
+                                  GVariant                    *channel_handle,
+                                  const char * const          *settings,
+                                  GUnixFDList                 *fd_list,
+                                  GError                     **error)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  g_autoptr(AnimationsDbusSettingsChannel) channel = NULL;
+  g_autoptr(GHashTable) keys = NULL;
+  int fd = -1;
+
+  if (fd_list == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "No file descriptor was sent for the settings channel");
+      return FALSE;
+    }
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (channel_handle), error);
+
+  if (fd < 0)
+    return FALSE;
+
+  channel = animations_dbus_settings_channel_new_for_fd (fd, error);
+
+  if (channel == NULL)
+    return FALSE;
+
+  keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (guint i = 0; settings[i] != NULL; ++i)
+    g_hash_table_insert (keys, g_strdup (settings[i]), GUINT_TO_POINTER (i + 1));
+
+  g_clear_pointer (&priv->settings_channel, animations_dbus_settings_channel_free);
+  g_clear_pointer (&priv->settings_channel_keys, g_hash_table_unref);
+
+  priv->settings_channel = g_steal_pointer (&channel);
+  priv->settings_channel_keys = g_steal_pointer (&keys);
+
+  return TRUE;
+}
+
+gboolean
+animations_dbus_client_effect_open_settings_channel_finish (AnimationsDbusClientEffect  *client_effect G_GNUC_UNUSED,
+                                                            GAsyncResult                *result,
+                                                            GError                     **error)
+{
+  g_autoptr(GTask) task = G_TASK (result);
+  return g_task_propagate_boolean (task, error);
+}
+
+static void
+on_animations_dbus_client_effect_opened_settings_channel (GObject      *source G_GNUC_UNUSED,
+                                                          GAsyncResult *result,
+                                                          gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AnimationsDbusClientEffect *client_effect =
+    ANIMATIONS_DBUS_CLIENT_EFFECT (g_task_get_task_data (task));
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  g_autoptr(GVariant) channel_handle = NULL;
+  g_auto(GStrv) settings = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_animation_effect_call_open_settings_channel_finish (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                                           &channel_handle,
+                                                                           &settings,
+                                                                           &fd_list,
+                                                                           result,
+                                                                           &local_error) ||
+      !open_settings_channel_from_reply (client_effect,
+                                         channel_handle,
+                                         (const char * const *) settings,
+                                         fd_list,
+                                         &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+void
+animations_dbus_client_effect_open_settings_channel_async (AnimationsDbusClientEffect *client_effect,
+                                                           GCancellable               *cancellable,
+                                                           GAsyncReadyCallback         callback,
+                                                           gpointer                    user_data)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  GTask *task = g_task_new (client_effect, cancellable, callback, user_data);
+
+  g_task_set_task_data (task, client_effect, NULL);
+
+  animations_dbus_animation_effect_call_open_settings_channel (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                               NULL,
+                                                               cancellable,
+                                                               on_animations_dbus_client_effect_opened_settings_channel,
+                                                               task);
+}
+
+gboolean
+animations_dbus_client_effect_open_settings_channel (AnimationsDbusClientEffect  *client_effect,
+                                                     GError                     **error)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  g_autoptr(GVariant) channel_handle = NULL;
+  g_auto(GStrv) settings = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+
+  if (!animations_dbus_animation_effect_call_open_settings_channel_sync (ANIMATIONS_DBUS_ANIMATION_EFFECT (priv->proxy),
+                                                                         NULL,
+                                                                         &channel_handle,
+                                                                         &settings,
+                                                                         &fd_list,
+                                                                         NULL,
+                                                                         error))
+    return FALSE;
+
+  return open_settings_channel_from_reply (client_effect,
+                                           channel_handle,
+                                           (const char * const *) settings,
+                                           fd_list,
+                                           error);
+}
+
+/* Write a new value for the numeric setting @name to the settings
+ * channel, without a round trip to the server. The server applies the
+ * latest value written for each setting once per frame. */
+gboolean
+animations_dbus_client_effect_push_setting (AnimationsDbusClientEffect  *client_effect,
+                                            const char                  *name,
+                                            double                       value,
+                                            GError                     **error)
+{
+  AnimationsDbusClientEffectPrivate *priv =
+    animations_dbus_client_effect_get_instance_private (client_effect);
+  guint key = 0;
+
+  if (priv->settings_channel == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_NOT_INITIALIZED,
+                           "No settings channel was opened for this effect");
+      return FALSE;
+    }
+
+  key = GPOINTER_TO_UINT (g_hash_table_lookup (priv->settings_channel_keys, name));
+
+  if (key == 0)
+    {
+      g_set_error (error,
+                   ANIMATIONS_DBUS_ERROR,
+                   ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
+                   "Setting %s cannot be changed through the settings channel",
+                   name);
+      return FALSE;
+    }
+
+  if (!animations_dbus_settings_channel_push (priv->settings_channel, key - 1, value))
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_WOULD_BLOCK,
+                           "The settings channel is full");
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 static void
@@ -199,6 +443,8 @@ animations_dbus_client_effect_dispose (GObject *object)
   AnimationsDbusClientEffectPrivate *priv = animations_dbus_client_effect_get_instance_private (client);
 
   g_clear_object (&priv->proxy);
+  g_clear_pointer (&priv->settings_channel, animations_dbus_settings_channel_free);
+  g_clear_pointer (&priv->settings_channel_keys, g_hash_table_unref);
 
   G_OBJECT_CLASS (animations_dbus_client_effect_parent_class)->dispose (object);
 }
@@ -49,6 +49,37 @@ gboolean animations_dbus_client_effect_change_setting (AnimationsDbusClientEffec
                                                        GVariant                    *value,
                                                        GError                     **error);
 
+gboolean animations_dbus_client_effect_change_settings_finish (AnimationsDbusClientEffect  *client_effect,
+                                                               GAsyncResult                *result,
+                                                               GError                     **error);
+
+void animations_dbus_client_effect_change_settings_async (AnimationsDbusClientEffect *client_effect,
+                                                          GVariant                   *settings,
+                                                          GCancellable               *cancellable,
+                                                          GAsyncReadyCallback         callback,
+                                                          gpointer                    user_data);
+
+gboolean animations_dbus_client_effect_change_settings (AnimationsDbusClientEffect  *client_effect,
+                                                        GVariant                    *settings,
+                                                        GError                     **error);
+
+gboolean animations_dbus_client_effect_open_settings_channel_finish (AnimationsDbusClientEffect  *client_effect,
+                                                                     GAsyncResult                *result,
+                                                                     GError                     **error);
+
+void animations_dbus_client_effect_open_settings_channel_async (AnimationsDbusClientEffect *client_effect,
+                                                                GCancellable               *cancellable,
+                                                                GAsyncReadyCallback         callback,
+                                                                gpointer                    user_data);
+
+gboolean animations_dbus_client_effect_open_settings_channel (AnimationsDbusClientEffect  *client_effect,
+                                                              GError                     **error);
+
+gboolean animations_dbus_client_effect_push_setting (AnimationsDbusClientEffect  *client_effect,
+                                                     const char                  *name,
+                                                     double                       value,
+                                                     GError                     **error);
+
 AnimationsDbusClientEffect * animations_dbus_client_effect_new_for_proxy (AnimationsDbusAnimationEffect *proxy);
 
 G_END_DECLS
@@ -19,13 +19,14 @@
  */
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "animations-dbus-client-effect.h"
 #include "animations-dbus-client-object.h"
 #include "animations-dbus-client-surface.h"
 #include "animations-dbus-errors.h"
-#include "animations-dbus-main-context-private.h"
 #include "animations-dbus-objects.h"
+#include "animations-dbus-state-snapshot.h"
 
 struct _AnimationsDbusClient
 {
@@ -36,14 +37,37 @@ typedef struct _AnimationsDbusClientPrivate
 {
   GDBusConnection                      *connection;
   AnimationsDbusConnectionManagerProxy *connection_manager_proxy;
+
+  /* Set if the service advertised a peer to peer address that could
+   * be connected to, in which case every object is reached over it
+   * instead of over the bus connection, without a bus name. */
+  GDBusConnection                      *peer_connection;
   AnimationsDbusConnectionManagerProxy *animation_manager_proxy;
+
+  /* Only set once the state snapshot was opened */
+  AnimationsDbusStateSnapshot          *state_snapshot;
+
+  /* The surfaces returned by RegisterClientWithSnapshot, if the
+   * service supports it. */
+  GPtrArray                            *initial_surfaces;  /* (element-type: AnimationsDbusClientSurface) */
+
+  /* Proxies for surfaces built from a snapshot do not load or follow
+   * their properties themselves. Instead, PropertiesChanged for every
+   * surface is followed with a single subscription, made before the
+   * first call that returns snapshots, so that a change made after a
+   * snapshot was taken always reaches the proxy built from it. */
+  guint                                 surface_properties_changed_id;
+  GHashTable                           *snapshot_surface_proxies;  /* (key-type: utf8) (value-type: AnimationsDbusAnimatableSurfaceProxy) (unowned) */
 } AnimationsDbusClientPrivate;
 
+static void animations_dbus_client_initable_interface_init (GInitableIface *iface);
 static void animations_dbus_client_async_initable_interface_init (GAsyncInitableIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (AnimationsDbusClient,
                          animations_dbus_client,
                          G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                animations_dbus_client_initable_interface_init)
                          G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
                                                 animations_dbus_client_async_initable_interface_init)
                          G_ADD_PRIVATE (AnimationsDbusClient))
@@ -56,6 +80,28 @@ enum {
 
 static GParamSpec *animations_dbus_client_properties[NPROPS];
 
+enum {
+  SIGNAL_SURFACES_ADDED,
+  SIGNAL_SURFACES_REMOVED,
+  NSIGNALS
+};
+
+static unsigned int animations_dbus_client_signals[NSIGNALS];
+
+#define LIBANIMATION_DBUS_NAME "com.endlessm.Libanimation"
+
+static GDBusConnection *
+get_object_connection (AnimationsDbusClientPrivate *priv)
+{
+  return priv->peer_connection != NULL ? priv->peer_connection : priv->connection;
+}
+
+static const char *
+get_object_bus_name (AnimationsDbusClientPrivate *priv)
+{
+  return priv->peer_connection != NULL ? NULL : LIBANIMATION_DBUS_NAME;
+}
+
 /**
  * animations_dbus_client_list_surfaces_finish:
  * @client: An #AnimationsDbusClient
@@ -222,9 +268,9 @@ on_animations_dbus_client_list_surfaces (GObject      *source_object,
        *surface_object_path_iter != NULL;
        ++surface_object_path_iter)
     {
-      animations_dbus_animatable_surface_proxy_new (priv->connection,
+      animations_dbus_animatable_surface_proxy_new (get_object_connection (priv),
                                                     G_DBUS_PROXY_FLAGS_NONE,
-                                                    "com.endlessm.Libanimation",
+                                                    get_object_bus_name (priv),
                                                     *surface_object_path_iter,
                                                     g_task_get_cancellable (task),
                                                     on_constructed_animatable_surface_proxy,
@@ -232,6 +278,256 @@ on_animations_dbus_client_list_surfaces (GObject      *source_object,
     }
 }
 
+/* Update the cached properties of @animatable_surface_proxy, then emit
+ * GDBusProxy::g-properties-changed on it as if it had received the
+ * PropertiesChanged signal itself, so that property notifications are
+ * emitted. */
+static void
+update_snapshot_surface_proxy (AnimationsDbusAnimatableSurfaceProxy *animatable_surface_proxy,
+                               GVariant                             *changed_properties,
+                               const char * const                   *invalidated_properties)
+{
+  GVariantIter iter;
+  const char *name;
+  GVariant *value;
+
+  g_variant_iter_init (&iter, changed_properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, &value))
+    {
+      g_autoptr(GVariant) owned_value = value;
+
+      g_dbus_proxy_set_cached_property (G_DBUS_PROXY (animatable_surface_proxy),
+                                        name,
+                                        owned_value);
+    }
+
+  for (const char * const *iter = invalidated_properties; *iter != NULL; ++iter)
+    g_dbus_proxy_set_cached_property (G_DBUS_PROXY (animatable_surface_proxy),
+                                      *iter,
+                                      NULL);
+
+  g_signal_emit_by_name (animatable_surface_proxy,
+                         "g-properties-changed",
+                         changed_properties,
+                         invalidated_properties);
+}
+
+static void
+on_surface_properties_changed (GDBusConnection *connection G_GNUC_UNUSED,
+                               const char      *sender_name G_GNUC_UNUSED,
+                               const char      *object_path,
+                               const char      *interface_name G_GNUC_UNUSED,
+                               const char      *signal_name G_GNUC_UNUSED,
+                               GVariant        *parameters,
+                               gpointer         user_data)
+{
+  AnimationsDbusClient *client = user_data;
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  AnimationsDbusAnimatableSurfaceProxy *animatable_surface_proxy = NULL;
+  g_autoptr(GVariant) changed_properties = NULL;
+  g_autofree const char **invalidated_properties = NULL;
+
+  if (priv->snapshot_surface_proxies == NULL ||
+      !g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+    return;
+
+  animatable_surface_proxy = g_hash_table_lookup (priv->snapshot_surface_proxies, object_path);
+
+  /* Proxies that were not built from a snapshot follow their
+   * properties themselves. */
+  if (animatable_surface_proxy == NULL)
+    return;
+
+  g_variant_get (parameters, "(&s@a{sv}^a&s)", NULL, &changed_properties, &invalidated_properties);
+  update_snapshot_surface_proxy (animatable_surface_proxy,
+                                 changed_properties,
+                                 invalidated_properties);
+}
+
+/* Must be called before making the first call that returns snapshots
+ * of surfaces, see snapshot_surface_proxies. */
+static void
+subscribe_to_surface_properties_changed (AnimationsDbusClient *client)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autofree char *name_owner = NULL;
+
+  if (priv->surface_properties_changed_id != 0)
+    return;
+
+  name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (priv->connection_manager_proxy));
+  priv->surface_properties_changed_id =
+    g_dbus_connection_signal_subscribe (get_object_connection (priv),
+                                        name_owner != NULL ? name_owner : get_object_bus_name (priv),
+                                        "org.freedesktop.DBus.Properties",
+                                        "PropertiesChanged",
+                                        NULL,
+                                        "com.endlessm.Libanimation.AnimatableSurface",
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_surface_properties_changed,
+                                        client,
+                                        NULL);
+}
+
+static void
+on_snapshot_surface_proxy_finalized (gpointer  user_data,
+                                     GObject  *where_the_object_was)
+{
+  AnimationsDbusClient *client = user_data;
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, priv->snapshot_surface_proxies);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      if (value == (gpointer) where_the_object_was)
+        {
+          g_hash_table_iter_remove (&iter);
+          return;
+        }
+    }
+}
+
+static gboolean
+unref_snapshot_surface_proxy (gpointer key G_GNUC_UNUSED,
+                              gpointer value,
+                              gpointer user_data)
+{
+  g_object_weak_unref (value, on_snapshot_surface_proxy_finalized, user_data);
+  return TRUE;
+}
+
+static AnimationsDbusClientSurface *
+client_surface_new_from_snapshot (AnimationsDbusClient  *client,
+                                  const char            *name_owner,
+                                  const char            *object_path,
+                                  GVariant              *properties,
+                                  GError               **error)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autoptr(AnimationsDbusAnimatableSurfaceProxy) animatable_surface_proxy = NULL;
+  const char * const no_invalidated_properties[] = { NULL };
+
+  /* A surface that is listed again shares the proxy that was built
+   * for it before, which the new snapshot brings up to date. */
+  animatable_surface_proxy = g_hash_table_lookup (priv->snapshot_surface_proxies, object_path);
+
+  if (animatable_surface_proxy != NULL)
+    {
+      g_object_ref (animatable_surface_proxy);
+    }
+  else
+    {
+      /* Since the name is a unique name and the properties are not
+       * loaded, constructing the proxy does not block on the bus. */
+      animatable_surface_proxy =
+        ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROXY (animations_dbus_animatable_surface_proxy_new_sync (get_object_connection (priv),
+                                                                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                                                                     name_owner,
+                                                                                                     object_path,
+                                                                                                     NULL,
+                                                                                                     error));
+
+      if (animatable_surface_proxy == NULL)
+        return NULL;
+
+      g_hash_table_insert (priv->snapshot_surface_proxies,
+                           g_strdup (object_path),
+                           animatable_surface_proxy);
+      g_object_weak_ref (G_OBJECT (animatable_surface_proxy),
+                         on_snapshot_surface_proxy_finalized,
+                         client);
+    }
+
+  update_snapshot_surface_proxy (animatable_surface_proxy,
+                                 properties,
+                                 no_invalidated_properties);
+
+  return animations_dbus_client_surface_new_for_proxy (ANIMATIONS_DBUS_ANIMATABLE_SURFACE (animatable_surface_proxy));
+}
+
+static GPtrArray *
+client_surfaces_new_from_snapshots (AnimationsDbusClient  *client,
+                                    GDBusProxy            *service_proxy,
+                                    GVariant              *surfaces,
+                                    GError               **error)
+{
+  g_autofree char *name_owner = g_dbus_proxy_get_name_owner (service_proxy);
+  const char *name = name_owner != NULL ? name_owner : g_dbus_proxy_get_name (service_proxy);
+  g_autoptr(GPtrArray) client_surfaces = g_ptr_array_new_full (g_variant_n_children (surfaces),
+                                                               g_object_unref);
+  GVariantIter iter;
+  const char *object_path;
+  GVariant *properties;
+
+  g_variant_iter_init (&iter, surfaces);
+  while (g_variant_iter_next (&iter, "(&o@a{sv})", &object_path, &properties))
+    {
+      g_autoptr(GVariant) owned_properties = properties;
+      AnimationsDbusClientSurface *client_surface =
+        client_surface_new_from_snapshot (client,
+                                          name,
+                                          object_path,
+                                          owned_properties,
+                                          error);
+
+      if (client_surface == NULL)
+        return NULL;
+
+      g_ptr_array_add (client_surfaces, client_surface);
+    }
+
+  return g_steal_pointer (&client_surfaces);
+}
+
+static void
+on_animations_dbus_client_list_surfaces_with_properties (GObject      *source_object,
+                                                         GAsyncResult *result,
+                                                         gpointer      user_data)
+{
+  g_autoptr(GTask) task = G_TASK (user_data);
+  AnimationsDbusClient *client = ANIMATIONS_DBUS_CLIENT (g_task_get_task_data (task));
+  g_autoptr(GVariant) surfaces = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_animation_manager_call_list_surfaces_with_properties_finish (ANIMATIONS_DBUS_ANIMATION_MANAGER (source_object),
+                                                                                    &surfaces,
+                                                                                    result,
+                                                                                    &local_error))
+    {
+      /* Services that predate ListSurfacesWithProperties only
+       * have ListSurfaces, so fall back to fetching the properties
+       * of each surface separately. */
+      if (g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        {
+          animations_dbus_animation_manager_call_list_surfaces (ANIMATIONS_DBUS_ANIMATION_MANAGER (source_object),
+                                                                g_task_get_cancellable (task),
+                                                                on_animations_dbus_client_list_surfaces,
+                                                                g_steal_pointer (&task));
+          return;
+        }
+
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  GPtrArray *client_surfaces = client_surfaces_new_from_snapshots (client,
+                                                                   G_DBUS_PROXY (source_object),
+                                                                   surfaces,
+                                                                   &local_error);
+
+  if (client_surfaces == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_pointer (task,
+                         client_surfaces,
+                         (GDestroyNotify) g_ptr_array_unref);
+}
+
 void
 animations_dbus_client_list_surfaces_async (AnimationsDbusClient *client,
                                             GCancellable         *cancellable,
@@ -243,10 +539,10 @@ animations_dbus_client_list_surfaces_async (AnimationsDbusClient *client,
 
   g_task_set_task_data (task, client, NULL);
 
-  animations_dbus_animation_manager_call_list_surfaces (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
-                                                        cancellable,
-                                                        on_animations_dbus_client_list_surfaces,
-                                                        g_steal_pointer (&task));
+  animations_dbus_animation_manager_call_list_surfaces_with_properties (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                                        cancellable,
+                                                                        on_animations_dbus_client_list_surfaces_with_properties,
+                                                                        g_steal_pointer (&task));
 }
 
 /**
@@ -266,20 +562,371 @@ GPtrArray *
 animations_dbus_client_list_surfaces (AnimationsDbusClient  *client,
                                       GError               **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  AnimationsDbusAnimationManager *animation_manager =
+    ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy);
+  g_autoptr(GVariant) surfaces = NULL;
+  g_auto(GStrv) surface_object_paths_array = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  if (animations_dbus_animation_manager_call_list_surfaces_with_properties_sync (animation_manager,
+                                                                                 &surfaces,
+                                                                                 NULL,
+                                                                                 &local_error))
+    return client_surfaces_new_from_snapshots (client,
+                                               G_DBUS_PROXY (animation_manager),
+                                               surfaces,
+                                               error);
+
+  if (!g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return NULL;
+    }
+
+  if (!animations_dbus_animation_manager_call_list_surfaces_sync (animation_manager,
+                                                                  &surface_object_paths_array,
+                                                                  NULL,
+                                                                  error))
+    return NULL;
+
+  g_autoptr(GPtrArray) client_surfaces = g_ptr_array_new_full (g_strv_length (surface_object_paths_array),
+                                                               g_object_unref);
+
+  for (const char **surface_object_path_iter = (const char **) surface_object_paths_array;
+       *surface_object_path_iter != NULL;
+       ++surface_object_path_iter)
+    {
+      g_autoptr(AnimationsDbusAnimatableSurface) animatable_surface_proxy =
+        animations_dbus_animatable_surface_proxy_new_sync (get_object_connection (priv),
+                                                           G_DBUS_PROXY_FLAGS_NONE,
+                                                           get_object_bus_name (priv),
+                                                           *surface_object_path_iter,
+                                                           NULL,
+                                                           error);
+
+      if (animatable_surface_proxy == NULL)
+        return NULL;
+
+      g_ptr_array_add (client_surfaces,
+                       animations_dbus_client_surface_new_for_proxy (animatable_surface_proxy));
+    }
+
+  return g_steal_pointer (&client_surfaces);
+}
+
+/**
+ * animations_dbus_client_get_initial_surfaces:
+ * @client: An #AnimationsDbusClient
+ *
+ * Get the surfaces that the server had when @client registered with
+ * it, which came in the same reply as the registration, so that they
+ * are available as soon as @client is initialized. Their properties
+ * are kept up to date, but surfaces that were added or removed since
+ * then are only reflected by animations_dbus_client_list_surfaces().
+ *
+ * Returns: (transfer none) (element-type AnimationsDbusClientSurface) (nullable):
+ *          A #GPtrArray of #AnimationsDbusClientSurface, or %NULL if
+ *          the server does not support returning them on registration.
+ */
+GPtrArray *
+animations_dbus_client_get_initial_surfaces (AnimationsDbusClient *client)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  return priv->initial_surfaces;
+}
+
+/**
+ * animations_dbus_client_set_geometry_notify_interval_finish:
+ * @client: An #AnimationsDbusClient
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish asynchronously requesting a minimum interval between
+ * geometry change notifications.
+ *
+ * Returns: %TRUE if the request was made, %FALSE with @error set
+ *          otherwise.
+ */
+gboolean
+animations_dbus_client_set_geometry_notify_interval_finish (AnimationsDbusClient  *client G_GNUC_UNUSED,
+                                                            GAsyncResult          *result,
+                                                            GError               **error)
+{
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+on_animations_dbus_client_set_geometry_notify_interval (GObject      *source_object,
+                                                        GAsyncResult *result,
+                                                        gpointer      user_data)
+{
+  g_autoptr(GTask) task = G_TASK (user_data);
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_animation_manager_call_set_geometry_notify_interval_finish (ANIMATIONS_DBUS_ANIMATION_MANAGER (source_object),
+                                                                                  result,
+                                                                                  &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * animations_dbus_client_set_geometry_notify_interval_async:
+ * @client: An #AnimationsDbusClient
+ * @interval: The minimum interval in milliseconds
+ * @cancellable: A #GCancellable
+ * @callback: A #GAsyncReadyCallback
+ * @user_data: Closure for @callback
+ *
+ * Asynchronously request that geometry changes on surfaces are not
+ * notified more often than once every @interval milliseconds. Since
+ * notifications are shared by all clients, the server only honours
+ * this once every client has made a request, using the shortest one.
+ */
+void
+animations_dbus_client_set_geometry_notify_interval_async (AnimationsDbusClient *client,
+                                                           unsigned int          interval,
+                                                           GCancellable         *cancellable,
+                                                           GAsyncReadyCallback   callback,
+                                                           gpointer              user_data)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autoptr(GTask) task = g_task_new (client, cancellable, callback, user_data);
+
+  animations_dbus_animation_manager_call_set_geometry_notify_interval (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                                       interval,
+                                                                       cancellable,
+                                                                       on_animations_dbus_client_set_geometry_notify_interval,
+                                                                       g_steal_pointer (&task));
+}
+
+/**
+ * animations_dbus_client_set_geometry_notify_interval:
+ * @client: An #AnimationsDbusClient
+ * @interval: The minimum interval in milliseconds
+ * @error: A #GError
+ *
+ * Request that geometry changes on surfaces are not notified more
+ * often than once every @interval milliseconds. See
+ * animations_dbus_client_set_geometry_notify_interval_async().
+ *
+ * Returns: %TRUE if the request was made, %FALSE with @error set
+ *          otherwise.
+ */
+gboolean
+animations_dbus_client_set_geometry_notify_interval (AnimationsDbusClient  *client,
+                                                     unsigned int           interval,
+                                                     GError               **error)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  return animations_dbus_animation_manager_call_set_geometry_notify_interval_sync (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                                                   interval,
+                                                                                   NULL,
+                                                                                   error);
+}
+
+static gboolean
+open_state_snapshot_from_reply (AnimationsDbusClient  *client,
+                                GVariant              *snapshot_handle,
+                                GUnixFDList           *fd_list,
+                                GError               **error)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  AnimationsDbusStateSnapshot *snapshot = NULL;
+  int fd = -1;
+
+  if (fd_list == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "No file descriptor was sent for the state snapshot");
+      return FALSE;
+    }
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (snapshot_handle), error);
+
+  if (fd < 0)
+    return FALSE;
+
+  snapshot = animations_dbus_state_snapshot_new_for_fd (fd, error);
+
+  if (snapshot == NULL)
+    return FALSE;
+
+  g_clear_pointer (&priv->state_snapshot, animations_dbus_state_snapshot_free);
+  priv->state_snapshot = snapshot;
+
+  return TRUE;
+}
+
+/**
+ * animations_dbus_client_open_state_snapshot_finish:
+ * @client: An #AnimationsDbusClient
+ * @result: A #GAsyncResult
+ * @error: A #GError
+ *
+ * Finish asynchronously opening the state snapshot of the server.
+ *
+ * Returns: %TRUE if the snapshot was opened, %FALSE with @error set
+ *          otherwise.
+ */
+gboolean
+animations_dbus_client_open_state_snapshot_finish (AnimationsDbusClient  *client G_GNUC_UNUSED,
+                                                   GAsyncResult          *result,
+                                                   GError               **error)
+{
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+on_animations_dbus_client_opened_state_snapshot (GObject      *source_object,
+                                                 GAsyncResult *result,
+                                                 gpointer      user_data)
+{
+  g_autoptr(GTask) task = G_TASK (user_data);
+  AnimationsDbusClient *client = g_task_get_source_object (task);
+  g_autoptr(GVariant) snapshot_handle = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_animation_manager_call_open_state_snapshot_finish (ANIMATIONS_DBUS_ANIMATION_MANAGER (source_object),
+                                                                          &snapshot_handle,
+                                                                          &fd_list,
+                                                                          result,
+                                                                          &local_error) ||
+      !open_state_snapshot_from_reply (client, snapshot_handle, fd_list, &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+/**
+ * animations_dbus_client_open_state_snapshot_async:
+ * @client: An #AnimationsDbusClient
+ * @cancellable: A #GCancellable
+ * @callback: A #GAsyncReadyCallback
+ * @user_data: Closure for @callback
+ *
+ * Asynchronously map the snapshot of the state of all surfaces that
+ * the server publishes in shared memory, if it was started with
+ * #AnimationsDbusServer:publish-state-snapshot. Once it is open, the
+ * snapshot can be read with animations_dbus_client_read_state_snapshot()
+ * without sending any messages to the server.
+ */
+void
+animations_dbus_client_open_state_snapshot_async (AnimationsDbusClient *client,
+                                                  GCancellable         *cancellable,
+                                                  GAsyncReadyCallback   callback,
+                                                  gpointer              user_data)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autoptr(GTask) task = g_task_new (client, cancellable, callback, user_data);
+
+  animations_dbus_animation_manager_call_open_state_snapshot (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                              NULL,
+                                                              cancellable,
+                                                              on_animations_dbus_client_opened_state_snapshot,
+                                                              g_steal_pointer (&task));
+}
+
+/**
+ * animations_dbus_client_open_state_snapshot:
+ * @client: An #AnimationsDbusClient
+ * @error: A #GError
+ *
+ * Map the snapshot of the state of all surfaces that the server
+ * publishes in shared memory. See
+ * animations_dbus_client_open_state_snapshot_async().
+ *
+ * Returns: %TRUE if the snapshot was opened, %FALSE with @error set
+ *          otherwise.
+ */
+gboolean
+animations_dbus_client_open_state_snapshot (AnimationsDbusClient  *client,
+                                            GError               **error)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autoptr(GVariant) snapshot_handle = NULL;
+  g_autoptr(GUnixFDList) fd_list = NULL;
+
+  if (!animations_dbus_animation_manager_call_open_state_snapshot_sync (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                                        NULL,
+                                                                        &snapshot_handle,
+                                                                        &fd_list,
+                                                                        NULL,
+                                                                        error))
+    return FALSE;
+
+  return open_state_snapshot_from_reply (client, snapshot_handle, fd_list, error);
+}
+
+/**
+ * animations_dbus_client_get_state_snapshot_sequence:
+ * @client: An #AnimationsDbusClient
+ *
+ * Get the sequence number of the state snapshot, which changes every
+ * time the server updates it. Comparing it against the sequence number
+ * from before the last call to animations_dbus_client_read_state_snapshot()
+ * tells whether reading the snapshot again would return anything new.
+ *
+ * Returns: The sequence number of the state snapshot, or 0 if it was
+ *          not opened.
+ */
+guint32
+animations_dbus_client_get_state_snapshot_sequence (AnimationsDbusClient *client)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  if (priv->state_snapshot == NULL)
+    return 0;
+
+  return animations_dbus_state_snapshot_get_sequence (priv->state_snapshot);
+}
+
+/**
+ * animations_dbus_client_read_state_snapshot:
+ * @client: An #AnimationsDbusClient
+ * @error: A #GError
+ *
+ * Read a consistent copy of the state snapshot opened with
+ * animations_dbus_client_open_state_snapshot(). This does not send
+ * any messages to the server.
+ *
+ * Returns: (transfer full): An "a(oa{sv})" array of the object paths of
+ *          all surfaces, each paired with a dictionary of their properties,
+ *          in the same format as returned by ListSurfacesWithProperties,
+ *          or %NULL with @error set.
+ */
+GVariant *
+animations_dbus_client_read_state_snapshot (AnimationsDbusClient  *client,
+                                            GError               **error)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  GVariant *surfaces = NULL;
 
-  animations_dbus_client_list_surfaces_async (client,
-                                              NULL,
-                                              animations_dbus_got_async_func_result,
-                                              &result);
+  if (priv->state_snapshot == NULL)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_NOT_INITIALIZED,
+                           "The state snapshot was not opened");
+      return NULL;
+    }
 
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
+  surfaces = animations_dbus_state_snapshot_read (priv->state_snapshot, error);
 
-  return animations_dbus_client_list_surfaces_finish (client,
-                                                      g_steal_pointer (&result),
-                                                      error);
+  return surfaces != NULL ? g_variant_ref_sink (surfaces) : NULL;
 }
 
 /**
@@ -344,9 +991,9 @@ on_animations_dbus_client_created_animation_effect (GObject      *source,
       return;
     }
 
-  animations_dbus_animation_effect_proxy_new (priv->connection,
+  animations_dbus_animation_effect_proxy_new (get_object_connection (priv),
                                               G_DBUS_PROXY_FLAGS_NONE,
-                                              "com.endlessm.Libanimation",
+                                              get_object_bus_name (priv),
                                               object_path,
                                               g_task_get_cancellable (task),
                                               on_constructed_animation_effect_callback,
@@ -398,23 +1045,30 @@ animations_dbus_client_create_animation_effect (AnimationsDbusClient  *client,
                                                 GVariant              *settings,
                                                 GError               **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autofree char *object_path = NULL;
 
-  animations_dbus_client_create_animation_effect_async (client,
-                                                        title,
-                                                        name,
-                                                        settings,
-                                                        NULL,
-                                                        animations_dbus_got_async_func_result,
-                                                        &result);
+  if (!animations_dbus_animation_manager_call_create_animation_effect_sync (ANIMATIONS_DBUS_ANIMATION_MANAGER (priv->animation_manager_proxy),
+                                                                            title,
+                                                                            name,
+                                                                            settings,
+                                                                            &object_path,
+                                                                            NULL,
+                                                                            error))
+    return NULL;
 
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
+  g_autoptr(AnimationsDbusAnimationEffect) effect_proxy =
+    animations_dbus_animation_effect_proxy_new_sync (get_object_connection (priv),
+                                                     G_DBUS_PROXY_FLAGS_NONE,
+                                                     get_object_bus_name (priv),
+                                                     object_path,
+                                                     NULL,
+                                                     error);
 
-  return animations_dbus_client_create_animation_effect_finish (client,
-                                                                g_steal_pointer (&result),
-                                                                error);
+  if (effect_proxy == NULL)
+    return NULL;
+
+  return animations_dbus_client_effect_new_for_proxy (effect_proxy);
 }
 
 /**
@@ -464,6 +1118,26 @@ on_created_animation_manager_proxy (GObject      *source G_GNUC_UNUSED,
   g_task_return_boolean (task, TRUE);
 }
 
+/* The AnimationManager has no properties, and its proxy is created for
+ * the unique name that the connection manager proxy already resolved,
+ * so creating it does not need any round trips to the service. */
+static inline void
+create_animation_manager_proxy (AnimationsDbusClientPrivate *priv,
+                                const char                  *object_path,
+                                GTask                       *task)
+{
+  g_autofree char *name_owner =
+    g_dbus_proxy_get_name_owner (G_DBUS_PROXY (priv->connection_manager_proxy));
+
+  animations_dbus_animation_manager_proxy_new (get_object_connection (priv),
+                                               G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                               name_owner != NULL ? name_owner : get_object_bus_name (priv),
+                                               object_path,
+                                               g_task_get_cancellable (task),
+                                               on_created_animation_manager_proxy,
+                                               task);
+}
+
 static void
 on_call_register_client_finished (GObject      *source,
                                   GAsyncResult *result,
@@ -484,13 +1158,125 @@ on_call_register_client_finished (GObject      *source,
       return;
     } 
 
-  animations_dbus_animation_manager_proxy_new (priv->connection,
-                                               G_DBUS_PROXY_FLAGS_NONE,
-                                               "com.endlessm.Libanimation",
-                                               object_path,
-                                               g_task_get_cancellable (task),
-                                               on_created_animation_manager_proxy,
-                                               task);
+  create_animation_manager_proxy (priv, object_path, task);
+}
+
+static void
+on_call_register_client_with_snapshot_finished (GObject      *source,
+                                                GAsyncResult *result,
+                                                gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AnimationsDbusClient *client = g_task_get_task_data (task);
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autofree char *object_path = NULL;
+  g_autoptr(GVariant) surfaces = NULL;
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_connection_manager_call_register_client_with_snapshot_finish (ANIMATIONS_DBUS_CONNECTION_MANAGER (source),
+                                                                                     &object_path,
+                                                                                     &surfaces,
+                                                                                     result,
+                                                                                     &local_error))
+    {
+      /* Services that predate RegisterClientWithSnapshot only
+       * have RegisterClient */
+      if (g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        {
+          animations_dbus_connection_manager_call_register_client (ANIMATIONS_DBUS_CONNECTION_MANAGER (source),
+                                                                   g_task_get_cancellable (task),
+                                                                   on_call_register_client_finished,
+                                                                   task);
+          return;
+        }
+
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  priv->initial_surfaces = client_surfaces_new_from_snapshots (client,
+                                                               G_DBUS_PROXY (source),
+                                                               surfaces,
+                                                               &local_error);
+
+  if (priv->initial_surfaces == NULL)
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  create_animation_manager_proxy (priv, object_path, task);
+}
+
+static inline void
+register_client (AnimationsDbusClientPrivate *priv,
+                 GTask                       *task)
+{
+  /* Now that we have a proxy to the connection manager, create an
+   * AnimationManager object on the remote end by calling RegisterClient. This
+   * will return an object path which we can use the create an
+   * AnimationManager proxy.
+   *
+   * Ask for the surfaces in the same reply, so that the client
+   * is usable straight away. */
+  subscribe_to_surface_properties_changed (g_task_get_task_data (task));
+  animations_dbus_connection_manager_call_register_client_with_snapshot (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
+                                                                         g_task_get_cancellable (task),
+                                                                         on_call_register_client_with_snapshot_finished,
+                                                                         task);
+}
+
+static void on_got_peer_address (GObject      *source,
+                                 GAsyncResult *result,
+                                 gpointer      user_data);
+
+static void
+on_connection_manager_surfaces_added (AnimationsDbusConnectionManager *connection_manager G_GNUC_UNUSED,
+                                      const char * const              *paths,
+                                      gpointer                         user_data)
+{
+  AnimationsDbusClient *client = user_data;
+
+  g_signal_emit (client,
+                 animations_dbus_client_signals[SIGNAL_SURFACES_ADDED],
+                 0,
+                 paths);
+}
+
+static void
+on_connection_manager_surfaces_removed (AnimationsDbusConnectionManager *connection_manager G_GNUC_UNUSED,
+                                        const char * const              *paths,
+                                        gpointer                         user_data)
+{
+  AnimationsDbusClient *client = user_data;
+
+  g_signal_emit (client,
+                 animations_dbus_client_signals[SIGNAL_SURFACES_REMOVED],
+                 0,
+                 paths);
+}
+
+/* Takes ownership of @connection_manager_proxy, replacing the proxy
+ * that was used to look up the peer address, if any. */
+static void
+set_connection_manager_proxy (AnimationsDbusClient                 *client,
+                              AnimationsDbusConnectionManagerProxy *connection_manager_proxy)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  g_clear_object (&priv->connection_manager_proxy);
+  priv->connection_manager_proxy = connection_manager_proxy;
+
+  g_signal_connect_object (priv->connection_manager_proxy,
+                           "surfaces-added",
+                           G_CALLBACK (on_connection_manager_surfaces_added),
+                           client,
+                           0);
+  g_signal_connect_object (priv->connection_manager_proxy,
+                           "surfaces-removed",
+                           G_CALLBACK (on_connection_manager_surfaces_removed),
+                           client,
+                           0);
 }
 
 static void
@@ -512,31 +1298,96 @@ on_created_connection_manager_proxy (GObject      *source G_GNUC_UNUSED,
       return;
     }
 
-  priv->connection_manager_proxy = g_steal_pointer (&connection_manager_proxy);
+  set_connection_manager_proxy (client, g_steal_pointer (&connection_manager_proxy));
 
-  /* Now that we have a proxy to the connection manager, create an
-   * AnimationManager object on the remote end by calling RegisterClient. This
-   * will return an object path which we can use the create an
-   * AnimationManager proxy. */
-  animations_dbus_connection_manager_call_register_client (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
-                                                           g_task_get_cancellable (task),
-                                                           on_call_register_client_finished,
-                                                           task);
+  /* Before registering on the bus, find out whether the service
+   * can be connected to directly instead. */
+  if (priv->peer_connection == NULL)
+    {
+      animations_dbus_connection_manager_call_get_peer_address (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
+                                                                g_task_get_cancellable (task),
+                                                                on_got_peer_address,
+                                                                task);
+      return;
+    }
+
+  register_client (priv, task);
 }
 
 static inline void
 create_animations_dbus_connection_manager_proxy (GDBusConnection *connection,
+                                                 const char      *name,
                                                  GTask           *task)
 {
+  /* The ConnectionManager has no properties, but it announces
+   * surfaces being added and removed with signals. */
   animations_dbus_connection_manager_proxy_new (connection,
-                                                G_DBUS_PROXY_FLAGS_NONE,
-                                                "com.endlessm.Libanimation",
+                                                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                name,
                                                 "/com/endlessm/Libanimation/ConnectionManager",
                                                 g_task_get_cancellable (task),
                                                 on_created_connection_manager_proxy,
                                                 task);
 }
 
+static void
+on_created_peer_connection (GObject      *source G_GNUC_UNUSED,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AnimationsDbusClient *client = g_task_get_task_data (task);
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autoptr(GError) local_error = NULL;
+
+  priv->peer_connection = g_dbus_connection_new_for_address_finish (result, &local_error);
+
+  /* The bus connection still works, so just keep using it */
+  if (priv->peer_connection == NULL)
+    {
+      g_debug ("Could not connect to the peer address, using the bus instead: %s",
+               local_error->message);
+      register_client (priv, task);
+      return;
+    }
+
+  /* Start over on the peer connection, where there is no bus name */
+  create_animations_dbus_connection_manager_proxy (priv->peer_connection,
+                                                   NULL,
+                                                   task);
+}
+
+static void
+on_got_peer_address (GObject      *source,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+  GTask *task = G_TASK (user_data);
+  AnimationsDbusClient *client = g_task_get_task_data (task);
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autofree char *peer_address = NULL;
+
+  /* Older services do not have GetPeerAddress and services that do
+   * not listen on a peer address return an empty string, in both
+   * cases carry on over the bus. */
+  if (!animations_dbus_connection_manager_call_get_peer_address_finish (ANIMATIONS_DBUS_CONNECTION_MANAGER (source),
+                                                                        &peer_address,
+                                                                        result,
+                                                                        NULL) ||
+      *peer_address == '\0')
+    {
+      register_client (priv, task);
+      return;
+    }
+
+  g_dbus_connection_new_for_address (peer_address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL,
+                                     g_task_get_cancellable (task),
+                                     on_created_peer_connection,
+                                     task);
+}
+
 static void
 on_got_session_bus (GObject      *source G_GNUC_UNUSED,
                     GAsyncResult *result,
@@ -559,7 +1410,9 @@ on_got_session_bus (GObject      *source G_GNUC_UNUSED,
   /* Now that we have the session bus, create a proxy for
    * the com.endlessm.Libanimation.ConnectionManager interface
    * com.endlessm.Libanimation:/com/endlessm/Libanimation/ConnectionManager */
-  create_animations_dbus_connection_manager_proxy (priv->connection, task);
+  create_animations_dbus_connection_manager_proxy (priv->connection,
+                                                   LIBANIMATION_DBUS_NAME,
+                                                   task);
 }
 
 static gboolean
@@ -602,6 +1455,7 @@ animations_dbus_client_init_async (GAsyncInitable      *initable,
   if (priv->connection != NULL)
     {
       create_animations_dbus_connection_manager_proxy (priv->connection,
+                                                       LIBANIMATION_DBUS_NAME,
                                                        task);
       return;
     }
@@ -619,6 +1473,129 @@ animations_dbus_client_async_initable_interface_init (GAsyncInitableIface *iface
   iface->init_finish = animations_dbus_client_init_finish;
 }
 
+static gboolean
+animations_dbus_client_init_sync (GInitable     *initable,
+                                  GCancellable  *cancellable,
+                                  GError       **error)
+{
+  AnimationsDbusClient *client = ANIMATIONS_DBUS_CLIENT (initable);
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+  g_autofree char *peer_address = NULL;
+  g_autofree char *object_path = NULL;
+  g_autofree char *name_owner = NULL;
+  g_autoptr(GVariant) surfaces = NULL;
+  g_autoptr(GError) local_error = NULL;
+  AnimationsDbusConnectionManagerProxy *connection_manager_proxy = NULL;
+
+  /* Already initialized */
+  if (priv->animation_manager_proxy != NULL)
+    return TRUE;
+
+  /* Same sequence as animations_dbus_client_init_async, but made
+   * directly with blocking calls so that no main context has to
+   * be iterated while waiting for the replies. */
+  if (priv->connection == NULL)
+    {
+      priv->connection = g_bus_get_sync (G_BUS_TYPE_SESSION, cancellable, error);
+
+      if (priv->connection == NULL)
+        return FALSE;
+    }
+
+  connection_manager_proxy =
+    ANIMATIONS_DBUS_CONNECTION_MANAGER_PROXY (animations_dbus_connection_manager_proxy_new_sync (priv->connection,
+                                                                                                 G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                                                                 LIBANIMATION_DBUS_NAME,
+                                                                                                 "/com/endlessm/Libanimation/ConnectionManager",
+                                                                                                 cancellable,
+                                                                                                 error));
+
+  if (connection_manager_proxy == NULL)
+    return FALSE;
+
+  set_connection_manager_proxy (client, connection_manager_proxy);
+
+  if (animations_dbus_connection_manager_call_get_peer_address_sync (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
+                                                                     &peer_address,
+                                                                     cancellable,
+                                                                     NULL) &&
+      *peer_address != '\0')
+    priv->peer_connection = g_dbus_connection_new_for_address_sync (peer_address,
+                                                                    G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                                    NULL,
+                                                                    cancellable,
+                                                                    NULL);
+
+  if (priv->peer_connection != NULL)
+    {
+      connection_manager_proxy =
+        ANIMATIONS_DBUS_CONNECTION_MANAGER_PROXY (animations_dbus_connection_manager_proxy_new_sync (priv->peer_connection,
+                                                                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                                                                     NULL,
+                                                                                                     "/com/endlessm/Libanimation/ConnectionManager",
+                                                                                                     cancellable,
+                                                                                                     error));
+
+      if (connection_manager_proxy == NULL)
+        return FALSE;
+
+      set_connection_manager_proxy (client, connection_manager_proxy);
+    }
+
+  subscribe_to_surface_properties_changed (client);
+
+  if (!animations_dbus_connection_manager_call_register_client_with_snapshot_sync (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
+                                                                                   &object_path,
+                                                                                   &surfaces,
+                                                                                   cancellable,
+                                                                                   &local_error) &&
+      !g_error_matches (local_error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      g_propagate_error (error, g_steal_pointer (&local_error));
+      return FALSE;
+    }
+
+  if (surfaces != NULL)
+    {
+      priv->initial_surfaces = client_surfaces_new_from_snapshots (client,
+                                                                   G_DBUS_PROXY (priv->connection_manager_proxy),
+                                                                   surfaces,
+                                                                   error);
+
+      if (priv->initial_surfaces == NULL)
+        return FALSE;
+    }
+  else if (!animations_dbus_connection_manager_call_register_client_sync (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_proxy),
+                                                                          &object_path,
+                                                                          cancellable,
+                                                                          error))
+    return FALSE;
+
+  name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (priv->connection_manager_proxy));
+
+  g_autoptr(AnimationsDbusAnimationManagerProxy) animation_manager_proxy =
+    ANIMATIONS_DBUS_ANIMATION_MANAGER_PROXY (animations_dbus_animation_manager_proxy_new_sync (get_object_connection (priv),
+                                                                                               G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                                                                                               name_owner != NULL ? name_owner : get_object_bus_name (priv),
+                                                                                               object_path,
+                                                                                               cancellable,
+                                                                                               error));
+
+  if (animation_manager_proxy == NULL)
+    return FALSE;
+
+  /* Only set last, since it marks the client as initialized. */
+  priv->animation_manager_proxy = g_steal_pointer (&animation_manager_proxy);
+
+  return TRUE;
+}
+
+static void
+animations_dbus_client_initable_interface_init (GInitableIface *iface)
+{
+  iface->init = animations_dbus_client_init_sync;
+}
+
 static void
 animations_dbus_client_set_property (GObject      *object,
                                      guint         prop_id,
@@ -667,16 +1644,48 @@ animations_dbus_client_dispose (GObject *object)
   AnimationsDbusClient *client = ANIMATIONS_DBUS_CLIENT (object);
   AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
 
+  if (priv->surface_properties_changed_id != 0)
+    {
+      g_dbus_connection_signal_unsubscribe (get_object_connection (priv),
+                                            priv->surface_properties_changed_id);
+      priv->surface_properties_changed_id = 0;
+    }
+
+  if (priv->snapshot_surface_proxies != NULL)
+    g_hash_table_foreach_remove (priv->snapshot_surface_proxies,
+                                 unref_snapshot_surface_proxy,
+                                 client);
+
   g_clear_object (&priv->animation_manager_proxy);
   g_clear_object (&priv->connection_manager_proxy);
+  g_clear_object (&priv->peer_connection);
   g_clear_object (&priv->connection);
+  g_clear_pointer (&priv->state_snapshot, animations_dbus_state_snapshot_free);
+  g_clear_pointer (&priv->initial_surfaces, g_ptr_array_unref);
 
   G_OBJECT_CLASS (animations_dbus_client_parent_class)->dispose (object);
 }
 
 static void
-animations_dbus_client_init (AnimationsDbusClient *client G_GNUC_UNUSED)
+animations_dbus_client_finalize (GObject *object)
 {
+  AnimationsDbusClient *client = ANIMATIONS_DBUS_CLIENT (object);
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  g_clear_pointer (&priv->snapshot_surface_proxies, g_hash_table_unref);
+
+  G_OBJECT_CLASS (animations_dbus_client_parent_class)->finalize (object);
+}
+
+static void
+animations_dbus_client_init (AnimationsDbusClient *client)
+{
+  AnimationsDbusClientPrivate *priv = animations_dbus_client_get_instance_private (client);
+
+  priv->snapshot_surface_proxies = g_hash_table_new_full (g_str_hash,
+                                                          g_str_equal,
+                                                          g_free,
+                                                          NULL);
 }
 
 static void
@@ -685,6 +1694,7 @@ animations_dbus_client_class_init (AnimationsDbusClientClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->dispose = animations_dbus_client_dispose;
+  object_class->finalize = animations_dbus_client_finalize;
   object_class->set_property = animations_dbus_client_set_property;
   object_class->get_property = animations_dbus_client_get_property;
 
@@ -698,6 +1708,46 @@ animations_dbus_client_class_init (AnimationsDbusClientClass *klass)
   g_object_class_install_properties (object_class,
                                      NPROPS,
                                      animations_dbus_client_properties);
+
+  /**
+   * AnimationsDbusClient::surfaces-added:
+   * @client: The #AnimationsDbusClient
+   * @paths: (array zero-terminated=1): The object paths of the surfaces
+   *
+   * Emitted once for each batch of surfaces that the service starts
+   * serving, with the object paths of all of them.
+   */
+  animations_dbus_client_signals[SIGNAL_SURFACES_ADDED] =
+    g_signal_new ("surfaces-added",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL,
+                  NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_STRV);
+
+  /**
+   * AnimationsDbusClient::surfaces-removed:
+   * @client: The #AnimationsDbusClient
+   * @paths: (array zero-terminated=1): The object paths of the surfaces
+   *
+   * Emitted once for each batch of surfaces that the service stops
+   * serving, with the object paths of all of them.
+   */
+  animations_dbus_client_signals[SIGNAL_SURFACES_REMOVED] =
+    g_signal_new ("surfaces-removed",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL,
+                  NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_STRV);
 }
 
 void
@@ -741,25 +1791,10 @@ animations_dbus_client_new_with_connection_async (GDBusConnection     *connectio
 AnimationsDbusClient *
 animations_dbus_client_new (GError **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-  g_autoptr(AnimationsDbusClient) client = g_object_new (ANIMATIONS_DBUS_TYPE_CLIENT, NULL);
-
-  g_async_initable_init_async (G_ASYNC_INITABLE (client),
-                               G_PRIORITY_DEFAULT,
-                               NULL,
-                               animations_dbus_got_async_func_result,
-                               &result);
-
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
-
-  if (!g_async_initable_init_finish (G_ASYNC_INITABLE (client),
-                                     g_steal_pointer (&result),
-                                     error))
-    return NULL;
-
-  return g_steal_pointer (&client);
+  return g_initable_new (ANIMATIONS_DBUS_TYPE_CLIENT,
+                         NULL,
+                         error,
+                         NULL);
 }
 
 /**
@@ -777,26 +1812,9 @@ AnimationsDbusClient *
 animations_dbus_client_new_with_connection (GDBusConnection  *connection,
                                             GError          **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-  g_autoptr(AnimationsDbusClient) client =
-    g_object_new (ANIMATIONS_DBUS_TYPE_CLIENT,
-                  "connection", connection,
-                  NULL);
-
-  g_async_initable_init_async (G_ASYNC_INITABLE (client),
-                               G_PRIORITY_DEFAULT,
-                               NULL,
-                               animations_dbus_got_async_func_result,
-                               &result);
-
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
-
-  if (!g_async_initable_init_finish (G_ASYNC_INITABLE (client),
-                                     g_steal_pointer (&result),
-                                     error))
-    return NULL;
-
-  return g_steal_pointer (&client);
+  return g_initable_new (ANIMATIONS_DBUS_TYPE_CLIENT,
+                         NULL,
+                         error,
+                         "connection", connection,
+                         NULL);
 }
@@ -63,6 +63,39 @@ void animations_dbus_client_list_surfaces_async (AnimationsDbusClient *client,
 GPtrArray * animations_dbus_client_list_surfaces (AnimationsDbusClient  *client,
                                                   GError               **error);
 
+GPtrArray * animations_dbus_client_get_initial_surfaces (AnimationsDbusClient *client);
+
+gboolean animations_dbus_client_set_geometry_notify_interval_finish (AnimationsDbusClient  *client,
+                                                                     GAsyncResult          *result,
+                                                                     GError               **error);
+
+void animations_dbus_client_set_geometry_notify_interval_async (AnimationsDbusClient *client,
+                                                                unsigned int          interval,
+                                                                GCancellable         *cancellable,
+                                                                GAsyncReadyCallback   callback,
+                                                                gpointer              user_data);
+
+gboolean animations_dbus_client_set_geometry_notify_interval (AnimationsDbusClient  *client,
+                                                              unsigned int           interval,
+                                                              GError               **error);
+
+gboolean animations_dbus_client_open_state_snapshot_finish (AnimationsDbusClient  *client,
+                                                            GAsyncResult          *result,
+                                                            GError               **error);
+
+void animations_dbus_client_open_state_snapshot_async (AnimationsDbusClient *client,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+
+gboolean animations_dbus_client_open_state_snapshot (AnimationsDbusClient  *client,
+                                                     GError               **error);
+
+guint32 animations_dbus_client_get_state_snapshot_sequence (AnimationsDbusClient *client);
+
+GVariant * animations_dbus_client_read_state_snapshot (AnimationsDbusClient  *client,
+                                                       GError               **error);
+
 AnimationsDbusClient * animations_dbus_client_new_finish (GObject       *source,
                                                           GAsyncResult  *result,
                                                           GError       **error);
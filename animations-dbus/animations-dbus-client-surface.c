@@ -23,7 +23,6 @@
 #include "animations-dbus-client-effect.h"
 #include "animations-dbus-client-surface.h"
 #include "animations-dbus-errors.h"
-#include "animations-dbus-main-context-private.h"
 #include "animations-dbus-objects.h"
 
 struct _AnimationsDbusClientSurface
@@ -157,20 +156,17 @@ GHashTable *
 animations_dbus_client_surface_list_available_effects (AnimationsDbusClientSurface  *surface,
                                                        GError                      **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-
-  animations_dbus_client_surface_list_available_effects_async (surface,
-                                                               NULL,
-                                                               animations_dbus_got_async_func_result,
-                                                               &result);
+  AnimationsDbusClientSurfacePrivate *priv =
+    animations_dbus_client_surface_get_instance_private (surface);
+  g_autoptr(GVariant) available_effects_variant = NULL;
 
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
+  if (!animations_dbus_animatable_surface_call_list_effects_sync (priv->proxy,
+                                                                  &available_effects_variant,
+                                                                  NULL,
+                                                                  error))
+    return NULL;
 
-  return animations_dbus_client_surface_list_available_effects_finish (surface,
-                                                                       g_steal_pointer (&result),
-                                                                       error);
+  return available_effects_variant_to_hash_table (available_effects_variant);
 }
 
 gboolean
@@ -232,22 +228,14 @@ animations_dbus_client_surface_detach_effect (AnimationsDbusClientSurface  *surf
                                               AnimationsDbusClientEffect   *effect,
                                               GError                      **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-
-  animations_dbus_client_surface_detach_effect_async (surface,
-                                                      event,
-                                                      effect,
-                                                      NULL,
-                                                      animations_dbus_got_async_func_result,
-                                                      &result);
-
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
-
-  return animations_dbus_client_surface_detach_effect_finish (surface,
-                                                              g_steal_pointer (&result),
-                                                              error);
+  AnimationsDbusClientSurfacePrivate *priv =
+    animations_dbus_client_surface_get_instance_private (surface);
+
+  return animations_dbus_animatable_surface_call_detach_animation_effect_sync (priv->proxy,
+                                                                              event,
+                                                                              animations_dbus_client_effect_get_object_path (effect),
+                                                                              NULL,
+                                                                              error);
 }
 
 gboolean
@@ -309,22 +297,14 @@ animations_dbus_client_surface_attach_effect (AnimationsDbusClientSurface  *surf
                                               AnimationsDbusClientEffect   *effect,
                                               GError                      **error)
 {
-  g_autoptr(GMainContextPopDefault) context = animations_dbus_main_context_new_default ();
-  g_autoptr(GAsyncResult) result = NULL;
-
-  animations_dbus_client_surface_attach_effect_async (surface,
-                                                      event,
-                                                      effect,
-                                                      NULL,
-                                                      animations_dbus_got_async_func_result,
-                                                      &result);
-
-  while (result == NULL)
-    g_main_context_iteration (context, TRUE);
-
-  return animations_dbus_client_surface_attach_effect_finish (surface,
-                                                              g_steal_pointer (&result),
-                                                              error);
+  AnimationsDbusClientSurfacePrivate *priv =
+    animations_dbus_client_surface_get_instance_private (surface);
+
+  return animations_dbus_animatable_surface_call_attach_animation_effect_sync (priv->proxy,
+                                                                              event,
+                                                                              animations_dbus_client_effect_get_object_path (effect),
+                                                                              NULL,
+                                                                              error);
 }
 
 static void
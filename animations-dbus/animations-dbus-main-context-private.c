@@ -1,31 +0,0 @@
-/* Copyright 2018 Endless Mobile, Inc.
- *
- * libanimation-dbus is free software: you can redistribute it and/or
- * modify it under the terms of the GNU Lesser General Public License as
- * published by the Free Software Foundation, either version 2.1 of the
- * License, or (at your option) any later version.
- *
- * libanimation-dbus is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU Lesser General Public License for more details.
- *
- * You should have received a copy of the GNU Lesser General Public
- * License along with eos-discovery-feed.  If not, see
- * <http://www.gnu.org/licenses/>.
- *
- * Authors:
- * - Sam Spilsbury <sam@endlessm.com>
- */
-
-#include "animations-dbus-main-context-private.h"
-
-void
-animations_dbus_got_async_func_result (GObject      *source G_GNUC_UNUSED,
-                                       GAsyncResult *result,
-                                       gpointer      user_data)
-{
-  GAsyncResult **out_result = user_data;
-
-  *out_result = result;
-}
@@ -19,12 +19,14 @@
  */
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "animations-dbus-errors.h"
 #include "animations-dbus-objects.h"
 #include "animations-dbus-server-animation-manager.h"
 #include "animations-dbus-server-effect.h"
 #include "animations-dbus-server-object.h"
+#include "animations-dbus-server-private.h"
 #include "animations-dbus-server-surface.h"
 
 struct _AnimationsDbusServerAnimationManager
@@ -38,8 +40,17 @@ typedef struct _AnimationsDbusServerAnimationManagerPrivate
   AnimationsDbusServer           *server;
   AnimationsDbusServerEffectFactory *effect_factory;
 
-  GHashTable *animation_effects;  /* (key-type: guint) (value-type: AnimationsDbusServerEffect) */
-  guint       animation_effect_serial;
+  /* Effect ids are handed out in sequence, so effects are kept in a
+   * table indexed by their id. They are not exported themselves, but
+   * dispatched from a subtree registered at the AnimationEffect node
+   * under this AnimationManager, so creating or deleting an effect
+   * does not register or unregister anything on the connection. */
+  GPtrArray  *animation_effects;  /* (element-type: AnimationsDbusServerEffect) (owned) */
+  guint       animation_effects_subtree_id;
+
+  /* Set by SetGeometryNotifyInterval */
+  gboolean    has_requested_geometry_notify_interval;
+  guint       requested_geometry_notify_interval;
 } AnimationsDbusServerAnimationManagerPrivate;
 
 static void animations_dbus_animation_manager_interface_init (AnimationsDbusAnimationManagerIface *iface);
@@ -82,10 +93,10 @@ animations_dbus_server_animation_manager_lookup_effect_by_id (AnimationsDbusServ
     animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
   AnimationsDbusServerEffect *server_animation_effect = NULL;
 
-  if (!g_hash_table_lookup_extended (priv->animation_effects,
-                                     GUINT_TO_POINTER (effect_id),
-                                     NULL,
-                                     (gpointer *) &server_animation_effect))
+  if (effect_id < priv->animation_effects->len)
+    server_animation_effect = g_ptr_array_index (priv->animation_effects, effect_id);
+
+  if (server_animation_effect == NULL)
     {
       g_set_error (error,
                    ANIMATIONS_DBUS_ERROR,
@@ -98,23 +109,146 @@ animations_dbus_server_animation_manager_lookup_effect_by_id (AnimationsDbusServ
   return server_animation_effect;
 }
 
+/* Look up the effect that is dispatched at @node in the AnimationEffect
+ * subtree, where @node is the effect id in decimal. */
+static AnimationsDbusServerEffect *
+lookup_dispatched_effect (AnimationsDbusServerAnimationManager *server_animation_manager,
+                          const char                           *node)
+{
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+  AnimationsDbusServerEffect *server_effect = NULL;
+  guint64 effect_id = 0;
+
+  if (node == NULL ||
+      !g_ascii_string_to_unsigned (node, 10, 0, priv->animation_effects->len, &effect_id, NULL) ||
+      effect_id == priv->animation_effects->len)
+    return NULL;
+
+  server_effect = g_ptr_array_index (priv->animation_effects, effect_id);
+
+  /* Destroyed effects are kept in the table, but no longer dispatched */
+  if (server_effect == NULL ||
+      animations_dbus_server_effect_get_object_path (server_effect) == NULL)
+    return NULL;
+
+  return server_effect;
+}
+
+static char **
+animation_effects_subtree_enumerate (GDBusConnection *connection G_GNUC_UNUSED,
+                                     const char      *sender G_GNUC_UNUSED,
+                                     const char      *object_path G_GNUC_UNUSED,
+                                     gpointer         user_data)
+{
+  AnimationsDbusServerAnimationManager *server_animation_manager = user_data;
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+  GPtrArray *nodes = g_ptr_array_new ();
+
+  for (unsigned int i = 0; i < priv->animation_effects->len; ++i)
+    {
+      AnimationsDbusServerEffect *server_effect = g_ptr_array_index (priv->animation_effects, i);
+
+      if (server_effect != NULL &&
+          animations_dbus_server_effect_get_object_path (server_effect) != NULL)
+        g_ptr_array_add (nodes, g_strdup_printf ("%u", i));
+    }
+
+  g_ptr_array_add (nodes, NULL);
+
+  return (char **) g_ptr_array_free (nodes, FALSE);
+}
+
+static GDBusInterfaceInfo **
+animation_effects_subtree_introspect (GDBusConnection *connection G_GNUC_UNUSED,
+                                      const char      *sender G_GNUC_UNUSED,
+                                      const char      *object_path G_GNUC_UNUSED,
+                                      const char      *node,
+                                      gpointer         user_data)
+{
+  GDBusInterfaceInfo **interfaces = NULL;
+
+  if (lookup_dispatched_effect (user_data, node) == NULL)
+    return NULL;
+
+  interfaces = g_new0 (GDBusInterfaceInfo *, 2);
+  interfaces[0] = g_dbus_interface_info_ref (animations_dbus_animation_effect_interface_info ());
+
+  return interfaces;
+}
+
+/* Calls and property accesses are handled by the vtable of the effect
+ * skeleton, exactly as if the skeleton had been exported at that path. */
+static const GDBusInterfaceVTable *
+animation_effects_subtree_dispatch (GDBusConnection *connection G_GNUC_UNUSED,
+                                    const char      *sender G_GNUC_UNUSED,
+                                    const char      *object_path G_GNUC_UNUSED,
+                                    const char      *interface_name,
+                                    const char      *node,
+                                    gpointer        *out_user_data,
+                                    gpointer         user_data)
+{
+  AnimationsDbusServerEffect *server_effect = lookup_dispatched_effect (user_data, node);
+
+  if (server_effect == NULL ||
+      g_strcmp0 (interface_name, animations_dbus_animation_effect_interface_info ()->name) != 0)
+    return NULL;
+
+  *out_user_data = server_effect;
+  return g_dbus_interface_skeleton_get_vtable (G_DBUS_INTERFACE_SKELETON (server_effect));
+}
+
+static const GDBusSubtreeVTable animation_effects_subtree_vtable =
+{
+  animation_effects_subtree_enumerate,
+  animation_effects_subtree_introspect,
+  animation_effects_subtree_dispatch
+};
+
 gboolean
 animations_dbus_server_animation_manager_export (AnimationsDbusServerAnimationManager  *server_animation_manager,
                                                  const char                            *object_path,
                                                  GError                               **error)
 {
   AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+  g_autofree char *animation_effects_object_path = g_strdup_printf ("%s/AnimationEffect",
+                                                                    object_path);
+
+  if (!animations_dbus_server_export_object (priv->server,
+                                             G_DBUS_INTERFACE_SKELETON (server_animation_manager),
+                                             object_path,
+                                             error))
+    return FALSE;
+
+  priv->animation_effects_subtree_id =
+    animations_dbus_server_register_subtree (priv->server,
+                                             animation_effects_object_path,
+                                             &animation_effects_subtree_vtable,
+                                             server_animation_manager,
+                                             error);
+
+  if (priv->animation_effects_subtree_id == 0)
+    {
+      animations_dbus_server_unexport_object (priv->server,
+                                              G_DBUS_INTERFACE_SKELETON (server_animation_manager));
+      return FALSE;
+    }
 
-  return g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (server_animation_manager),
-                                           priv->connection,
-                                           object_path,
-                                           error);
+  return TRUE;
 }
 
 void
 animations_dbus_server_animation_manager_unexport (AnimationsDbusServerAnimationManager *server_animation_manager)
 {
-  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (server_animation_manager));
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+
+  if (priv->animation_effects_subtree_id != 0)
+    {
+      animations_dbus_server_unregister_subtree (priv->server, priv->animation_effects_subtree_id);
+      priv->animation_effects_subtree_id = 0;
+    }
+
+  animations_dbus_server_unexport_object (priv->server,
+                                          G_DBUS_INTERFACE_SKELETON (server_animation_manager));
 }
 
 /**
@@ -140,7 +274,6 @@ animations_dbus_server_animation_manager_create_effect (AnimationsDbusServerAnim
                                                         GError                               **error)
 {
   AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
-  g_autoptr(GError) local_error = NULL;
 
   g_autoptr(AnimationsDbusServerEffectBridge) effect_bridge =
     animations_dbus_server_effect_factory_create_effect (priv->effect_factory,
@@ -158,71 +291,57 @@ animations_dbus_server_animation_manager_create_effect (AnimationsDbusServerAnim
                                        settings);
   const char *animation_manager_object_path =
     g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (server_animation_manager));
-  unsigned int available_serial = priv->animation_effect_serial++;
+  unsigned int available_serial = priv->animation_effects->len;
   g_autofree char *animation_effect_object_path = g_strdup_printf ("%s/AnimationEffect/%u",
                                                                    animation_manager_object_path,
                                                                    available_serial);
 
-  if (!animations_dbus_server_effect_export (animation_effect,
-                                             animation_effect_object_path,
-                                             &local_error))
-    {
-      g_autofree char *printed_variant = g_variant_print (settings, TRUE);
+  animations_dbus_server_effect_set_server (animation_effect, priv->server);
 
-      g_set_error (error,
-                   ANIMATIONS_DBUS_ERROR,
-                   ANIMATIONS_DBUS_ERROR_INTERNAL_ERROR,
-                   "Could not register AnimationEffect "
-                   "for title '%s', name '%s', settings '%s': %s",
-                   title,
-                   name,
-                   printed_variant,
-                   local_error->message);
-      return NULL;
-    }
+  /* The effect appears on the bus as soon as it is in the table,
+   * since the subtree dispatches to whatever is in there. */
+  animations_dbus_server_effect_set_dispatch_target (animation_effect,
+                                                     animation_effect_object_path,
+                                                     animations_dbus_server_get_connections (priv->server));
 
   /* We always insert the AnimationsDbusServerAnimationEffect here since
    * it should be visible and able to be looked up by clients on the bus. */
-  g_hash_table_insert (priv->animation_effects,
-                       GUINT_TO_POINTER (available_serial),
-                       g_object_ref (animation_effect));
+  g_ptr_array_add (priv->animation_effects, g_object_ref (animation_effect));
+  animations_dbus_server_track_animation_effect (priv->server, animation_effect);
   return g_steal_pointer (&animation_effect);
 }
 
-typedef gpointer (*ElementMapFunc) (gpointer);
-
-static GPtrArray *
-pointer_array_map (GPtrArray      *src,
-                   ElementMapFunc  mapper,
-                   GDestroyNotify  dst_free_func)
+static gboolean
+animations_dbus_server_animation_manager_list_surfaces (AnimationsDbusAnimationManager *animation_manager,
+                                                        GDBusMethodInvocation          *invocation)
 {
-  g_autoptr(GPtrArray) dst = g_ptr_array_new_full (src->len, dst_free_func);
+  AnimationsDbusServerAnimationManager *server_animation_manager =
+    ANIMATIONS_DBUS_SERVER_ANIMATION_MANAGER (animation_manager);
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
 
-  for (size_t i = 0 ; i < src->len; ++i)
-    g_ptr_array_add (dst, mapper (g_ptr_array_index (src, i)));
+  /* The object path array is cached on the server and only rebuilt
+   * when surfaces come and go, so wrap it directly in the reply
+   * instead of going through complete_list_surfaces, which would
+   * build a new array from a strv. */
+  GVariant *server_surface_object_paths =
+    animations_dbus_server_list_surface_object_paths (priv->server);
 
-  return g_steal_pointer (&dst);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&server_surface_object_paths, 1));
+  return TRUE;
 }
 
 static gboolean
-animations_dbus_server_animation_manager_list_surfaces (AnimationsDbusAnimationManager *animation_manager,
-                                                        GDBusMethodInvocation          *invocation)
+animations_dbus_server_animation_manager_list_surfaces_with_properties (AnimationsDbusAnimationManager *animation_manager,
+                                                                        GDBusMethodInvocation          *invocation)
 {
   AnimationsDbusServerAnimationManager *server_animation_manager =
     ANIMATIONS_DBUS_SERVER_ANIMATION_MANAGER (animation_manager);
   AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
-  GPtrArray *server_surfaces =
-    animations_dbus_server_list_surfaces (priv->server);
-  g_autoptr(GPtrArray) server_surface_object_paths =
-    pointer_array_map (server_surfaces,
-                       (ElementMapFunc) g_dbus_interface_skeleton_get_object_path,
-                       NULL);
 
-  g_ptr_array_add (server_surface_object_paths, NULL);
-
-  animations_dbus_animation_manager_complete_list_surfaces (animation_manager,
-                                                            invocation,
-                                                            (const char * const *) server_surface_object_paths->pdata);
+  animations_dbus_animation_manager_complete_list_surfaces_with_properties (animation_manager,
+                                                                            invocation,
+                                                                            animations_dbus_server_serialize_surfaces_with_properties (priv->server));
   return TRUE;
 }
 
@@ -252,7 +371,66 @@ animations_dbus_server_animation_manager_create_animation_effect (AnimationsDbus
 
   animations_dbus_animation_manager_complete_create_animation_effect (animation_manager,
                                                                       invocation,
-                                                                      g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (server_effect)));
+                                                                      animations_dbus_server_effect_get_object_path (server_effect));
+  return TRUE;
+}
+
+/* Get the interval the client that owns this AnimationManager requested
+ * with SetGeometryNotifyInterval, returning %FALSE if it never did. */
+gboolean
+animations_dbus_server_animation_manager_get_requested_geometry_notify_interval (AnimationsDbusServerAnimationManager *server_animation_manager,
+                                                                                 unsigned int                         *out_interval)
+{
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+
+  *out_interval = priv->requested_geometry_notify_interval;
+  return priv->has_requested_geometry_notify_interval;
+}
+
+static gboolean
+animations_dbus_server_animation_manager_set_geometry_notify_interval (AnimationsDbusAnimationManager *animation_manager,
+                                                                       GDBusMethodInvocation          *invocation,
+                                                                       unsigned int                    interval)
+{
+  AnimationsDbusServerAnimationManager *server_animation_manager =
+    ANIMATIONS_DBUS_SERVER_ANIMATION_MANAGER (animation_manager);
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+
+  priv->has_requested_geometry_notify_interval = TRUE;
+  priv->requested_geometry_notify_interval = interval;
+
+  animations_dbus_server_update_geometry_notify_interval (priv->server);
+
+  animations_dbus_animation_manager_complete_set_geometry_notify_interval (animation_manager,
+                                                                           invocation);
+  return TRUE;
+}
+
+static gboolean
+animations_dbus_server_animation_manager_open_state_snapshot (AnimationsDbusAnimationManager *animation_manager,
+                                                              GDBusMethodInvocation          *invocation,
+                                                              GUnixFDList                    *fd_list G_GNUC_UNUSED)
+{
+  AnimationsDbusServerAnimationManager *server_animation_manager =
+    ANIMATIONS_DBUS_SERVER_ANIMATION_MANAGER (animation_manager);
+  AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
+  g_autoptr(GUnixFDList) out_fd_list = NULL;
+  g_autoptr(GError) local_error = NULL;
+  int fd = animations_dbus_server_open_state_snapshot_fd (priv->server, &local_error);
+
+  if (fd < 0)
+    {
+      g_dbus_method_invocation_return_gerror (invocation, local_error);
+      return TRUE;
+    }
+
+  /* The fd list takes ownership of the fd */
+  out_fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+
+  animations_dbus_animation_manager_complete_open_state_snapshot (animation_manager,
+                                                                  invocation,
+                                                                  out_fd_list,
+                                                                  g_variant_new_handle (0));
   return TRUE;
 }
 
@@ -260,7 +438,10 @@ static void
 animations_dbus_animation_manager_interface_init (AnimationsDbusAnimationManagerIface *iface)
 {
   iface->handle_list_surfaces = animations_dbus_server_animation_manager_list_surfaces;
+  iface->handle_list_surfaces_with_properties = animations_dbus_server_animation_manager_list_surfaces_with_properties;
   iface->handle_create_animation_effect = animations_dbus_server_animation_manager_create_animation_effect;
+  iface->handle_set_geometry_notify_interval = animations_dbus_server_animation_manager_set_geometry_notify_interval;
+  iface->handle_open_state_snapshot = animations_dbus_server_animation_manager_open_state_snapshot;
 }
 
 static void
@@ -322,22 +503,17 @@ animations_dbus_server_animation_manager_get_property (GObject    *object,
 }
 
 static void
-unref_hash_table_and_destroy_all_server_effect_values (GHashTable *animation_effects)
+unref_array_and_destroy_all_server_effects (GPtrArray *animation_effects)
 {
-  GHashTableIter iter;
-  gpointer value;
-
   /* Need to manually call animations_dbus_server_effect_destroy on each
-   * member of the hash table, since it is possible that language bindings
+   * member of the table, since it is possible that language bindings
    * could still have a reference on the effects. Calling
    * animations_dbus_server_effect_destroy will ensure that the "destroy"
    * signal gets emitted and the effect is detached from any surfaces. */
-  g_hash_table_iter_init (&iter, animation_effects);
-
-  while (g_hash_table_iter_next (&iter, NULL, &value))
-    animations_dbus_server_effect_destroy (ANIMATIONS_DBUS_SERVER_EFFECT (value));
+  for (unsigned int i = 0; i < animation_effects->len; ++i)
+    animations_dbus_server_effect_destroy (ANIMATIONS_DBUS_SERVER_EFFECT (g_ptr_array_index (animation_effects, i)));
 
-  g_hash_table_unref (animation_effects);
+  g_ptr_array_unref (animation_effects);
 }
 
 static void
@@ -346,7 +522,10 @@ animations_dbus_server_animation_manager_finalize (GObject *object)
   AnimationsDbusServerAnimationManager *server_animation_manager = ANIMATIONS_DBUS_SERVER_ANIMATION_MANAGER (object);
   AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (server_animation_manager);
 
-  g_clear_pointer (&priv->animation_effects, unref_hash_table_and_destroy_all_server_effect_values);
+  if (priv->animation_effects_subtree_id != 0)
+    animations_dbus_server_unregister_subtree (priv->server, priv->animation_effects_subtree_id);
+
+  g_clear_pointer (&priv->animation_effects, unref_array_and_destroy_all_server_effects);
 
   G_OBJECT_CLASS (animations_dbus_server_animation_manager_parent_class)->finalize (object);
 }
@@ -356,10 +535,7 @@ animations_dbus_server_animation_manager_init (AnimationsDbusServerAnimationMana
 {
   AnimationsDbusServerAnimationManagerPrivate *priv = animations_dbus_server_animation_manager_get_instance_private (animation_manager);
 
-  priv->animation_effects = g_hash_table_new_full (g_direct_hash,
-                                                   g_direct_equal,
-                                                   NULL,
-                                                   g_object_unref);
+  priv->animation_effects = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
 static void
@@ -19,24 +19,46 @@
  */
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "animations-dbus-errors.h"
 #include "animations-dbus-objects.h"
 #include "animations-dbus-server-effect.h"
+#include "animations-dbus-server-private.h"
 #include "animations-dbus-server-skeleton-properties.h"
+#include "animations-dbus-settings-channel.h"
 
 struct _AnimationsDbusServerEffect
 {
   AnimationsDbusAnimationEffectSkeleton parent_instance;
 };
 
+typedef struct
+{
+  double   value;
+  gboolean pending;
+} SettingsChannelValue;
+
 typedef struct _AnimationsDbusServerEffectPrivate
 {
   GDBusConnection                  *connection;
+  AnimationsDbusServer             *server;  /* (unowned) (nullable) */
   AnimationsDbusServerEffectBridge *effect_bridge;
 
   char                             *title;
   gboolean                          is_destroyed;
+
+  /* Every surface event this effect is attached to */
+  GQueue                            attachments;  /* (element-type: AnimationsDbusServerSurfaceAttachment) (unowned) */
+
+  /* Only set while a client has a settings channel open. The keys
+   * in the channel are indices into settings_channel_keys, and the
+   * latest value drained for each of them is collected in
+   * settings_channel_values before it is applied. */
+  AnimationsDbusSettingsChannel    *settings_channel;
+  GStrv                             settings_channel_keys;
+  unsigned int                      n_settings_channel_keys;
+  SettingsChannelValue             *settings_channel_values;
 } AnimationsDbusServerEffectPrivate;
 
 static void animations_dbus_animation_effect_interface_init (AnimationsDbusAnimationEffectIface *iface);
@@ -70,6 +92,114 @@ enum {
 
 static unsigned int animations_dbus_server_effect_signals[NSIGNALS];
 
+static AnimationsDbusPropertiesChangedQueue *
+properties_changed_queue_for_effect (AnimationsDbusServerEffect *server_effect)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  if (priv->server == NULL)
+    return NULL;
+
+  return animations_dbus_server_get_properties_changed_queue (priv->server);
+}
+
+static void
+on_settings_channel_update (guint32  key,
+                            double   value,
+                            gpointer user_data)
+{
+  AnimationsDbusServerEffectPrivate *priv = user_data;
+
+  /* The key comes from the client, so it is not trusted */
+  if (key >= priv->n_settings_channel_keys)
+    return;
+
+  priv->settings_channel_values[key].value = value;
+  priv->settings_channel_values[key].pending = TRUE;
+}
+
+/* Apply the updates in the settings channel of @server_effect. Called
+ * by its server whenever it drains the settings channels. */
+void
+animations_dbus_server_effect_drain_settings_channel (AnimationsDbusServerEffect *server_effect)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+  gboolean changed = FALSE;
+
+  if (animations_dbus_settings_channel_drain (priv->settings_channel,
+                                              on_settings_channel_update,
+                                              priv) == 0)
+    return;
+
+  /* Only the latest value for each setting is applied */
+  g_object_freeze_notify (G_OBJECT (priv->effect_bridge));
+
+  for (unsigned int i = 0; i < priv->n_settings_channel_keys; ++i)
+    {
+      g_autoptr(GVariant) value = NULL;
+      g_autoptr(GError) local_error = NULL;
+
+      if (!priv->settings_channel_values[i].pending)
+        continue;
+
+      priv->settings_channel_values[i].pending = FALSE;
+      value = g_variant_ref_sink (g_variant_new_double (priv->settings_channel_values[i].value));
+
+      if (!animations_dbus_set_property_from_variant (G_OBJECT (priv->effect_bridge),
+                                                      priv->settings_channel_keys[i],
+                                                      value,
+                                                      &local_error))
+        {
+          g_debug ("Dropping value from settings channel: %s", local_error->message);
+          continue;
+        }
+
+      changed = TRUE;
+    }
+
+  g_object_thaw_notify (G_OBJECT (priv->effect_bridge));
+
+  if (changed)
+    animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_effect (server_effect),
+                                                                     G_DBUS_INTERFACE_SKELETON (server_effect),
+                                                                     &animations_dbus_animation_effect_property_table,
+                                                                     ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATION_EFFECT_PROPERTY_SETTINGS));
+}
+
+static void
+close_settings_channel (AnimationsDbusServerEffect *server_effect)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  if (priv->settings_channel == NULL)
+    return;
+
+  g_clear_pointer (&priv->settings_channel, animations_dbus_settings_channel_free);
+  g_clear_pointer (&priv->settings_channel_keys, g_strfreev);
+  g_clear_pointer (&priv->settings_channel_values, g_free);
+  priv->n_settings_channel_keys = 0;
+
+  if (priv->server != NULL)
+    animations_dbus_server_remove_settings_channel (priv->server, server_effect);
+}
+
+static void
+open_settings_channel (AnimationsDbusServerEffect    *server_effect,
+                       AnimationsDbusSettingsChannel *channel)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  close_settings_channel (server_effect);
+
+  priv->settings_channel = channel;
+  priv->settings_channel_keys = animations_dbus_list_double_property_names (G_OBJECT (priv->effect_bridge));
+  priv->n_settings_channel_keys = g_strv_length (priv->settings_channel_keys);
+  priv->settings_channel_values = g_new0 (SettingsChannelValue, priv->n_settings_channel_keys);
+
+  if (priv->server != NULL)
+    animations_dbus_server_add_settings_channel (priv->server, server_effect);
+}
+
 gboolean
 animations_dbus_server_effect_export (AnimationsDbusServerEffect  *server_effect,
                                       const char                  *object_path,
@@ -83,6 +213,69 @@ animations_dbus_server_effect_export (AnimationsDbusServerEffect  *server_effect
                                            error);
 }
 
+/* Effects created through an AnimationManager are not exported
+ * themselves, they are dispatched from the subtree of their
+ * AnimationManager instead. This records the @object_path that
+ * @server_effect is dispatched at and the @connections that its
+ * PropertiesChanged signals are sent on. */
+void
+animations_dbus_server_effect_set_dispatch_target (AnimationsDbusServerEffect *server_effect,
+                                                   const char                 *object_path,
+                                                   GPtrArray                  *connections)
+{
+  animations_dbus_set_skeleton_dispatch_target (G_DBUS_INTERFACE_SKELETON (server_effect),
+                                                object_path,
+                                                connections);
+}
+
+/* Effects created through an AnimationManager belong to its server,
+ * which queues up their property changes and drains their settings
+ * channels. */
+void
+animations_dbus_server_effect_set_server (AnimationsDbusServerEffect *server_effect,
+                                          AnimationsDbusServer       *server)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  if (priv->server != NULL)
+    g_object_remove_weak_pointer (G_OBJECT (priv->server), (gpointer *) &priv->server);
+
+  priv->server = server;
+
+  if (priv->server != NULL)
+    g_object_add_weak_pointer (G_OBJECT (priv->server), (gpointer *) &priv->server);
+}
+
+/* The object path that @server_effect is exported or dispatched at,
+ * or %NULL once it has been destroyed. */
+const char *
+animations_dbus_server_effect_get_object_path (AnimationsDbusServerEffect *server_effect)
+{
+  return animations_dbus_get_skeleton_object_path (G_DBUS_INTERFACE_SKELETON (server_effect));
+}
+
+/* Called by AnimationsDbusServerSurface when @server_effect is attached
+ * to one of its events. @effect_link is embedded in the attachment and
+ * stays linked until animations_dbus_server_effect_untrack_attachment()
+ * is called when the attachment is freed. */
+void
+animations_dbus_server_effect_track_attachment (AnimationsDbusServerEffect *server_effect,
+                                                GList                      *effect_link)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  g_queue_push_tail_link (&priv->attachments, effect_link);
+}
+
+void
+animations_dbus_server_effect_untrack_attachment (AnimationsDbusServerEffect *server_effect,
+                                                  GList                      *effect_link)
+{
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  g_queue_unlink (&priv->attachments, effect_link);
+}
+
 const char *
 animations_dbus_server_effect_get_title (AnimationsDbusServerEffect *server_effect)
 {
@@ -97,7 +290,8 @@ animations_dbus_server_effect_get_title (AnimationsDbusServerEffect *server_effe
  *
  * Cause the effect to be marked as "destroyed", which unexports it from
  * the bus and emits the "destroy" signal, notifying interested listeners
- * that the effect should be considered inert. It is safe to call this
+ * that the effect should be considered inert. The effect is also
+ * detached from every surface it is attached to. It is safe to call this
  * function multiple times, since the destroy signal emission and
  * unexport process will only happen once.
  */
@@ -106,10 +300,20 @@ animations_dbus_server_effect_destroy (AnimationsDbusServerEffect *server_effect
 {
   AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
 
+  close_settings_channel (server_effect);
+
   if (!priv->is_destroyed)
-    g_signal_emit (server_effect,
-                   animations_dbus_server_effect_signals[SIGNAL_DESTROYED],
-                   0);
+    {
+      GList *link = NULL;
+
+      g_signal_emit (server_effect,
+                     animations_dbus_server_effect_signals[SIGNAL_DESTROYED],
+                     0);
+
+      /* Removing the attachment unlinks it from priv->attachments */
+      while ((link = g_queue_peek_head_link (&priv->attachments)) != NULL)
+        animations_dbus_server_surface_remove_attachment (link->data);
+    }
 
   /* XXX: Not ideal to have a check like this, but since animations_dbus_server_effect_destroy
    *      can be called from animations_dbus_server_effect_dispose (where our reference count
@@ -124,6 +328,10 @@ animations_dbus_server_effect_destroy (AnimationsDbusServerEffect *server_effect
                                                           priv->connection);
     }
 
+  /* Stops it from being dispatched by the subtree of its AnimationManager */
+  if (G_IS_DBUS_INTERFACE_SKELETON (server_effect))
+    animations_dbus_server_effect_set_dispatch_target (server_effect, NULL, NULL);
+
   priv->is_destroyed = TRUE;
 }
 
@@ -132,8 +340,15 @@ animations_dbus_server_effect_delete (AnimationsDbusAnimationEffect *animation_e
                                       GDBusMethodInvocation         *invocation)
 {
   AnimationsDbusServerEffect *server_effect = ANIMATIONS_DBUS_SERVER_EFFECT (animation_effect);
+  AnimationsDbusPropertiesChangedQueue *queue = properties_changed_queue_for_effect (server_effect);
 
   animations_dbus_server_effect_destroy (server_effect);
+
+  /* The effect is detached from every surface it was attached to,
+   * so send the changes to all of them before returning. */
+  if (queue != NULL)
+    animations_dbus_properties_changed_queue_flush (queue);
+
   animations_dbus_animation_effect_complete_delete (animation_effect, invocation);
 
   return TRUE;
@@ -155,23 +370,96 @@ animations_dbus_server_effect_change_setting (AnimationsDbusAnimationEffect *ani
                                                   unboxed,
                                                   &local_error))
     {
-      g_dbus_method_invocation_return_gerror (invocation, g_steal_pointer (&local_error));
+      g_dbus_method_invocation_return_gerror (invocation, local_error);
       return TRUE;
     }
 
-  const char *props[] = { "settings", NULL };
-  animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (animation_effect),
-                                                                   props);
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_effect (server_effect),
+                                                                   G_DBUS_INTERFACE_SKELETON (animation_effect),
+                                                                   &animations_dbus_animation_effect_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATION_EFFECT_PROPERTY_SETTINGS));
+  animations_dbus_properties_changed_queue_flush_skeleton (properties_changed_queue_for_effect (server_effect),
+                                                           G_DBUS_INTERFACE_SKELETON (animation_effect));
 
   animations_dbus_animation_effect_complete_change_setting (animation_effect, invocation);
   return TRUE;
 }
 
+static gboolean
+animations_dbus_server_effect_change_settings (AnimationsDbusAnimationEffect *animation_effect,
+                                               GDBusMethodInvocation         *invocation,
+                                               GVariant                      *settings)
+{
+  AnimationsDbusServerEffect *server_effect = ANIMATIONS_DBUS_SERVER_EFFECT (animation_effect);
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+  g_autoptr(GError) local_error = NULL;
+
+  if (!animations_dbus_set_properties_from_variant (G_OBJECT (priv->effect_bridge),
+                                                    settings,
+                                                    &local_error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, local_error);
+      return TRUE;
+    }
+
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_effect (server_effect),
+                                                                   G_DBUS_INTERFACE_SKELETON (animation_effect),
+                                                                   &animations_dbus_animation_effect_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATION_EFFECT_PROPERTY_SETTINGS));
+  animations_dbus_properties_changed_queue_flush_skeleton (properties_changed_queue_for_effect (server_effect),
+                                                           G_DBUS_INTERFACE_SKELETON (animation_effect));
+
+  animations_dbus_animation_effect_complete_change_settings (animation_effect, invocation);
+  return TRUE;
+}
+
+static gboolean
+animations_dbus_server_effect_open_settings_channel (AnimationsDbusAnimationEffect *animation_effect,
+                                                     GDBusMethodInvocation         *invocation,
+                                                     GUnixFDList                   *fd_list G_GNUC_UNUSED)
+{
+  AnimationsDbusServerEffect *server_effect = ANIMATIONS_DBUS_SERVER_EFFECT (animation_effect);
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+  g_autoptr(GUnixFDList) out_fd_list = g_unix_fd_list_new ();
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(AnimationsDbusSettingsChannel) channel =
+    animations_dbus_settings_channel_new (&local_error);
+  int handle = -1;
+
+  if (channel == NULL)
+    {
+      g_dbus_method_invocation_return_gerror (invocation, local_error);
+      return TRUE;
+    }
+
+  /* The fd list gets its own duplicate of the fd */
+  handle = g_unix_fd_list_append (out_fd_list,
+                                  animations_dbus_settings_channel_get_fd (channel),
+                                  &local_error);
+
+  if (handle < 0)
+    {
+      g_dbus_method_invocation_return_gerror (invocation, local_error);
+      return TRUE;
+    }
+
+  open_settings_channel (server_effect, g_steal_pointer (&channel));
+
+  animations_dbus_animation_effect_complete_open_settings_channel (animation_effect,
+                                                                   invocation,
+                                                                   out_fd_list,
+                                                                   g_variant_new_handle (handle),
+                                                                   (const char * const *) priv->settings_channel_keys);
+  return TRUE;
+}
+
 static void
 animations_dbus_animation_effect_interface_init (AnimationsDbusAnimationEffectIface *effect)
 {
   effect->handle_delete = animations_dbus_server_effect_delete;
   effect->handle_change_setting = animations_dbus_server_effect_change_setting;
+  effect->handle_change_settings = animations_dbus_server_effect_change_settings;
+  effect->handle_open_settings_channel = animations_dbus_server_effect_open_settings_channel;
 }
 
 static void
@@ -275,6 +563,7 @@ animations_dbus_server_effect_dispose (GObject *object)
   /* Destroy the effect and emit the destroy signal now which will
    * cause the effect to be detached from any surfaces it is attached to. */
   animations_dbus_server_effect_destroy (server_effect);
+  animations_dbus_server_effect_set_server (server_effect, NULL);
 
   g_clear_object (&priv->effect_bridge);
 
@@ -293,8 +582,11 @@ animations_dbus_server_effect_finalize (GObject *object)
 }
 
 static void
-animations_dbus_server_effect_init (AnimationsDbusServerEffect *server_effect G_GNUC_UNUSED)
+animations_dbus_server_effect_init (AnimationsDbusServerEffect *server_effect)
 {
+  AnimationsDbusServerEffectPrivate *priv = animations_dbus_server_effect_get_instance_private (server_effect);
+
+  g_queue_init (&priv->attachments);
 }
 
 static void
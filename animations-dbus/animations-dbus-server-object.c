@@ -19,51 +19,333 @@
  */
 
 #include <gio/gio.h>
+#include <string.h>
 
 #include "animations-dbus-errors.h"
 #include "animations-dbus-objects.h"
 #include "animations-dbus-server-object.h"
 #include "animations-dbus-server-animation-manager.h"
 #include "animations-dbus-server-effect-factory-interface.h"
+#include "animations-dbus-server-private.h"
+#include "animations-dbus-server-skeleton-properties.h"
 #include "animations-dbus-server-surface.h"
+#include "animations-dbus-state-snapshot.h"
 
 struct _AnimationsDbusServer
 {
   GObject parent_instance;
 };
 
+/* Everything the server keeps track of for a registered client */
+typedef struct _AnimationsDbusServerClient
+{
+  char                                 *name;               /* (owned) */
+  guint                                 animation_manager_id;
+  AnimationsDbusServerAnimationManager *animation_manager;  /* (owned) */
+
+  /* Clients on the bus are unregistered when their unique name loses
+   * its owner. Peers are unregistered when their connection closes. */
+  GDBusConnection                      *bus_connection;     /* (owned) (nullable) */
+  guint                                 name_owner_changed_id;
+} AnimationsDbusServerClient;
+
+static AnimationsDbusServerClient *
+animations_dbus_server_client_new (const char                           *name,
+                                   guint                                 animation_manager_id,
+                                   AnimationsDbusServerAnimationManager *animation_manager)
+{
+  AnimationsDbusServerClient *client = g_new0 (AnimationsDbusServerClient, 1);
+
+  client->name = g_strdup (name);
+  client->animation_manager_id = animation_manager_id;
+  client->animation_manager = g_object_ref (animation_manager);
+
+  return client;
+}
+
+static void
+animations_dbus_server_client_free (AnimationsDbusServerClient *client)
+{
+  if (client->name_owner_changed_id != 0)
+    g_dbus_connection_signal_unsubscribe (client->bus_connection,
+                                          client->name_owner_changed_id);
+
+  g_clear_object (&client->bus_connection);
+  g_clear_pointer (&client->name, g_free);
+  g_clear_object (&client->animation_manager);
+
+  g_free (client);
+}
+
+/* Everything the server keeps track of for a peer to peer connection */
+typedef struct _AnimationsDbusServerPeer
+{
+  char                     *name;            /* (owned) */
+  GDBusConnection          *connection;      /* (owned) */
+  GDBusObjectManagerServer *object_manager;  /* (owned) */
+  gulong                    closed_id;
+} AnimationsDbusServerPeer;
+
+static AnimationsDbusServerPeer *
+animations_dbus_server_peer_new (const char      *name,
+                                 GDBusConnection *connection,
+                                 const char      *object_manager_path)
+{
+  AnimationsDbusServerPeer *peer = g_new0 (AnimationsDbusServerPeer, 1);
+
+  peer->name = g_strdup (name);
+  peer->connection = g_object_ref (connection);
+  peer->object_manager = g_dbus_object_manager_server_new (object_manager_path);
+
+  return peer;
+}
+
+static void
+animations_dbus_server_peer_free (AnimationsDbusServerPeer *peer)
+{
+  if (peer->closed_id != 0)
+    g_signal_handler_disconnect (peer->connection, peer->closed_id);
+
+  /* Unexports every object from the connection, the objects
+   * themselves are still exported on the other connections. */
+  g_dbus_object_manager_server_set_connection (peer->object_manager, NULL);
+  g_clear_object (&peer->object_manager);
+
+  if (!g_dbus_connection_is_closed (peer->connection))
+    g_dbus_connection_close (peer->connection, NULL, NULL, NULL);
+
+  g_clear_object (&peer->connection);
+  g_clear_pointer (&peer->name, g_free);
+
+  g_free (peer);
+}
+
+/* A subtree registered with animations_dbus_server_register_subtree,
+ * along with its registration id on each connection. */
+typedef struct _AnimationsDbusServerSubtree
+{
+  char                     *object_path;       /* (owned) */
+  const GDBusSubtreeVTable *vtable;            /* (unowned) */
+  gpointer                  user_data;
+  GHashTable               *registration_ids;  /* (key-type: GDBusConnection) (value-type: guint) (owned) */
+} AnimationsDbusServerSubtree;
+
+static AnimationsDbusServerSubtree *
+animations_dbus_server_subtree_new (const char               *object_path,
+                                    const GDBusSubtreeVTable *vtable,
+                                    gpointer                  user_data)
+{
+  AnimationsDbusServerSubtree *subtree = g_new0 (AnimationsDbusServerSubtree, 1);
+
+  subtree->object_path = g_strdup (object_path);
+  subtree->vtable = vtable;
+  subtree->user_data = user_data;
+  subtree->registration_ids = g_hash_table_new_full (g_direct_hash,
+                                                     g_direct_equal,
+                                                     g_object_unref,
+                                                     NULL);
+
+  return subtree;
+}
+
+static gboolean
+animations_dbus_server_subtree_register_on_connection (AnimationsDbusServerSubtree  *subtree,
+                                                       GDBusConnection              *connection,
+                                                       GError                      **error)
+{
+  /* Nodes are dispatched without being enumerated first, so that
+   * a method call is a single lookup in the dispatch function. */
+  guint registration_id =
+    g_dbus_connection_register_subtree (connection,
+                                        subtree->object_path,
+                                        subtree->vtable,
+                                        G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES,
+                                        subtree->user_data,
+                                        NULL,
+                                        error);
+
+  if (registration_id == 0)
+    return FALSE;
+
+  g_hash_table_insert (subtree->registration_ids,
+                       g_object_ref (connection),
+                       GUINT_TO_POINTER (registration_id));
+  return TRUE;
+}
+
+static void
+animations_dbus_server_subtree_unregister_from_connection (AnimationsDbusServerSubtree *subtree,
+                                                           GDBusConnection             *connection)
+{
+  gpointer registration_id = NULL;
+
+  if (!g_hash_table_lookup_extended (subtree->registration_ids,
+                                     connection,
+                                     NULL,
+                                     &registration_id))
+    return;
+
+  g_dbus_connection_unregister_subtree (connection, GPOINTER_TO_UINT (registration_id));
+  g_hash_table_remove (subtree->registration_ids, connection);
+}
+
+static void
+animations_dbus_server_subtree_free (AnimationsDbusServerSubtree *subtree)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, subtree->registration_ids);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_dbus_connection_unregister_subtree (key, GPOINTER_TO_UINT (value));
+
+  g_clear_pointer (&subtree->registration_ids, g_hash_table_unref);
+  g_clear_pointer (&subtree->object_path, g_free);
+
+  g_free (subtree);
+}
+
 typedef struct _AnimationsDbusServerPrivate
 {
   GDBusConnection                         *connection;  /* (owned) */
   guint                                    name_id;
   AnimationsDbusConnectionManagerSkeleton *connection_manager_skeleton;
 
+  /* Only the connection manager and the animation manager of each
+   * client are exported through the object manager. Surfaces and
+   * effects are dispatched from subtrees, so they are not part of
+   * GetManagedObjects, InterfacesAdded or InterfacesRemoved. Surfaces
+   * coming and going are announced with the SurfacesAdded and
+   * SurfacesRemoved signals of the connection manager instead. */
+  GDBusObjectManagerServer                *object_manager;
+
+  /* Only set if listen-peer-to-peer was set on construction.
+   *
+   * Clients that get the address of the peer server through
+   * GetPeerAddress connect to it directly, so that their calls and
+   * the signals sent to them do not go through the bus daemon.
+   * Each peer connection has its own object manager, which exports
+   * the same objects as the object manager on the bus connection,
+   * and every subtree is registered on it as well. */
+  gboolean                                 listen_peer_to_peer;
+  GDBusServer                             *peer_server;
+  GHashTable                              *peers; /* (key-type: GDBusConnection) (value-type: AnimationsDbusServerPeer) (owned) */
+  guint                                    peer_serial;
+
+  /* The bus connection followed by every peer connection */
+  GPtrArray                               *connections; /* (element-type: GDBusConnection) (owned) */
+
+  /* Objects that are too numerous to export a skeleton for each of
+   * them, such as AnimationEffects, are dispatched from subtrees
+   * instead. Each subtree is registered on every connection in
+   * connections, including peer connections that come later. */
+  GHashTable                              *subtrees; /* (key-type: guint) (value-type: AnimationsDbusServerSubtree) (owned) */
+  guint                                    subtree_serial;
+
   AnimationsDbusServerEffectFactory       *effect_factory;
 
-  /* One AnimationManager per client connection */
-  GHashTable *animation_manager_ids; /* (key-type: utf8) (value-type: guint) */
-  GHashTable *animation_managers;  /* (key-type: guint) (value-type: AnimationsDbusServerAnimationManager) */
+  /* One AnimationManager per client connection.
+   *
+   * When a client calls RegisterClient we create an
+   * AnimationManager for them and subscribe to NameOwnerChanged
+   * for their unique name only, so that we can tear down the
+   * corresponding AnimationManager for that bus name, ensuring
+   * a clean state when the client exits.
+   *
+   * The same client record is indexed both by bus name and by
+   * AnimationManager id, so that registering, unregistering and
+   * looking up a client are all O(1). */
+  GHashTable *clients_by_name; /* (key-type: utf8) (value-type: AnimationsDbusServerClient) (owned) */
+  GHashTable *clients_by_id;   /* (key-type: guint) (value-type: AnimationsDbusServerClient) (unowned) */
   guint       animation_manager_serial;
 
-  /* When a client calls RegisterClient and we create an
-   * AnimationManager for them, we also watch their owned
-   * bus name to see when it disappears. We can then tear
-   * down the corresponding AnimationManager for that bus
-   * name, ensuring a clean state when the client exits. */
-  GHashTable  *client_name_watches;
+  /* Every exported AnimationEffect, indexed by its object path, so
+   * that resolving the path passed to AttachAnimationEffect and
+   * DetachAnimationEffect is a single lookup. Entries are added
+   * when the effect is exported and removed when it is destroyed. */
+  GHashTable  *animation_effects_by_path; /* (key-type: utf8) (value-type: AnimationsDbusServerEffect) (unowned) */
+
+  /* The main context that the server was created on. Property change
+   * notifications and settings channel updates queued up by the
+   * objects of this server are sent and applied from sources on it,
+   * unless animations_dbus_server_flush() gets to them first. */
+  GMainContext                         *main_context;
+  AnimationsDbusPropertiesChangedQueue *properties_changed_queue;
+
+  /* Every effect of this server with an open settings channel. The
+   * channels are drained once per frame from animations_dbus_server_flush(),
+   * and from a timeout at about the same rate for hosts that do not
+   * flush every frame. */
+  GHashTable *effects_with_settings_channels; /* (key-type: AnimationsDbusServerEffect) (unowned) */
+  GSource    *settings_channels_drain_source;
 
   /* One AnimatableSurface per surface that is animatable.
    *
    * Add surfaces with animations_dbus_server_register_surface()
-   * and remove surfaces with animations_dbus_server_unregister_surface(). */
-  GPtrArray *animatable_surfaces; /* (element-type: AnimationsDbusServerSurface) */
-  guint      animatable_surface_serial;
+   * and remove surfaces with animations_dbus_server_unregister_surface().
+   *
+   * Surfaces are kept in registration order in animatable_surface_order
+   * and indexed by their id in animatable_surfaces, which maps to the
+   * link in the queue, so that both insertion and removal are O(1). */
+  GHashTable *animatable_surfaces; /* (key-type: guint) (value-type: GList) */
+  GQueue      animatable_surface_order; /* (element-type: AnimationsDbusServerSurface) (owned) */
+  guint       animatable_surface_serial;
+
+  /* Surfaces are not exported one by one, which would be a skeleton
+   * registration for every window even if no client ever looks at
+   * them. A single subtree dispatches calls to the surfaces in
+   * animatable_surfaces instead. */
+  guint       animatable_surfaces_subtree_id;
+
+  /* Only set if lazy-surface-export was set on construction.
+   *
+   * Surfaces are then only dispatched and only send change
+   * notifications while at least one client is registered. They are
+   * all exported at once when the first client registers and all
+   * unexported again when the last client goes away. */
+  gboolean    lazy_surface_export;
+
+  /* Bumped whenever a surface is registered or unregistered. The
+   * GPtrArray that animations_dbus_server_list_surfaces returns and
+   * the serialized ListSurfaces reply are rebuilt lazily when their
+   * generation no longer matches. */
+  guint       animatable_surfaces_generation;
+  GPtrArray  *animatable_surfaces_array; /* (element-type: AnimationsDbusServerSurface) */
+  guint       animatable_surfaces_array_generation;
+  GVariant   *animatable_surface_paths;
+  guint       animatable_surface_paths_generation;
+
+  /* The minimum interval between Geometry change notifications
+   * in milliseconds, as configured on the server and as actually
+   * used once the intervals requested by clients are considered. */
+  guint       geometry_notify_interval;
+  guint       effective_geometry_notify_interval;
+
+  /* Only set if publish-state-snapshot was set on construction.
+   *
+   * Surfaces that changed are collected by id and their records in
+   * the snapshot are rewritten all at once, on the next main loop
+   * iteration or on animations_dbus_server_flush(), whichever comes
+   * first. Ids of surfaces that are no longer registered have their
+   * records removed. */
+  gboolean                     publish_state_snapshot;
+  AnimationsDbusStateSnapshot *state_snapshot;
+  GHashTable                  *state_snapshot_changed_surfaces; /* (key-type: guint) */
+  GSource                     *state_snapshot_update_source;
 } AnimationsDbusServerPrivate;
 
+#define DEFAULT_GEOMETRY_NOTIFY_INTERVAL 0
+
 enum {
   PROP_0,
   PROP_CONNECTION,
   PROP_EFFECT_FACTORY,
+  PROP_GEOMETRY_NOTIFY_INTERVAL,
+  PROP_EFFECTIVE_GEOMETRY_NOTIFY_INTERVAL,
+  PROP_LISTEN_PEER_TO_PEER,
+  PROP_PUBLISH_STATE_SNAPSHOT,
+  PROP_LAZY_SURFACE_EXPORT,
   NPROPS
 };
 
@@ -107,10 +389,10 @@ animations_dbus_server_lookup_animation_effect_by_ids (AnimationsDbusServer  *se
                                                        GError               **error)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
-  const char *client_name = g_hash_table_lookup (priv->animation_manager_ids,
-                                                 GUINT_TO_POINTER (animation_manager_id));
+  AnimationsDbusServerClient *client = g_hash_table_lookup (priv->clients_by_id,
+                                                           GUINT_TO_POINTER (animation_manager_id));
 
-  if (client_name == NULL)
+  if (client == NULL)
     {
       /* We use ANIMATIONS_DBUS_ERROR_NO_SUCH_EFFECT since that is
        * basically mean to signify a bad object path when looking
@@ -123,274 +405,1524 @@ animations_dbus_server_lookup_animation_effect_by_ids (AnimationsDbusServer  *se
       return NULL;
     }
 
-  AnimationsDbusServerAnimationManager *animation_manager =
-    g_hash_table_lookup (priv->animation_managers,
-                         client_name);
+  return animations_dbus_server_animation_manager_lookup_effect_by_id (client->animation_manager,
+                                                                       animation_effect_id,
+                                                                       error);
+}
+
+#define ANIMATION_EFFECT_OBJECT_PATH_PREFIX "/com/endlessm/Libanimation/AnimationManager/"
+#define ANIMATION_EFFECT_OBJECT_PATH_INFIX "/AnimationEffect/"
+
+/* Parse a run of decimal digits at @str into @out_id, returning a
+ * pointer to the first character after the digits, or %NULL if there
+ * were no digits or the number does not fit into an unsigned int. */
+static const char *
+parse_object_path_id (const char   *str,
+                      unsigned int *out_id)
+{
+  const char *iter = str;
+  guint64 id = 0;
+
+  for (; g_ascii_isdigit (*iter); ++iter)
+    {
+      id = id * 10 + (guint64) (*iter - '0');
+
+      if (id > G_MAXUINT)
+        return NULL;
+    }
+
+  if (iter == str)
+    return NULL;
+
+  *out_id = (unsigned int) id;
+  return iter;
+}
+
+/* Parse an effect path of the form
+ * /com/endlessm/Libanimation/AnimationManager/N/AnimationEffect/M
+ * in place, without allocating. This is only used to give a useful
+ * error message when a path was not found in the effect index. */
+static gboolean
+parse_effect_path (const char   *effect_path,
+                   unsigned int *out_animation_manager_id,
+                   unsigned int *out_animation_effect_id)
+{
+  const char *iter = effect_path;
+
+  if (!g_str_has_prefix (iter, ANIMATION_EFFECT_OBJECT_PATH_PREFIX))
+    return FALSE;
+
+  iter = parse_object_path_id (iter + strlen (ANIMATION_EFFECT_OBJECT_PATH_PREFIX),
+                               out_animation_manager_id);
+
+  if (iter == NULL || !g_str_has_prefix (iter, ANIMATION_EFFECT_OBJECT_PATH_INFIX))
+    return FALSE;
+
+  iter = parse_object_path_id (iter + strlen (ANIMATION_EFFECT_OBJECT_PATH_INFIX),
+                               out_animation_effect_id);
+
+  return iter != NULL && *iter == '\0';
+}
+
+/**
+ * animations_dbus_server_lookup_animation_effect_by_path:
+ * @server: A #AnimationsDbusServer
+ * @object_path: The object path of the effect.
+ * @error: A #GError
+ *
+ * Get the #AnimationsDbusServerEffect exported at @object_path, or %NULL with
+ * @error set if there is no such effect or the @object_path is not a valid
+ * effect path.
+ *
+ * Returns: (transfer none): An #AnimationsDbusServerEffect if one is exported
+ *                           at @object_path or %NULL otherwise.
+ */
+AnimationsDbusServerEffect *
+animations_dbus_server_lookup_animation_effect_by_path (AnimationsDbusServer  *server,
+                                                        const char            *object_path,
+                                                        GError               **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  AnimationsDbusServerEffect *server_effect =
+    g_hash_table_lookup (priv->animation_effects_by_path, object_path);
+  unsigned int animation_manager_id = 0;
+  unsigned int animation_effect_id = 0;
+
+  if (server_effect != NULL)
+    return server_effect;
+
+  if (!parse_effect_path (object_path, &animation_manager_id, &animation_effect_id))
+    {
+      g_set_error (error,
+                   ANIMATIONS_DBUS_ERROR,
+                   ANIMATIONS_DBUS_ERROR_NO_SUCH_ANIMATION,
+                   "Expected animation path '%s' to be of the form "
+                   ANIMATION_EFFECT_OBJECT_PATH_PREFIX "N"
+                   ANIMATION_EFFECT_OBJECT_PATH_INFIX "M",
+                   object_path);
+      return NULL;
+    }
+
+  g_set_error (error,
+               ANIMATIONS_DBUS_ERROR,
+               ANIMATIONS_DBUS_ERROR_NO_SUCH_ANIMATION,
+               "No animation with id %u on animation manager %u",
+               animation_effect_id,
+               animation_manager_id);
+  return NULL;
+}
+
+#define LIBANIMATION_OBJECT_MANAGER_OBJECT_PATH "/com/endlessm/Libanimation"
+
+/* Export @skeleton at @object_path as the only interface of a new
+ * object on the object manager, which exports it on the connection
+ * and announces it with InterfacesAdded. */
+gboolean
+animations_dbus_server_export_object (AnimationsDbusServer    *server,
+                                      GDBusInterfaceSkeleton  *skeleton,
+                                      const char              *object_path,
+                                      GError                 **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(GDBusObject) existing_object =
+    g_dbus_object_manager_get_object (G_DBUS_OBJECT_MANAGER (priv->object_manager),
+                                      object_path);
+
+  /* g_dbus_object_manager_server_export would silently replace
+   * the existing object, so check for it first. */
+  if (existing_object != NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_EXISTS,
+                   "An object is already exported at %s",
+                   object_path);
+      return FALSE;
+    }
+
+  g_autoptr(GDBusObjectSkeleton) object = g_dbus_object_skeleton_new (object_path);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_dbus_object_skeleton_add_interface (object, skeleton);
+  g_dbus_object_manager_server_export (priv->object_manager, object);
+
+  /* The skeleton is exported on every peer connection as well, so
+   * PropertiesChanged is emitted on all of them. */
+  g_hash_table_iter_init (&iter, priv->peers);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      AnimationsDbusServerPeer *peer = value;
+
+      g_dbus_object_manager_server_export (peer->object_manager, object);
+    }
+
+  return TRUE;
+}
+
+/* Unexport the object that @skeleton was exported on with
+ * animations_dbus_server_export_object, announcing it with
+ * InterfacesRemoved. Does nothing if it is not exported. */
+void
+animations_dbus_server_unexport_object (AnimationsDbusServer   *server,
+                                        GDBusInterfaceSkeleton *skeleton)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  const char *object_path = g_dbus_interface_skeleton_get_object_path (skeleton);
+  GHashTableIter iter;
+  gpointer value;
+
+  if (object_path == NULL || priv->object_manager == NULL)
+    return;
+
+  if (priv->peers != NULL)
+    {
+      g_hash_table_iter_init (&iter, priv->peers);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          AnimationsDbusServerPeer *peer = value;
+
+          g_dbus_object_manager_server_unexport (peer->object_manager, object_path);
+        }
+    }
+
+  g_dbus_object_manager_server_unexport (priv->object_manager, object_path);
+}
+
+/* Get every connection that objects are exported on, which is the bus
+ * connection followed by the peer connections. The array is kept up
+ * to date as peers come and go, so it may be held on to. */
+GPtrArray *
+animations_dbus_server_get_connections (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  return priv->connections;
+}
+
+/* Register @vtable as a subtree at @object_path on every connection,
+ * now and as peers connect later, until the returned id is passed to
+ * animations_dbus_server_unregister_subtree(). Returns 0 with @error
+ * set if the subtree could not be registered. */
+guint
+animations_dbus_server_register_subtree (AnimationsDbusServer      *server,
+                                         const char                *object_path,
+                                         const GDBusSubtreeVTable  *vtable,
+                                         gpointer                   user_data,
+                                         GError                   **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  AnimationsDbusServerSubtree *subtree = animations_dbus_server_subtree_new (object_path,
+                                                                            vtable,
+                                                                            user_data);
+
+  for (unsigned int i = 0; i < priv->connections->len; ++i)
+    {
+      if (!animations_dbus_server_subtree_register_on_connection (subtree,
+                                                                  g_ptr_array_index (priv->connections, i),
+                                                                  error))
+        {
+          animations_dbus_server_subtree_free (subtree);
+          return 0;
+        }
+    }
+
+  g_hash_table_insert (priv->subtrees, GUINT_TO_POINTER (++priv->subtree_serial), subtree);
+
+  return priv->subtree_serial;
+}
+
+void
+animations_dbus_server_unregister_subtree (AnimationsDbusServer *server,
+                                           guint                 subtree_id)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  if (priv->subtrees != NULL)
+    g_hash_table_remove (priv->subtrees, GUINT_TO_POINTER (subtree_id));
+}
+
+static void
+add_connection (AnimationsDbusServer *server,
+                GDBusConnection      *connection)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_ptr_array_add (priv->connections, g_object_ref (connection));
+
+  g_hash_table_iter_init (&iter, priv->subtrees);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      AnimationsDbusServerSubtree *subtree = value;
+      g_autoptr(GError) local_error = NULL;
+
+      if (!animations_dbus_server_subtree_register_on_connection (subtree,
+                                                                  connection,
+                                                                  &local_error))
+        g_warning ("Could not register subtree at %s on new connection: %s",
+                   subtree->object_path,
+                   local_error->message);
+    }
+}
+
+static void
+remove_connection (AnimationsDbusServer *server,
+                   GDBusConnection      *connection)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, priv->subtrees);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    animations_dbus_server_subtree_unregister_from_connection (value, connection);
+
+  g_ptr_array_remove (priv->connections, connection);
+}
+
+/* The key that a tracked effect was added to the object path index
+ * with, kept on the effect so that it can be removed with a single
+ * lookup once the effect is destroyed. */
+G_DEFINE_QUARK (animations-dbus-server-tracked-effect-path, tracked_animation_effect_path)
+
+static void
+on_tracked_animation_effect_destroyed (AnimationsDbusServerEffect *server_effect,
+                                       gpointer                    user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autofree char *object_path = g_object_steal_qdata (G_OBJECT (server_effect),
+                                                       tracked_animation_effect_path_quark ());
+
+  /* The effect stops being dispatched by its AnimationManager
+   * itself, it only needs to be removed from the index. */
+  if (object_path != NULL && priv->animation_effects_by_path != NULL)
+    g_hash_table_remove (priv->animation_effects_by_path, object_path);
+}
+
+/* Add an exported @server_effect to the object path index, so that
+ * it can be found by animations_dbus_server_lookup_animation_effect_by_path.
+ * It is removed from the index again once it is destroyed. */
+void
+animations_dbus_server_track_animation_effect (AnimationsDbusServer       *server,
+                                               AnimationsDbusServerEffect *server_effect)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  const char *object_path = animations_dbus_server_effect_get_object_path (server_effect);
+
+  g_return_if_fail (object_path != NULL);
+
+  g_hash_table_insert (priv->animation_effects_by_path,
+                       g_strdup (object_path),
+                       server_effect);
+  g_object_set_qdata_full (G_OBJECT (server_effect),
+                           tracked_animation_effect_path_quark (),
+                           g_strdup (object_path),
+                           g_free);
+
+  g_signal_connect_object (server_effect,
+                           "destroyed",
+                           G_CALLBACK (on_tracked_animation_effect_destroyed),
+                           server,
+                           0);
+}
+
+static GPtrArray *
+peek_surfaces_array (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  if (priv->animatable_surfaces_array_generation != priv->animatable_surfaces_generation)
+    {
+      g_autoptr(GPtrArray) array =
+        g_ptr_array_new_full (priv->animatable_surface_order.length, NULL);
+
+      for (GList *link = priv->animatable_surface_order.head; link != NULL; link = link->next)
+        g_ptr_array_add (array, link->data);
+
+      g_clear_pointer (&priv->animatable_surfaces_array, g_ptr_array_unref);
+      priv->animatable_surfaces_array = g_steal_pointer (&array);
+      priv->animatable_surfaces_array_generation = priv->animatable_surfaces_generation;
+    }
+
+  return priv->animatable_surfaces_array;
+}
+
+/**
+ * animations_dbus_server_list_surfaces:
+ * @server: A #AnimationsDbusServer
+ *
+ * Get a #GPtrArray of surfaces that this #AnimationsDbusServer is tracking,
+ * in the order that they were registered. The array is only valid until
+ * the next surface is registered or unregistered.
+ *
+ * Returns: (transfer none) (element-type AnimationsDbusServerSurface): A #GPtrArray
+ * of #AnimationsDbusServerSurface.
+ */
+GPtrArray *
+animations_dbus_server_list_surfaces (AnimationsDbusServer *server)
+{
+  return peek_surfaces_array (server);
+}
+
+/**
+ * animations_dbus_server_list_surface_object_paths:
+ * @server: A #AnimationsDbusServer
+ *
+ * Get the object paths of all the surfaces that this #AnimationsDbusServer
+ * is tracking, in the order that they were registered, serialized as a
+ * #GVariant of type "ao". The variant is cached until the next surface is
+ * registered or unregistered, so repeated calls are cheap.
+ *
+ * Returns: (transfer none): A #GVariant of type "ao".
+ */
+GVariant *
+animations_dbus_server_list_surface_object_paths (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  if (priv->animatable_surface_paths_generation != priv->animatable_surfaces_generation)
+    {
+      g_auto(GVariantBuilder) builder;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+
+      for (GList *link = priv->animatable_surface_order.head; link != NULL; link = link->next)
+        {
+          const char *object_path = animations_dbus_server_surface_get_object_path (link->data);
+
+          /* Not exported yet in lazy-surface-export mode */
+          if (object_path == NULL)
+            continue;
+
+          g_variant_builder_add (&builder, "o", object_path);
+        }
+
+      g_clear_pointer (&priv->animatable_surface_paths, g_variant_unref);
+      priv->animatable_surface_paths = g_variant_ref_sink (g_variant_builder_end (&builder));
+      priv->animatable_surface_paths_generation = priv->animatable_surfaces_generation;
+    }
+
+  return priv->animatable_surface_paths;
+}
+
+/* Serialize the object paths and properties of all surfaces into a
+ * new floating "a(oa{sv})" array, as sent by ListSurfacesWithProperties
+ * and RegisterClientWithSnapshot. */
+GVariant *
+animations_dbus_server_serialize_surfaces_with_properties (AnimationsDbusServer *server)
+{
+  GPtrArray *server_surfaces = peek_surfaces_array (server);
+  g_auto(GVariantBuilder) builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(oa{sv})"));
+
+  for (unsigned int i = 0; i < server_surfaces->len; ++i)
+    {
+      AnimationsDbusServerSurface *server_surface = g_ptr_array_index (server_surfaces, i);
+      const char *object_path = animations_dbus_server_surface_get_object_path (server_surface);
+
+      if (object_path == NULL)
+        continue;
+
+      g_variant_builder_add (&builder,
+                             "(o@a{sv})",
+                             object_path,
+                             animations_dbus_server_surface_serialize_properties (server_surface));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+#define ANIMATIONS_DBUS_ANIMATABLE_SURFACE_SUBTREE_OBJECT_PATH "/com/endlessm/Libanimation/AnimatableSurface"
+#define ANIMATIONS_DBUS_ANIMATABLE_SURFACE_OBJECT_PATH_TEMPLATE ANIMATIONS_DBUS_ANIMATABLE_SURFACE_SUBTREE_OBJECT_PATH "/%u"
+
+/* Whether surfaces are currently served, which is always the case
+ * unless lazy-surface-export is set and no client is registered. */
+static gboolean
+surfaces_are_exported (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  return !priv->lazy_surface_export ||
+         (priv->clients_by_name != NULL && g_hash_table_size (priv->clients_by_name) > 0);
+}
+
+/* Nothing is actually exported here, the surface is dispatched from
+ * the AnimatableSurface subtree once it has an object path. */
+static void
+export_surface (AnimationsDbusServer        *server,
+                AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  char object_path[sizeof (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_SUBTREE_OBJECT_PATH "/") + 10];
+
+  g_snprintf (object_path,
+              sizeof (object_path),
+              ANIMATIONS_DBUS_ANIMATABLE_SURFACE_OBJECT_PATH_TEMPLATE,
+              animations_dbus_server_surface_get_id (server_surface));
+  animations_dbus_server_surface_set_dispatch_target (server_surface,
+                                                      object_path,
+                                                      priv->connections);
+}
+
+/* Look up the surface that is dispatched at @node in the
+ * AnimatableSurface subtree, where @node is the surface id in decimal. */
+static AnimationsDbusServerSurface *
+lookup_dispatched_surface (AnimationsDbusServer *server,
+                           const char           *node)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  guint64 id = 0;
+  GList *link = NULL;
+
+  if (node == NULL ||
+      priv->animatable_surfaces == NULL ||
+      !g_ascii_string_to_unsigned (node, 10, 0, G_MAXUINT, &id, NULL))
+    return NULL;
+
+  link = g_hash_table_lookup (priv->animatable_surfaces, GUINT_TO_POINTER ((unsigned int) id));
+
+  /* Surfaces that are not exported yet in lazy-surface-export mode
+   * have no object path */
+  if (link == NULL || animations_dbus_server_surface_get_object_path (link->data) == NULL)
+    return NULL;
+
+  return link->data;
+}
+
+static char **
+animatable_surfaces_subtree_enumerate (GDBusConnection *connection G_GNUC_UNUSED,
+                                       const char      *sender G_GNUC_UNUSED,
+                                       const char      *object_path G_GNUC_UNUSED,
+                                       gpointer         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  GPtrArray *nodes = g_ptr_array_new ();
+
+  if (surfaces_are_exported (server))
+    {
+      for (GList *link = priv->animatable_surface_order.head; link != NULL; link = link->next)
+        g_ptr_array_add (nodes,
+                         g_strdup_printf ("%u", animations_dbus_server_surface_get_id (link->data)));
+    }
+
+  g_ptr_array_add (nodes, NULL);
+
+  return (char **) g_ptr_array_free (nodes, FALSE);
+}
+
+static GDBusInterfaceInfo **
+animatable_surfaces_subtree_introspect (GDBusConnection *connection G_GNUC_UNUSED,
+                                        const char      *sender G_GNUC_UNUSED,
+                                        const char      *object_path G_GNUC_UNUSED,
+                                        const char      *node,
+                                        gpointer         user_data)
+{
+  GDBusInterfaceInfo **interfaces = NULL;
+
+  if (lookup_dispatched_surface (user_data, node) == NULL)
+    return NULL;
+
+  interfaces = g_new0 (GDBusInterfaceInfo *, 2);
+  interfaces[0] = g_dbus_interface_info_ref (animations_dbus_animatable_surface_interface_info ());
+
+  return interfaces;
+}
+
+/* Calls and property accesses are handled by the vtable of the surface
+ * skeleton, exactly as if the skeleton had been exported at that path. */
+static const GDBusInterfaceVTable *
+animatable_surfaces_subtree_dispatch (GDBusConnection *connection G_GNUC_UNUSED,
+                                      const char      *sender G_GNUC_UNUSED,
+                                      const char      *object_path G_GNUC_UNUSED,
+                                      const char      *interface_name,
+                                      const char      *node,
+                                      gpointer        *out_user_data,
+                                      gpointer         user_data)
+{
+  AnimationsDbusServerSurface *server_surface = lookup_dispatched_surface (user_data, node);
+
+  if (server_surface == NULL ||
+      g_strcmp0 (interface_name, animations_dbus_animatable_surface_interface_info ()->name) != 0)
+    return NULL;
+
+  *out_user_data = server_surface;
+  return g_dbus_interface_skeleton_get_vtable (G_DBUS_INTERFACE_SKELETON (server_surface));
+}
+
+static const GDBusSubtreeVTable animatable_surfaces_subtree_vtable =
+{
+  animatable_surfaces_subtree_enumerate,
+  animatable_surfaces_subtree_introspect,
+  animatable_surfaces_subtree_dispatch
+};
+
+/* Export or unexport every registered surface at once, when the first
+ * client registers or the last one goes away in lazy-surface-export mode. */
+static void
+set_surfaces_exported (AnimationsDbusServer *server,
+                       gboolean              exported)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  for (GList *link = priv->animatable_surface_order.head; link != NULL; link = link->next)
+    {
+      if (exported)
+        export_surface (server, link->data);
+      else
+        animations_dbus_server_surface_set_dispatch_target (link->data, NULL, NULL);
+    }
+
+  /* The cached object paths change along with the surfaces */
+  ++priv->animatable_surfaces_generation;
+}
+
+/* Create and track a surface for @bridge with the next id, without
+ * notifying anybody about it. */
+static AnimationsDbusServerSurface *
+register_surface_internal (AnimationsDbusServer              *server,
+                           AnimationsDbusServerSurfaceBridge *bridge)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  unsigned int allocated_id = priv->animatable_surface_serial++;
+  g_autoptr(AnimationsDbusServerSurface) server_surface =
+    animations_dbus_server_surface_new_with_id (priv->connection,
+                                                server,
+                                                bridge,
+                                                allocated_id);
+
+  if (surfaces_are_exported (server))
+    export_surface (server, server_surface);
+
+  g_queue_push_tail (&priv->animatable_surface_order, g_object_ref (server_surface));
+  g_hash_table_insert (priv->animatable_surfaces,
+                       GUINT_TO_POINTER (allocated_id),
+                       g_queue_peek_tail_link (&priv->animatable_surface_order));
+
+  animations_dbus_server_queue_state_snapshot_update (server, allocated_id);
+
+  return g_steal_pointer (&server_surface);
+}
+
+/* Stop tracking @server_surface, which must have been checked to be
+ * registered, and add its object path to @removed_paths if it had one.
+ * Surfaces that were already removed earlier in the same batch are
+ * skipped. */
+static void
+unregister_surface_internal (AnimationsDbusServer        *server,
+                             AnimationsDbusServerSurface *server_surface,
+                             GVariantBuilder             *removed_paths)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  unsigned int id = animations_dbus_server_surface_get_id (server_surface);
+  GList *link = g_hash_table_lookup (priv->animatable_surfaces, GUINT_TO_POINTER (id));
+  const char *object_path = animations_dbus_server_surface_get_object_path (server_surface);
+
+  if (link == NULL)
+    return;
+
+  if (object_path != NULL)
+    g_variant_builder_add (removed_paths, "o", object_path);
+
+  g_hash_table_remove (priv->animatable_surfaces, GUINT_TO_POINTER (id));
+  g_queue_unlink (&priv->animatable_surface_order, link);
+  g_list_free (link);
+
+  animations_dbus_server_queue_state_snapshot_update (server, id);
+
+  animations_dbus_server_surface_set_dispatch_target (server_surface, NULL, NULL);
+  g_object_unref (server_surface);
+}
+
+static gboolean
+check_surface_registered (AnimationsDbusServer         *server,
+                          AnimationsDbusServerSurface  *server_surface,
+                          GError                      **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  unsigned int id = animations_dbus_server_surface_get_id (server_surface);
+  GList *link = g_hash_table_lookup (priv->animatable_surfaces, GUINT_TO_POINTER (id));
+
+  if (link == NULL || link->data != server_surface)
+    {
+      g_set_error (error,
+                   ANIMATIONS_DBUS_ERROR,
+                   ANIMATIONS_DBUS_ERROR_SERVER_SURFACE_NOT_FOUND,
+                   "Server surface %p was not found",
+                   (gpointer) server_surface);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Send a single SurfacesAdded signal for all the @n_surfaces newly
+ * registered @server_surfaces, if they are exported. */
+static void
+emit_surfaces_added (AnimationsDbusServer         *server,
+                     AnimationsDbusServerSurface **server_surfaces,
+                     unsigned int                  n_surfaces)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(GPtrArray) paths = NULL;
+
+  if (priv->connection_manager_skeleton == NULL ||
+      n_surfaces == 0 ||
+      !surfaces_are_exported (server))
+    return;
+
+  paths = g_ptr_array_new_full (n_surfaces + 1, NULL);
+
+  for (unsigned int i = 0; i < n_surfaces; ++i)
+    g_ptr_array_add (paths,
+                     (gpointer) animations_dbus_server_surface_get_object_path (server_surfaces[i]));
+
+  g_ptr_array_add (paths, NULL);
+
+  animations_dbus_connection_manager_emit_surfaces_added (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_skeleton),
+                                                          (const char * const *) paths->pdata);
+}
+
+static void
+emit_surfaces_removed (AnimationsDbusServer *server,
+                       GVariantBuilder      *removed_paths)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(GVariant) paths_variant = g_variant_ref_sink (g_variant_builder_end (removed_paths));
+  g_autofree const char **paths = NULL;
+
+  if (priv->connection_manager_skeleton == NULL || g_variant_n_children (paths_variant) == 0)
+    return;
+
+  paths = g_variant_get_objv (paths_variant, NULL);
+  animations_dbus_connection_manager_emit_surfaces_removed (ANIMATIONS_DBUS_CONNECTION_MANAGER (priv->connection_manager_skeleton),
+                                                            paths);
+}
+
+/**
+ * animations_dbus_server_register_surface:
+ * @server: A #AnimationsDbusServer.
+ * @bridge: An #AnimationsDbusServerSurfaceBridge.
+ * @error: A #GError
+ *
+ * Register a new surface, using @bridge to register effects and get properties
+ * on the underlying surface.
+ *
+ * Returns: (transfer full): An #AnimationsDbusServerSurface for the @title and
+ *          @geometry of the surface, or %NULL with @error set in case the surface
+ *          is not there.
+ */
+AnimationsDbusServerSurface *
+animations_dbus_server_register_surface (AnimationsDbusServer               *server,
+                                         AnimationsDbusServerSurfaceBridge  *bridge,
+                                         GError                            **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(AnimationsDbusServerSurface) server_surface = register_surface_internal (server, bridge);
+
+  ++priv->animatable_surfaces_generation;
+  emit_surfaces_added (server, &server_surface, 1);
+
+  return g_steal_pointer (&server_surface);
+}
+
+/**
+ * animations_dbus_server_register_surfaces:
+ * @server: A #AnimationsDbusServer.
+ * @bridges: (element-type AnimationsDbusServerSurfaceBridge): The
+ *           #AnimationsDbusServerSurfaceBridge for each surface.
+ * @error: A #GError
+ *
+ * Register a new surface for each of @bridges, as
+ * animations_dbus_server_register_surface() does. This is cheaper than
+ * registering the surfaces one by one, for instance when the compositor
+ * starts up, since clients are only told about the new surfaces once.
+ *
+ * Returns: (transfer container) (element-type AnimationsDbusServerSurface):
+ *          The new #AnimationsDbusServerSurface for each of @bridges, in
+ *          the same order. Registering a surface cannot fail, so this is
+ *          never %NULL.
+ */
+GPtrArray *
+animations_dbus_server_register_surfaces (AnimationsDbusServer  *server,
+                                          GPtrArray             *bridges,
+                                          GError               **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(GPtrArray) server_surfaces = g_ptr_array_new_full (bridges->len, g_object_unref);
+
+  for (unsigned int i = 0; i < bridges->len; ++i)
+    g_ptr_array_add (server_surfaces,
+                     register_surface_internal (server, g_ptr_array_index (bridges, i)));
+
+  ++priv->animatable_surfaces_generation;
+  emit_surfaces_added (server,
+                       (AnimationsDbusServerSurface **) server_surfaces->pdata,
+                       server_surfaces->len);
+
+  return g_steal_pointer (&server_surfaces);
+}
+
+/**
+ * animations_dbus_server_unregister_surface:
+ * @server: A #AnimationsDbusServer
+ * @server_surface: The surface to unregister.
+ * @error: A #GError
+ *
+ * Unregister and unexport the given surface.
+ *
+ * Returns: %TRUE if the surface was unregistered and unexported correctly, %FALSE
+ *          with @error set otherwise.
+ */
+gboolean
+animations_dbus_server_unregister_surface (AnimationsDbusServer         *server,
+                                           AnimationsDbusServerSurface  *server_surface,
+                                           GError                      **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_auto(GVariantBuilder) removed_paths;
+
+  g_variant_builder_init (&removed_paths, G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+
+  if (!check_surface_registered (server, server_surface, error))
+    return FALSE;
+
+  unregister_surface_internal (server, server_surface, &removed_paths);
+  ++priv->animatable_surfaces_generation;
+
+  emit_surfaces_removed (server, &removed_paths);
+
+  return TRUE;
+}
+
+/**
+ * animations_dbus_server_unregister_surfaces:
+ * @server: A #AnimationsDbusServer
+ * @server_surfaces: (element-type AnimationsDbusServerSurface): The surfaces
+ *                   to unregister.
+ * @error: A #GError
+ *
+ * Unregister and unexport all of @server_surfaces at once, for instance
+ * when a workspace is torn down. Either all of the surfaces are
+ * unregistered, or none of them are if one of them is not registered.
+ *
+ * Returns: %TRUE if the surfaces were unregistered and unexported correctly,
+ *          %FALSE with @error set otherwise.
+ */
+gboolean
+animations_dbus_server_unregister_surfaces (AnimationsDbusServer  *server,
+                                            GPtrArray             *server_surfaces,
+                                            GError               **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_auto(GVariantBuilder) removed_paths;
+
+  g_variant_builder_init (&removed_paths, G_VARIANT_TYPE_OBJECT_PATH_ARRAY);
+
+  for (unsigned int i = 0; i < server_surfaces->len; ++i)
+    if (!check_surface_registered (server, g_ptr_array_index (server_surfaces, i), error))
+      return FALSE;
+
+  for (unsigned int i = 0; i < server_surfaces->len; ++i)
+    unregister_surface_internal (server, g_ptr_array_index (server_surfaces, i), &removed_paths);
+
+  ++priv->animatable_surfaces_generation;
+  emit_surfaces_removed (server, &removed_paths);
+
+  return TRUE;
+}
+
+#define LIBANIMATION_ANIMATION_MANAGER_OBJECT_PATH_TEMPLATE "/com/endlessm/Libanimation/AnimationManager/%u"
+
+/**
+ * animations_dbus_server_create_animation_manager:
+ * @server: An #AnimationsDbusServer.
+ * @error: A #GError.
+ *
+ * Create a #AnimationsDbusServerAnimationManager for use by the
+ * server side. The animation manager will appear on the bus but
+ * will be managed by the caller (for instance, there is no bus name
+ * that is being watched for the animation manager to be destroyed).
+ *
+ * Returns: (transfer full): A #AnimationsDbusServerAnimationManager
+ * or %NULL with @error set in case of an error.
+ */
+AnimationsDbusServerAnimationManager *
+animations_dbus_server_create_animation_manager (AnimationsDbusServer  *server,
+                                                 GError               **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(AnimationsDbusServerAnimationManager) server_animation_manager =
+    animations_dbus_server_animation_manager_new (priv->connection,
+                                                  server,
+                                                  priv->effect_factory);
+
+  /* Need to be careful to use preincrement here as we will be
+   * doing a reverse lookup of this later and we can't have 0
+   * as 0 == NULL, which would indicate that an id was not found
+   * for a given client name */
+  unsigned int allocated_id = ++priv->animation_manager_serial;
+  g_autofree char *object_path = g_strdup_printf (LIBANIMATION_ANIMATION_MANAGER_OBJECT_PATH_TEMPLATE,
+                                                  allocated_id);
+
+  if (!animations_dbus_server_animation_manager_export (server_animation_manager,
+                                                        object_path,
+                                                        error))
+    return NULL;
+
+  /* Because the caller could be a user of the server library and not
+   * the server library itself
+   * (from on_animation_connection_manager_register_client), we don't
+   * register the newly created AnimationsDbusServerAnimationManager in
+   * the hash table, since it is up to the caller to keep track of its
+   * lifetime. */
+  return g_steal_pointer (&server_animation_manager);
+}
+
+static void
+unregister_client_record (AnimationsDbusServer       *server,
+                          AnimationsDbusServerClient *client)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  /* The record is owned by clients_by_name, steal it so that it
+   * stays alive until we are done with it here. */
+  g_hash_table_steal (priv->clients_by_name, client->name);
+  g_hash_table_remove (priv->clients_by_id,
+                       GUINT_TO_POINTER (client->animation_manager_id));
+
+  animations_dbus_server_animation_manager_unexport (client->animation_manager);
+
+  g_signal_emit (server,
+                 animations_dbus_server_signals[SIGNAL_CLIENT_DISCONNECTED],
+                 0,
+                 client->name);
+
+  animations_dbus_server_client_free (client);
+
+  if (priv->lazy_surface_export && !surfaces_are_exported (server))
+    set_surfaces_exported (server, FALSE);
+
+  if (priv->clients_by_name != NULL)
+    animations_dbus_server_update_geometry_notify_interval (server);
+}
+
+static void
+unregister_client (AnimationsDbusServer *server,
+                   const gchar          *name)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  AnimationsDbusServerClient *client = g_hash_table_lookup (priv->clients_by_name, name);
+
+  if (client != NULL)
+    unregister_client_record (server, client);
+}
+
+static void
+on_name_owner_changed (GDBusConnection *connection G_GNUC_UNUSED,
+                       const char      *sender_name G_GNUC_UNUSED,
+                       const char      *object_path G_GNUC_UNUSED,
+                       const char      *interface_name G_GNUC_UNUSED,
+                       const char      *signal_name G_GNUC_UNUSED,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  const char *name;
+  const char *old_owner;
+  const char *new_owner;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sss)")))
+    return;
+
+  g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+
+  /* Clients are registered by their unique name, which only ever
+   * changes owner when the connection that had it goes away. */
+  if (new_owner[0] != '\0')
+    return;
+
+  unregister_client (server, name);
+}
+
+/* The name that a GetNameOwner call was made for in watch_client_name */
+typedef struct
+{
+  AnimationsDbusServer *server;  /* (owned) */
+  char                 *name;    /* (owned) */
+} ClientNameOwnerCheck;
+
+static void
+on_got_client_name_owner (GObject      *source,
+                          GAsyncResult *result,
+                          gpointer      user_data)
+{
+  ClientNameOwnerCheck *check = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (check->server);
+  g_autoptr(GVariant) reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source),
+                                                             result,
+                                                             NULL);
+
+  /* The name went away before the subscription was in place, so
+   * there will be no NameOwnerChanged for it. Unique names are never
+   * reused, so the record is still the one that was checked. */
+  if (reply == NULL && priv->clients_by_name != NULL)
+    unregister_client (check->server, check->name);
+
+  g_clear_object (&check->server);
+  g_clear_pointer (&check->name, g_free);
+  g_free (check);
+}
+
+/* Subscribe to NameOwnerChanged for the unique name of @client only,
+ * so that the bus does not wake us up for every other name. The client
+ * may already have gone away before the bus saw the match rule, so
+ * check that the name still has an owner once it is in place. The
+ * bus handles messages from a connection in order, so the name either
+ * has no owner when GetNameOwner is handled, or the signal comes. */
+static void
+watch_client_name (AnimationsDbusServer       *server,
+                   AnimationsDbusServerClient *client)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  ClientNameOwnerCheck *check = g_new0 (ClientNameOwnerCheck, 1);
+
+  client->bus_connection = g_object_ref (priv->connection);
+  client->name_owner_changed_id =
+    g_dbus_connection_signal_subscribe (client->bus_connection,
+                                        "org.freedesktop.DBus",
+                                        "org.freedesktop.DBus",
+                                        "NameOwnerChanged",
+                                        "/org/freedesktop/DBus",
+                                        client->name,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_name_owner_changed,
+                                        server,
+                                        NULL);
+
+  check->server = g_object_ref (server);
+  check->name = g_strdup (client->name);
+
+  g_dbus_connection_call (client->bus_connection,
+                          "org.freedesktop.DBus",
+                          "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus",
+                          "GetNameOwner",
+                          g_variant_new ("(s)", client->name),
+                          G_VARIANT_TYPE ("(s)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          on_got_client_name_owner,
+                          check);
+}
+
+/* Create and track an AnimationManager for the caller of @invocation.
+ * Returns %NULL if there was an error, which has already been returned
+ * to the caller. */
+static AnimationsDbusServerAnimationManager *
+register_client_for_invocation (AnimationsDbusServer  *server,
+                                GDBusMethodInvocation *invocation)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  const char *sender = g_dbus_method_invocation_get_sender (invocation);
+  AnimationsDbusServerPeer *peer =
+    g_hash_table_lookup (priv->peers, g_dbus_method_invocation_get_connection (invocation));
+  g_autoptr(GError) local_error = NULL;
+
+  /* Messages on a peer to peer connection have no sender, so use the
+   * name that was made up for the peer when it connected. */
+  if (peer != NULL)
+    sender = peer->name;
+
+  if (g_hash_table_contains (priv->clients_by_name, sender))
+    {
+      g_autofree char *message = g_strdup_printf ("Name '%s' already has an AnimationManager "
+                                                  "registered", sender);
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     ANIMATIONS_DBUS_ERROR,
+                                                     ANIMATIONS_DBUS_ERROR_NAME_ALREADY_REGISTERED,
+                                                     message);
+      return NULL;
+    }
+
+  g_autoptr(AnimationsDbusServerAnimationManager) server_animation_manager =
+    animations_dbus_server_create_animation_manager (server, &local_error);
+
+  if (server_animation_manager == NULL)
+    {
+      g_autofree char *message = g_strdup_printf ("Could not register AnimationManager "
+                                                  "for name '%s': %s",
+                                                  sender,
+                                                  local_error->message);
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     ANIMATIONS_DBUS_ERROR,
+                                                     ANIMATIONS_DBUS_ERROR_INTERNAL_ERROR,
+                                                     message);
+      return NULL;
+    }
+
+  /* If the name disappears, on_name_owner_changed removes the animation
+   * manager and drops all of its associated effects. Peers are
+   * unregistered when their connection is closed instead. */
+  AnimationsDbusServerClient *client =
+    animations_dbus_server_client_new (sender,
+                                       priv->animation_manager_serial,
+                                       server_animation_manager);
+
+  if (peer == NULL)
+    watch_client_name (server, client);
+
+  g_hash_table_insert (priv->clients_by_name, client->name, client);
+  g_hash_table_insert (priv->clients_by_id,
+                       GUINT_TO_POINTER (client->animation_manager_id),
+                       client);
+  animations_dbus_server_update_geometry_notify_interval (server);
+
+  /* Before the reply, so that the client can see the surfaces */
+  if (priv->lazy_surface_export && g_hash_table_size (priv->clients_by_name) == 1)
+    set_surfaces_exported (server, TRUE);
+
+  g_message ("Registering client '%s'", sender);
+
+  g_signal_emit (server,
+                 animations_dbus_server_signals[SIGNAL_CLIENT_CONNECTED],
+                 0,
+                 sender);
+
+  /* Owned by the client record */
+  return server_animation_manager;
+}
+
+static gboolean
+on_animation_connection_manager_register_client (AnimationsDbusConnectionManager *connection_manager,
+                                                 GDBusMethodInvocation           *invocation,
+                                                 gpointer                         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerAnimationManager *server_animation_manager =
+    register_client_for_invocation (server, invocation);
+
+  if (server_animation_manager == NULL)
+    return TRUE;
+
+  animations_dbus_connection_manager_complete_register_client (connection_manager,
+                                                               invocation,
+                                                               g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (server_animation_manager)));
+  return TRUE;
+}
+
+static gboolean
+on_animation_connection_manager_register_client_with_snapshot (AnimationsDbusConnectionManager *connection_manager,
+                                                               GDBusMethodInvocation           *invocation,
+                                                               gpointer                         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerAnimationManager *server_animation_manager =
+    register_client_for_invocation (server, invocation);
+
+  if (server_animation_manager == NULL)
+    return TRUE;
+
+  animations_dbus_connection_manager_complete_register_client_with_snapshot (connection_manager,
+                                                                             invocation,
+                                                                             g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (server_animation_manager)),
+                                                                             animations_dbus_server_serialize_surfaces_with_properties (server));
+  return TRUE;
+}
+
+static gboolean
+on_animation_connection_manager_get_peer_address (AnimationsDbusConnectionManager *connection_manager,
+                                                  GDBusMethodInvocation           *invocation,
+                                                  gpointer                         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  animations_dbus_connection_manager_complete_get_peer_address (connection_manager,
+                                                                invocation,
+                                                                priv->peer_server != NULL ?
+                                                                g_dbus_server_get_client_address (priv->peer_server) :
+                                                                "");
+  return TRUE;
+}
+
+static void
+on_peer_connection_closed (GDBusConnection *connection,
+                           gboolean         remote_peer_vanished G_GNUC_UNUSED,
+                           GError          *error G_GNUC_UNUSED,
+                           gpointer         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  AnimationsDbusServerPeer *peer = g_hash_table_lookup (priv->peers, connection);
+
+  if (peer == NULL)
+    return;
+
+  unregister_client (server, peer->name);
+  remove_connection (server, connection);
+  g_hash_table_remove (priv->peers, connection);
+}
+
+static gboolean
+on_peer_server_new_connection (GDBusServer     *peer_server G_GNUC_UNUSED,
+                               GDBusConnection *connection,
+                               gpointer         user_data)
+{
+  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autofree char *name = g_strdup_printf ("peer:%u", ++priv->peer_serial);
+  AnimationsDbusServerPeer *peer = animations_dbus_server_peer_new (name,
+                                                                   connection,
+                                                                   LIBANIMATION_OBJECT_MANAGER_OBJECT_PATH);
+  g_autolist(GDBusObject) objects =
+    g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (priv->object_manager));
+
+  /* Export everything that is already on the bus, including the
+   * ConnectionManager, before the peer can make any calls. */
+  for (GList *l = objects; l != NULL; l = l->next)
+    g_dbus_object_manager_server_export (peer->object_manager,
+                                         G_DBUS_OBJECT_SKELETON (l->data));
+
+  g_dbus_object_manager_server_set_connection (peer->object_manager, connection);
+  add_connection (server, connection);
+  peer->closed_id = g_signal_connect (connection,
+                                      "closed",
+                                      G_CALLBACK (on_peer_connection_closed),
+                                      server);
+
+  g_hash_table_insert (priv->peers, peer->connection, peer);
+
+  return TRUE;
+}
+
+static gboolean
+on_authorize_authenticated_peer (GDBusAuthObserver *observer G_GNUC_UNUSED,
+                                 GIOStream         *stream G_GNUC_UNUSED,
+                                 GCredentials      *credentials,
+                                 gpointer           user_data G_GNUC_UNUSED)
+{
+  g_autoptr(GCredentials) own_credentials = g_credentials_new ();
+
+  /* Only accept connections from the same user, like the
+   * session bus would. */
+  return credentials != NULL &&
+         g_credentials_is_same_user (credentials, own_credentials, NULL);
+}
+
+static gboolean
+start_peer_server (AnimationsDbusServer  *server,
+                   GCancellable          *cancellable,
+                   GError               **error)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autofree char *guid = g_dbus_generate_guid ();
+  g_autofree char *escaped_runtime_dir = g_dbus_address_escape_value (g_get_user_runtime_dir ());
+  g_autofree char *address = g_strdup_printf ("unix:tmpdir=%s", escaped_runtime_dir);
+  g_autoptr(GDBusAuthObserver) observer = g_dbus_auth_observer_new ();
+
+  g_signal_connect (observer,
+                    "authorize-authenticated-peer",
+                    G_CALLBACK (on_authorize_authenticated_peer),
+                    NULL);
+
+  priv->peer_server = g_dbus_server_new_sync (address,
+                                              G_DBUS_SERVER_FLAGS_NONE,
+                                              guid,
+                                              observer,
+                                              cancellable,
+                                              error);
+
+  if (priv->peer_server == NULL)
+    return FALSE;
+
+  g_signal_connect_object (priv->peer_server,
+                           "new-connection",
+                           G_CALLBACK (on_peer_server_new_connection),
+                           server,
+                           0);
+  g_dbus_server_start (priv->peer_server);
+
+  return TRUE;
+}
+
+/* Called whenever the server interval changes, a client comes or goes or
+ * a client requests a new interval. PropertiesChanged is broadcast to all
+ * clients, so a client can only lower the rate of notifications below the
+ * server interval if every other client also asked for that. */
+void
+animations_dbus_server_update_geometry_notify_interval (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  gboolean all_clients_requested_interval = g_hash_table_size (priv->clients_by_name) > 0;
+  unsigned int shortest_requested_interval = G_MAXUINT;
+  unsigned int effective_interval = 0;
+  gpointer value;
+  GHashTableIter iter;
+
+  g_hash_table_iter_init (&iter, priv->clients_by_name);
+  while (all_clients_requested_interval && g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      AnimationsDbusServerClient *client = value;
+      unsigned int requested_interval = 0;
+
+      if (!animations_dbus_server_animation_manager_get_requested_geometry_notify_interval (client->animation_manager,
+                                                                                             &requested_interval))
+        all_clients_requested_interval = FALSE;
+      else
+        shortest_requested_interval = MIN (shortest_requested_interval, requested_interval);
+    }
+
+  if (all_clients_requested_interval)
+    effective_interval = MAX (priv->geometry_notify_interval,
+                              shortest_requested_interval);
+  else
+    effective_interval = priv->geometry_notify_interval;
 
-  g_assert (animation_manager != NULL);
+  if (effective_interval == priv->effective_geometry_notify_interval)
+    return;
 
-  return animations_dbus_server_animation_manager_lookup_effect_by_id (animation_manager,
-                                                                       animation_effect_id,
-                                                                       error);
+  priv->effective_geometry_notify_interval = effective_interval;
+  g_object_notify_by_pspec (G_OBJECT (server),
+                            animations_dbus_server_props[PROP_EFFECTIVE_GEOMETRY_NOTIFY_INTERVAL]);
 }
 
-/**
- * animations_dbus_server_list_surfaces:
- * @server: A #AnimationsDbusServer
- *
- * Get a #GPtrArray of surfaces that this #AnimationsDbusServer is tracking.
- *
- * Returns: (transfer none) (element-type AnimationsDbusServerSurface): A #GPtrArray
- * of #AnimationsDbusServerSurface.
- */
-GPtrArray *
-animations_dbus_server_list_surfaces (AnimationsDbusServer *server)
+/* The interval in milliseconds that AnimationsDbusServerSurface
+ * should wait between Geometry change notifications. */
+unsigned int
+animations_dbus_server_get_effective_geometry_notify_interval (AnimationsDbusServer *server)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
 
-  return priv->animatable_surfaces;
+  return priv->effective_geometry_notify_interval;
 }
 
-#define ANIMATIONS_DBUS_ANIMATABLE_SURFACE_OBJECT_PATH_TEMPLATE "/com/endlessm/Libanimation/AnimatableSurface/%u"
-
-/**
- * animations_dbus_server_register_surface:
- * @server: A #AnimationsDbusServer.
- * @bridge: An #AnimationsDbusServerSurfaceBridge.
- * @error: A #GError
- *
- * Register a new surface, using @bridge to register effects and get properties
- * on the underlying surface.
- *
- * Returns: (transfer full): An #AnimationsDbusServerSurface for the @title and
- *          @geometry of the surface, or %NULL with @error set in case the surface
- *          is not there.
- */
-AnimationsDbusServerSurface *
-animations_dbus_server_register_surface (AnimationsDbusServer               *server,
-                                         AnimationsDbusServerSurfaceBridge  *bridge,
-                                         GError                            **error)
+static void
+update_state_snapshot (AnimationsDbusServer *server)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
-  g_autoptr(AnimationsDbusServerSurface) server_surface =
-    animations_dbus_server_surface_new (priv->connection,
-                                        server,
-                                        bridge);
-  unsigned int allocated_id = priv->animatable_surface_serial++;
-  g_autofree char *object_path = g_strdup_printf (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_OBJECT_PATH_TEMPLATE, allocated_id);
+  GHashTableIter iter;
+  gpointer key;
 
-  if (!animations_dbus_server_surface_export (server_surface,
-                                              object_path,
-                                              error))
-    return NULL;
+  if (priv->state_snapshot_update_source != NULL)
+    {
+      g_source_destroy (priv->state_snapshot_update_source);
+      g_clear_pointer (&priv->state_snapshot_update_source, g_source_unref);
+    }
 
-  g_ptr_array_add (priv->animatable_surfaces, g_object_ref (server_surface));
-  return g_steal_pointer (&server_surface);
-}
+  if (priv->state_snapshot == NULL ||
+      g_hash_table_size (priv->state_snapshot_changed_surfaces) == 0)
+    return;
 
-/**
- * animations_dbus_server_unregister_surface:
- * @server: A #AnimationsDbusServer
- * @server_surface: The surface to unregister.
- * @error: A #GError
- *
- * Unregister and unexport the given surface.
- *
- * Returns: %TRUE if the surface was unregistered and unexported correctly, %FALSE
- *          with @error set otherwise.
- */
-gboolean
-animations_dbus_server_unregister_surface (AnimationsDbusServer         *server,
-                                           AnimationsDbusServerSurface  *server_surface,
-                                           GError                      **error)
-{
-  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  animations_dbus_state_snapshot_begin_update (priv->state_snapshot);
 
-  if (!g_ptr_array_remove_fast (priv->animatable_surfaces, server_surface))
+  g_hash_table_iter_init (&iter, priv->state_snapshot_changed_surfaces);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
     {
-      g_set_error (error,
-                   ANIMATIONS_DBUS_ERROR,
-                   ANIMATIONS_DBUS_ERROR_SERVER_SURFACE_NOT_FOUND,
-                   "Server surface %p was not found",
-                   (gpointer) server_surface);
-      return FALSE;
+      guint id = GPOINTER_TO_UINT (key);
+      GList *link = g_hash_table_lookup (priv->animatable_surfaces, key);
+
+      if (link == NULL)
+        {
+          animations_dbus_state_snapshot_remove_surface (priv->state_snapshot, id);
+          continue;
+        }
+
+      g_autoptr(GVariant) properties =
+        g_variant_ref_sink (animations_dbus_server_surface_serialize_properties (link->data));
+
+      if (!animations_dbus_state_snapshot_update_surface (priv->state_snapshot, id, properties))
+        g_debug ("No room left to publish surface %u in the state snapshot", id);
     }
 
-  animations_dbus_server_surface_unexport (server_surface);
-  return TRUE;
+  animations_dbus_state_snapshot_end_update (priv->state_snapshot);
+
+  g_hash_table_remove_all (priv->state_snapshot_changed_surfaces);
 }
 
-#define LIBANIMATION_ANIMATION_MANAGER_OBJECT_PATH_TEMPLATE "/com/endlessm/Libanimation/AnimationManager/%u"
+static gboolean
+on_update_state_snapshot (gpointer user_data)
+{
+  update_state_snapshot (ANIMATIONS_DBUS_SERVER (user_data));
+  return G_SOURCE_REMOVE;
+}
 
-/**
- * animations_dbus_server_create_animation_manager:
- * @server: An #AnimationsDbusServer.
- * @error: A #GError.
- *
- * Create a #AnimationsDbusServerAnimationManager for use by the
- * server side. The animation manager will appear on the bus but
- * will be managed by the caller (for instance, there is no bus name
- * that is being watched for the animation manager to be destroyed).
- *
- * Returns: (transfer full): A #AnimationsDbusServerAnimationManager
- * or %NULL with @error set in case of an error.
- */
-AnimationsDbusServerAnimationManager *
-animations_dbus_server_create_animation_manager (AnimationsDbusServer  *server,
-                                                 GError               **error)
+/* Called whenever a surface is registered, unregistered or has one
+ * of its properties changed. The record of the surface in the state
+ * snapshot is rewritten on the next update, if there is a snapshot. */
+void
+animations_dbus_server_queue_state_snapshot_update (AnimationsDbusServer *server,
+                                                    unsigned int          surface_id)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
-  g_autoptr(AnimationsDbusServerAnimationManager) server_animation_manager =
-    animations_dbus_server_animation_manager_new (priv->connection,
-                                                  server,
-                                                  priv->effect_factory);
 
-  /* Need to be careful to use preincrement here as we will be
-   * doing a reverse lookup of this later and we can't have 0
-   * as 0 == NULL, which would indicate that an id was not found
-   * for a given client name */
-  unsigned int allocated_id = ++priv->animation_manager_serial;
-  g_autofree char *object_path = g_strdup_printf (LIBANIMATION_ANIMATION_MANAGER_OBJECT_PATH_TEMPLATE,
-                                                  allocated_id);
+  if (priv->state_snapshot == NULL)
+    return;
 
-  if (!animations_dbus_server_animation_manager_export (server_animation_manager,
-                                                        object_path,
-                                                        error))
-    return NULL;
+  g_hash_table_add (priv->state_snapshot_changed_surfaces, GUINT_TO_POINTER (surface_id));
 
-  /* Because the caller could be a user of the server library and not
-   * the server library itself
-   * (from on_animation_connection_manager_register_client), we don't
-   * register the newly created AnimationsDbusServerAnimationManager in
-   * the hash table, since it is up to the caller to keep track of its
-   * lifetime. */
-  return g_steal_pointer (&server_animation_manager);
+  if (priv->state_snapshot_update_source == NULL)
+    {
+      priv->state_snapshot_update_source = g_idle_source_new ();
+      g_source_set_priority (priv->state_snapshot_update_source, G_PRIORITY_DEFAULT);
+      g_source_set_callback (priv->state_snapshot_update_source,
+                             on_update_state_snapshot,
+                             server,
+                             NULL);
+      g_source_attach (priv->state_snapshot_update_source, priv->main_context);
+    }
 }
 
-static gboolean
-remove_if_value_strequal (gpointer key G_GNUC_UNUSED,
-                          gpointer value,
-                          gpointer user_data)
+/* Get a new read-only file descriptor for the state snapshot, after
+ * bringing it up to date, for a client that asked for it with
+ * OpenStateSnapshot. */
+int
+animations_dbus_server_open_state_snapshot_fd (AnimationsDbusServer  *server,
+                                               GError               **error)
 {
-  return g_str_equal ((const char *) value, (const char *) user_data);
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+
+  if (priv->state_snapshot == NULL)
+    {
+      g_set_error_literal (error,
+                           G_DBUS_ERROR,
+                           G_DBUS_ERROR_NOT_SUPPORTED,
+                           "The server does not publish a state snapshot");
+      return -1;
+    }
+
+  update_state_snapshot (server);
+
+  return animations_dbus_state_snapshot_open_read_only_fd (priv->state_snapshot, error);
 }
 
-static void
-unregister_client (AnimationsDbusServer *server,
-                   const gchar          *name)
+static gboolean
+start_publishing_state_snapshot (AnimationsDbusServer  *server,
+                                 GError               **error)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
-  gpointer watch_id_ptr = NULL;
 
-  if (g_hash_table_lookup_extended (priv->client_name_watches,
-                                    name,
-                                    NULL,
-                                    (gpointer *) &watch_id_ptr))
-    {
-      unsigned int watch_id = GPOINTER_TO_UINT (watch_id_ptr);
-      g_autoptr(AnimationsDbusServerAnimationManager) server_animation_manager =
-          g_object_ref (g_hash_table_lookup (priv->animation_managers, name));
+  priv->state_snapshot = animations_dbus_state_snapshot_new (error);
 
-      g_bus_unwatch_name (watch_id);
-      g_hash_table_remove (priv->client_name_watches, name);
-      g_hash_table_remove (priv->animation_managers, name);
+  if (priv->state_snapshot == NULL)
+    return FALSE;
 
-      /* Need to do an O(N) lookup of ids names to remove the
-       * corresponding entry in the id table. We could also
-       * use an additional hash table here to avoid this cost
-       * but this seems like a simpler solution. */
-      unsigned int n_removed = g_hash_table_foreach_remove (priv->animation_manager_ids,
-                                                            remove_if_value_strequal,
-                                                            (gpointer) name);
+  /* Publish the surfaces that were registered before now */
+  for (GList *link = g_queue_peek_head_link (&priv->animatable_surface_order);
+       link != NULL;
+       link = link->next)
+    animations_dbus_server_queue_state_snapshot_update (server,
+                                                        animations_dbus_server_surface_get_id (link->data));
 
-      g_assert (n_removed > 0);
+  return TRUE;
+}
 
-      animations_dbus_server_animation_manager_unexport (server_animation_manager);
+/* The queue that the objects of @server add their property changes
+ * to, or %NULL once the server is disposed, in which case they are
+ * sent straight away. */
+AnimationsDbusPropertiesChangedQueue *
+animations_dbus_server_get_properties_changed_queue (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
 
-      g_signal_emit (server,
-                     animations_dbus_server_signals[SIGNAL_CLIENT_DISCONNECTED],
-                     0,
-                     name);
-    }
+  return priv->properties_changed_queue;
 }
 
+#define SETTINGS_CHANNELS_DRAIN_INTERVAL 16
+
+/* Apply the updates in the settings channels of all effects. */
 static void
-on_animation_manager_owner_name_lost (GDBusConnection *connection G_GNUC_UNUSED,
-                                      const char      *name,
-                                      gpointer         user_data)
+drain_settings_channels (AnimationsDbusServer *server)
 {
-  AnimationsDbusServer *server = user_data;
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  GHashTableIter iter;
+  gpointer key;
 
-  unregister_client (server, name);
+  if (priv->effects_with_settings_channels == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, priv->effects_with_settings_channels);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    animations_dbus_server_effect_drain_settings_channel (key);
 }
 
 static gboolean
-on_animation_connection_manager_register_client (AnimationsDbusConnectionManager *connection_manager,
-                                                 GDBusMethodInvocation           *invocation,
-                                                 gpointer                         user_data)
+on_drain_settings_channels (gpointer user_data)
+{
+  drain_settings_channels (user_data);
+  return G_SOURCE_CONTINUE;
+}
+
+/* Start draining the settings channel that @server_effect just opened. */
+void
+animations_dbus_server_add_settings_channel (AnimationsDbusServer       *server,
+                                             AnimationsDbusServerEffect *server_effect)
 {
-  AnimationsDbusServer *server = user_data;
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
-  const char *sender = g_dbus_method_invocation_get_sender (invocation);
-  g_autoptr(GError) local_error = NULL;
 
-  if (g_hash_table_contains (priv->animation_managers, sender))
+  if (priv->effects_with_settings_channels == NULL)
+    return;
+
+  g_hash_table_add (priv->effects_with_settings_channels, server_effect);
+
+  if (priv->settings_channels_drain_source == NULL)
     {
-      g_autofree char *message = g_strdup_printf ("Name '%s' already has an AnimationManager "
-                                                  "registered", sender);
-      g_dbus_method_invocation_return_error_literal (invocation,
-                                                     ANIMATIONS_DBUS_ERROR,
-                                                     ANIMATIONS_DBUS_ERROR_NAME_ALREADY_REGISTERED,
-                                                     message);
-      return TRUE;
+      priv->settings_channels_drain_source = g_timeout_source_new (SETTINGS_CHANNELS_DRAIN_INTERVAL);
+      g_source_set_callback (priv->settings_channels_drain_source,
+                             on_drain_settings_channels,
+                             server,
+                             NULL);
+      g_source_attach (priv->settings_channels_drain_source, priv->main_context);
     }
+}
 
-  g_autoptr(AnimationsDbusServerAnimationManager) server_animation_manager =
-    animations_dbus_server_create_animation_manager (server, &local_error);
+void
+animations_dbus_server_remove_settings_channel (AnimationsDbusServer       *server,
+                                                AnimationsDbusServerEffect *server_effect)
+{
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
 
-  if (server_animation_manager == NULL)
+  if (priv->effects_with_settings_channels == NULL ||
+      !g_hash_table_remove (priv->effects_with_settings_channels, server_effect))
+    return;
+
+  if (g_hash_table_size (priv->effects_with_settings_channels) == 0)
     {
-      g_autofree char *message = g_strdup_printf ("Could not register AnimationManager "
-                                                  "for name '%s': %s",
-                                                  sender,
-                                                  local_error->message);
-      g_dbus_method_invocation_return_error_literal (invocation,
-                                                     ANIMATIONS_DBUS_ERROR,
-                                                     ANIMATIONS_DBUS_ERROR_INTERNAL_ERROR,
-                                                     message);
-      return TRUE;
-    }
-
-  /* Watch the name on the connection. If the name disappears, we can remove
-   * the animation manager and drop all of its associated effects. */
-  guint name_watch_id = g_bus_watch_name_on_connection (priv->connection,
-                                                        sender,
-                                                        G_BUS_NAME_WATCHER_FLAGS_NONE,
-                                                        NULL,
-                                                        on_animation_manager_owner_name_lost,
-                                                        server,
-                                                        NULL);
-  g_hash_table_insert (priv->client_name_watches,
-                       g_strdup (sender),
-                       GINT_TO_POINTER (name_watch_id));
-  g_hash_table_insert (priv->animation_manager_ids,
-                       GINT_TO_POINTER (priv->animation_manager_serial),
-                       g_strdup (sender));
-  g_hash_table_insert (priv->animation_managers,
-                       g_strdup (sender),
-                       g_object_ref (server_animation_manager));
+      g_source_destroy (priv->settings_channels_drain_source);
+      g_clear_pointer (&priv->settings_channels_drain_source, g_source_unref);
+    }
+}
 
-  g_message ("Registering client '%s'", sender);
+/**
+ * animations_dbus_server_flush:
+ * @server: An #AnimationsDbusServer
+ *
+ * Apply the setting changes that clients wrote to their settings
+ * channels, update the state snapshot if there is one and send any
+ * property change notifications that have been queued up since the
+ * last flush. Notifications are otherwise sent once per
+ * main loop iteration, but a compositor may want to call this at
+ * a well defined point, such as at the end of each frame.
+ */
+void
+animations_dbus_server_flush (AnimationsDbusServer *server)
+{
+  AnimationsDbusServerPrivate *priv = NULL;
 
-  g_signal_emit (server,
-                 animations_dbus_server_signals[SIGNAL_CLIENT_CONNECTED],
-                 0,
-                 sender);
+  g_return_if_fail (ANIMATIONS_DBUS_IS_SERVER (server));
 
-  animations_dbus_connection_manager_complete_register_client (connection_manager,
-                                                               invocation,
-                                                               g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (server_animation_manager)));
-  return TRUE;
+  priv = animations_dbus_server_get_instance_private (server);
+
+  drain_settings_channels (server);
+  update_state_snapshot (server);
+
+  if (priv->properties_changed_queue != NULL)
+    animations_dbus_properties_changed_queue_flush (priv->properties_changed_queue);
 }
 
 #define LIBANIMATION_DBUS_NAME "com.endlessm.Libanimation"
@@ -411,10 +1943,10 @@ on_got_session_bus_name (GDBusConnection *connection,
   g_autoptr(AnimationsDbusConnectionManagerSkeleton) connection_manager_skeleton =
     ANIMATIONS_DBUS_CONNECTION_MANAGER_SKELETON (animations_dbus_connection_manager_skeleton_new ());
 
-  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (connection_manager_skeleton),
-                                         connection,
-                                         LIBANIMATION_CONNECTION_MANAGER_OBJECT_PATH,
-                                         &local_error))
+  if (!animations_dbus_server_export_object (server,
+                                             G_DBUS_INTERFACE_SKELETON (connection_manager_skeleton),
+                                             LIBANIMATION_CONNECTION_MANAGER_OBJECT_PATH,
+                                             &local_error))
     {
       g_task_return_error (task, g_steal_pointer (&local_error));
       return;
@@ -425,6 +1957,16 @@ on_got_session_bus_name (GDBusConnection *connection,
                            G_CALLBACK (on_animation_connection_manager_register_client),
                            server,
                            G_CONNECT_AFTER);
+  g_signal_connect_object (connection_manager_skeleton,
+                           "handle-register-client-with-snapshot",
+                           G_CALLBACK (on_animation_connection_manager_register_client_with_snapshot),
+                           server,
+                           G_CONNECT_AFTER);
+  g_signal_connect_object (connection_manager_skeleton,
+                           "handle-get-peer-address",
+                           G_CALLBACK (on_animation_connection_manager_get_peer_address),
+                           server,
+                           G_CONNECT_AFTER);
 
   priv->connection_manager_skeleton = g_steal_pointer (&connection_manager_skeleton);
   g_task_return_boolean (task, TRUE);
@@ -487,6 +2029,8 @@ on_got_session_bus_connection (GObject      *object G_GNUC_UNUSED,
     }
 
   priv->connection = g_steal_pointer (&connection);
+  g_dbus_object_manager_server_set_connection (priv->object_manager, priv->connection);
+  add_connection (server, priv->connection);
 
   /* Now that we have the connection, own the bus name on
    * behalf of the caller. */
@@ -513,6 +2057,7 @@ animations_dbus_server_init_async (GAsyncInitable      *initable,
   AnimationsDbusServer *server = ANIMATIONS_DBUS_SERVER (initable);
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
   g_autoptr(GTask) task = g_task_new (initable, cancellable, callback, user_data);
+  g_autoptr(GError) local_error = NULL;
 
   g_task_set_task_data (task, server, NULL);
 
@@ -522,6 +2067,24 @@ animations_dbus_server_init_async (GAsyncInitable      *initable,
       return;
     }
 
+  /* Start listening before owning the name, so that the address
+   * can already be handed out to the first client. */
+  if (priv->listen_peer_to_peer &&
+      priv->peer_server == NULL &&
+      !start_peer_server (server, cancellable, &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
+  if (priv->publish_state_snapshot &&
+      priv->state_snapshot == NULL &&
+      !start_publishing_state_snapshot (server, &local_error))
+    {
+      g_task_return_error (task, g_steal_pointer (&local_error));
+      return;
+    }
+
   /* The caller already passed us a connection that we can use,
    * continue on to calling attempt_to_own_session_bus_name */
   if (priv->connection != NULL)
@@ -562,6 +2125,19 @@ animations_dbus_server_set_property (GObject      *object,
     case PROP_EFFECT_FACTORY:
       priv->effect_factory = g_value_dup_object (value);
       break;
+    case PROP_GEOMETRY_NOTIFY_INTERVAL:
+      priv->geometry_notify_interval = g_value_get_uint (value);
+      animations_dbus_server_update_geometry_notify_interval (server);
+      break;
+    case PROP_LISTEN_PEER_TO_PEER:
+      priv->listen_peer_to_peer = g_value_get_boolean (value);
+      break;
+    case PROP_PUBLISH_STATE_SNAPSHOT:
+      priv->publish_state_snapshot = g_value_get_boolean (value);
+      break;
+    case PROP_LAZY_SURFACE_EXPORT:
+      priv->lazy_surface_export = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -583,6 +2159,21 @@ animations_dbus_server_get_property (GObject    *object,
     case PROP_CONNECTION:
       g_value_set_object (value, priv->connection);
       break;
+    case PROP_GEOMETRY_NOTIFY_INTERVAL:
+      g_value_set_uint (value, priv->geometry_notify_interval);
+      break;
+    case PROP_EFFECTIVE_GEOMETRY_NOTIFY_INTERVAL:
+      g_value_set_uint (value, priv->effective_geometry_notify_interval);
+      break;
+    case PROP_LISTEN_PEER_TO_PEER:
+      g_value_set_boolean (value, priv->listen_peer_to_peer);
+      break;
+    case PROP_PUBLISH_STATE_SNAPSHOT:
+      g_value_set_boolean (value, priv->publish_state_snapshot);
+      break;
+    case PROP_LAZY_SURFACE_EXPORT:
+      g_value_set_boolean (value, priv->lazy_surface_export);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -599,14 +2190,72 @@ animations_dbus_server_dispose (GObject *object)
 
   g_clear_object (&priv->connection);
   g_clear_object (&priv->connection_manager_skeleton);
+  g_clear_object (&priv->object_manager);
+  g_clear_object (&priv->peer_server);
   g_clear_object (&priv->effect_factory);
 
-  g_clear_pointer (&priv->animation_managers, g_hash_table_unref);
-  g_clear_pointer (&priv->animatable_surfaces, g_ptr_array_unref);
+  g_clear_pointer (&priv->clients_by_id, g_hash_table_unref);
+  g_clear_pointer (&priv->clients_by_name, g_hash_table_unref);
+  g_clear_pointer (&priv->peers, g_hash_table_unref);
+  g_clear_pointer (&priv->subtrees, g_hash_table_unref);
+  g_clear_pointer (&priv->connections, g_ptr_array_unref);
+  g_clear_pointer (&priv->animation_effects_by_path, g_hash_table_unref);
+  g_clear_pointer (&priv->animatable_surfaces, g_hash_table_unref);
+  g_queue_foreach (&priv->animatable_surface_order, (GFunc) g_object_unref, NULL);
+  g_queue_clear (&priv->animatable_surface_order);
+  g_clear_pointer (&priv->animatable_surfaces_array, g_ptr_array_unref);
+  g_clear_pointer (&priv->animatable_surface_paths, g_variant_unref);
+
+  if (priv->state_snapshot_update_source != NULL)
+    {
+      g_source_destroy (priv->state_snapshot_update_source);
+      g_clear_pointer (&priv->state_snapshot_update_source, g_source_unref);
+    }
+
+  g_clear_pointer (&priv->state_snapshot, animations_dbus_state_snapshot_free);
+  g_clear_pointer (&priv->state_snapshot_changed_surfaces, g_hash_table_unref);
+
+  if (priv->settings_channels_drain_source != NULL)
+    {
+      g_source_destroy (priv->settings_channels_drain_source);
+      g_clear_pointer (&priv->settings_channels_drain_source, g_source_unref);
+    }
+
+  g_clear_pointer (&priv->effects_with_settings_channels, g_hash_table_unref);
+  g_clear_pointer (&priv->properties_changed_queue, animations_dbus_properties_changed_queue_free);
 
   G_OBJECT_CLASS (animations_dbus_server_parent_class)->dispose (object);
 }
 
+static void
+animations_dbus_server_constructed (GObject *object)
+{
+  AnimationsDbusServer *server = ANIMATIONS_DBUS_SERVER (object);
+  AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
+  g_autoptr(GError) local_error = NULL;
+
+  G_OBJECT_CLASS (animations_dbus_server_parent_class)->constructed (object);
+
+  priv->object_manager = g_dbus_object_manager_server_new (LIBANIMATION_OBJECT_MANAGER_OBJECT_PATH);
+  g_dbus_object_manager_server_set_connection (priv->object_manager, priv->connection);
+
+  if (priv->connection != NULL)
+    add_connection (server, priv->connection);
+
+  /* Stays registered until the server is stopped, on the bus
+   * connection once there is one and on every peer connection. */
+  priv->animatable_surfaces_subtree_id =
+    animations_dbus_server_register_subtree (server,
+                                             ANIMATIONS_DBUS_ANIMATABLE_SURFACE_SUBTREE_OBJECT_PATH,
+                                             &animatable_surfaces_subtree_vtable,
+                                             server,
+                                             &local_error);
+
+  if (priv->animatable_surfaces_subtree_id == 0)
+    g_warning ("Could not register the AnimatableSurface subtree: %s",
+               local_error->message);
+}
+
 static void
 animations_dbus_server_finalize (GObject *object)
 {
@@ -614,7 +2263,8 @@ animations_dbus_server_finalize (GObject *object)
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
 
   g_assert (priv->name_id == 0);
-  g_clear_pointer (&priv->client_name_watches, g_hash_table_unref);
+
+  g_clear_pointer (&priv->main_context, g_main_context_unref);
 
   G_OBJECT_CLASS (animations_dbus_server_parent_class)->finalize (object);
 }
@@ -624,19 +2274,31 @@ animations_dbus_server_init (AnimationsDbusServer *server)
 {
   AnimationsDbusServerPrivate *priv = animations_dbus_server_get_instance_private (server);
 
-  priv->animatable_surfaces = g_ptr_array_new_with_free_func (g_object_unref);
-  priv->animation_managers = g_hash_table_new_full (g_str_hash,
-                                                    g_str_equal,
-                                                    g_free,
-                                                    g_object_unref);
-  priv->animation_manager_ids = g_hash_table_new_full (g_direct_hash,
-                                                       g_direct_equal,
-                                                       NULL,
-                                                       g_free);
-  priv->client_name_watches = g_hash_table_new_full (g_str_hash,
-                                                     g_str_equal,
-                                                     g_free,
-                                                     NULL);
+  priv->animatable_surfaces = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_queue_init (&priv->animatable_surface_order);
+  priv->animatable_surfaces_generation = 1;
+  priv->clients_by_name = g_hash_table_new_full (g_str_hash,
+                                                 g_str_equal,
+                                                 NULL,
+                                                 (GDestroyNotify) animations_dbus_server_client_free);
+  priv->clients_by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->peers = g_hash_table_new_full (g_direct_hash,
+                                       g_direct_equal,
+                                       NULL,
+                                       (GDestroyNotify) animations_dbus_server_peer_free);
+  priv->connections = g_ptr_array_new_with_free_func (g_object_unref);
+  priv->subtrees = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) animations_dbus_server_subtree_free);
+  priv->animation_effects_by_path = g_hash_table_new_full (g_str_hash,
+                                                           g_str_equal,
+                                                           g_free,
+                                                           NULL);
+  priv->state_snapshot_changed_surfaces = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->main_context = g_main_context_ref_thread_default ();
+  priv->properties_changed_queue = animations_dbus_properties_changed_queue_new (priv->main_context);
+  priv->effects_with_settings_channels = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 static void
@@ -646,6 +2308,7 @@ animations_dbus_server_class_init (AnimationsDbusServerClass *klass)
 
   object_class->get_property = animations_dbus_server_get_property;
   object_class->set_property = animations_dbus_server_set_property;
+  object_class->constructed = animations_dbus_server_constructed;
   object_class->dispose = animations_dbus_server_dispose;
   object_class->finalize = animations_dbus_server_finalize;
 
@@ -663,6 +2326,51 @@ animations_dbus_server_class_init (AnimationsDbusServerClass *klass)
                          ANIMATIONS_DBUS_TYPE_SERVER_EFFECT_FACTORY,
                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
 
+  animations_dbus_server_props[PROP_GEOMETRY_NOTIFY_INTERVAL] =
+    g_param_spec_uint ("geometry-notify-interval",
+                       "Geometry notify interval",
+                       "The minimum interval in milliseconds between Geometry change "
+                       "notifications for each surface, or 0 to send every change",
+                       0,
+                       G_MAXUINT,
+                       DEFAULT_GEOMETRY_NOTIFY_INTERVAL,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+
+  animations_dbus_server_props[PROP_EFFECTIVE_GEOMETRY_NOTIFY_INTERVAL] =
+    g_param_spec_uint ("effective-geometry-notify-interval",
+                       "Effective geometry notify interval",
+                       "The interval in milliseconds that is actually waited between "
+                       "Geometry change notifications, taking the intervals requested "
+                       "by clients into account",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       G_PARAM_READABLE);
+
+  animations_dbus_server_props[PROP_LISTEN_PEER_TO_PEER] =
+    g_param_spec_boolean ("listen-peer-to-peer",
+                          "Listen peer to peer",
+                          "Whether to also listen on a private socket that clients "
+                          "can connect to directly instead of going through the bus",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  animations_dbus_server_props[PROP_PUBLISH_STATE_SNAPSHOT] =
+    g_param_spec_boolean ("publish-state-snapshot",
+                          "Publish state snapshot",
+                          "Whether to publish the state of all surfaces in shared "
+                          "memory that clients can map with OpenStateSnapshot",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+  animations_dbus_server_props[PROP_LAZY_SURFACE_EXPORT] =
+    g_param_spec_boolean ("lazy-surface-export",
+                          "Lazy surface export",
+                          "Whether to only export surfaces while at least "
+                          "one client is registered",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
   g_object_class_install_properties (object_class,
                                      NPROPS,
                                      animations_dbus_server_props);
@@ -771,34 +2479,63 @@ animations_dbus_server_stop (AnimationsDbusServer  *self,
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  while (priv->animatable_surfaces != NULL && priv->animatable_surfaces->len > 0)
+  if (priv->animatable_surfaces != NULL && priv->animatable_surface_order.head != NULL)
     {
-      AnimationsDbusServerSurface *surface = g_ptr_array_index (priv->animatable_surfaces, 0);
+      /* Unregister all the surfaces at once, so that clients only
+       * get one SurfacesRemoved signal for them */
+      g_autoptr(GPtrArray) surfaces = g_ptr_array_new_full (priv->animatable_surface_order.length,
+                                                            g_object_unref);
+
+      for (GList *link = priv->animatable_surface_order.head; link != NULL; link = link->next)
+        g_ptr_array_add (surfaces, g_object_ref (link->data));
 
-      if (!animations_dbus_server_unregister_surface (self, surface, NULL))
+      if (!animations_dbus_server_unregister_surfaces (self, surfaces, NULL))
         error_seen = TRUE;
     }
 
-  if (priv->animation_managers != NULL)
+  if (priv->clients_by_name != NULL)
     {
-      /* Operate on a copy of the keys of @animation_managers to avoid iterating while modifying the hash table.
-       * Operate on a copy of the name as unregistering it will free the original storage location. */
-      GList *names = g_hash_table_get_keys (priv->animation_managers);
+      /* Operate on a list of the client records to avoid iterating while
+       * modifying the hash table. Each record stays alive until it is
+       * unregistered itself. */
+      GList *clients = g_hash_table_get_values (priv->clients_by_name);
       GList *l;
 
-      for (l = names; l != NULL; l = l->next)
-        {
-          const gchar *name = l->data;
-          g_autofree gchar *name_copy = g_strdup (name);
-          unregister_client (self, name_copy);
-        }
+      for (l = clients; l != NULL; l = l->next)
+        unregister_client_record (self, l->data);
+
+      g_list_free (clients);
+    }
+
+  if (priv->connection_manager_skeleton != NULL)
+    animations_dbus_server_unexport_object (self,
+                                            G_DBUS_INTERFACE_SKELETON (priv->connection_manager_skeleton));
+
+  if (priv->peer_server != NULL)
+    g_dbus_server_stop (priv->peer_server);
+
+  /* Clients on peer connections were already unregistered above,
+   * which also unregistered their subtrees. */
+  if (priv->subtrees != NULL)
+    g_hash_table_remove_all (priv->subtrees);
+
+  priv->animatable_surfaces_subtree_id = 0;
+
+  if (priv->peers != NULL)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      g_hash_table_iter_init (&iter, priv->peers);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_remove (priv->connections, key);
 
-      g_list_free (names);
+      g_hash_table_remove_all (priv->peers);
     }
 
-  if (priv->connection_manager_skeleton != NULL &&
-      g_dbus_interface_skeleton_get_connection (G_DBUS_INTERFACE_SKELETON (priv->connection_manager_skeleton)) != NULL)
-    g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (priv->connection_manager_skeleton));
+  /* Unexports the org.freedesktop.DBus.ObjectManager interface itself */
+  if (priv->object_manager != NULL)
+    g_dbus_object_manager_server_set_connection (priv->object_manager, NULL);
 
   if (priv->name_id != 0)
     {
@@ -37,22 +37,38 @@ G_BEGIN_DECLS
 
 GPtrArray * animations_dbus_server_list_surfaces (AnimationsDbusServer *server);
 
+GVariant * animations_dbus_server_list_surface_object_paths (AnimationsDbusServer *server);
+
 AnimationsDbusServerEffect * animations_dbus_server_lookup_animation_effect_by_ids (AnimationsDbusServer  *server,
                                                                                     unsigned int           animation_manager_id,
                                                                                     unsigned int           animation_effect_id,
                                                                                     GError               **error);
 
+AnimationsDbusServerEffect * animations_dbus_server_lookup_animation_effect_by_path (AnimationsDbusServer  *server,
+                                                                                     const char            *object_path,
+                                                                                     GError               **error);
+
 AnimationsDbusServerSurface * animations_dbus_server_register_surface (AnimationsDbusServer               *server,
                                                                        AnimationsDbusServerSurfaceBridge  *bridge,
                                                                        GError                            **error);
 
+GPtrArray * animations_dbus_server_register_surfaces (AnimationsDbusServer  *server,
+                                                      GPtrArray             *bridges,
+                                                      GError               **error);
+
 gboolean animations_dbus_server_unregister_surface (AnimationsDbusServer         *server,
                                                     AnimationsDbusServerSurface  *server_surface,
                                                     GError                      **error);
 
+gboolean animations_dbus_server_unregister_surfaces (AnimationsDbusServer  *server,
+                                                     GPtrArray             *server_surfaces,
+                                                     GError               **error);
+
 AnimationsDbusServerAnimationManager * animations_dbus_server_create_animation_manager (AnimationsDbusServer  *server,
                                                                                         GError               **error);
 
+void animations_dbus_server_flush (AnimationsDbusServer *server);
+
 AnimationsDbusServer * animations_dbus_server_new_finish (GObject       *source,
                                                           GAsyncResult  *result,
                                                           GError       **error);
@@ -0,0 +1,119 @@
+/* Copyright 2018 Endless Mobile, Inc.
+ *
+ * libanimation-dbus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * libanimation-dbus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with eos-discovery-feed.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ * - Sam Spilsbury <sam@endlessm.com>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#include "animations-dbus-server-effect.h"
+#include "animations-dbus-server-object.h"
+#include "animations-dbus-server-skeleton-properties.h"
+#include "animations-dbus-server-types.h"
+
+G_BEGIN_DECLS
+
+/* Functions shared between the server side objects that are
+ * not part of the public API. */
+
+gboolean animations_dbus_server_export_object (AnimationsDbusServer    *server,
+                                               GDBusInterfaceSkeleton  *skeleton,
+                                               const char              *object_path,
+                                               GError                 **error);
+
+void animations_dbus_server_unexport_object (AnimationsDbusServer   *server,
+                                             GDBusInterfaceSkeleton *skeleton);
+
+GPtrArray * animations_dbus_server_get_connections (AnimationsDbusServer *server);
+
+guint animations_dbus_server_register_subtree (AnimationsDbusServer       *server,
+                                               const char                 *object_path,
+                                               const GDBusSubtreeVTable   *vtable,
+                                               gpointer                    user_data,
+                                               GError                    **error);
+
+void animations_dbus_server_unregister_subtree (AnimationsDbusServer *server,
+                                                guint                 subtree_id);
+
+void animations_dbus_server_track_animation_effect (AnimationsDbusServer       *server,
+                                                    AnimationsDbusServerEffect *server_effect);
+
+/* An attachment of an AnimationsDbusServerEffect to an event on an
+ * AnimationsDbusServerSurface. It is owned by the surface and linked
+ * into the list of attachments of its effect through @effect_link,
+ * so that destroying the effect only has to visit the surfaces it is
+ * actually attached to. */
+typedef struct _AnimationsDbusServerSurfaceAttachment AnimationsDbusServerSurfaceAttachment;
+
+void animations_dbus_server_surface_remove_attachment (AnimationsDbusServerSurfaceAttachment *attachment);
+
+void animations_dbus_server_effect_track_attachment (AnimationsDbusServerEffect *server_effect,
+                                                     GList                      *effect_link);
+
+void animations_dbus_server_effect_untrack_attachment (AnimationsDbusServerEffect *server_effect,
+                                                       GList                      *effect_link);
+
+void animations_dbus_server_effect_set_dispatch_target (AnimationsDbusServerEffect *server_effect,
+                                                        const char                 *object_path,
+                                                        GPtrArray                  *connections);
+
+const char * animations_dbus_server_effect_get_object_path (AnimationsDbusServerEffect *server_effect);
+
+void animations_dbus_server_effect_set_server (AnimationsDbusServerEffect *server_effect,
+                                               AnimationsDbusServer       *server);
+
+void animations_dbus_server_effect_drain_settings_channel (AnimationsDbusServerEffect *server_effect);
+
+AnimationsDbusPropertiesChangedQueue * animations_dbus_server_get_properties_changed_queue (AnimationsDbusServer *server);
+
+void animations_dbus_server_add_settings_channel (AnimationsDbusServer       *server,
+                                                  AnimationsDbusServerEffect *server_effect);
+
+void animations_dbus_server_remove_settings_channel (AnimationsDbusServer       *server,
+                                                     AnimationsDbusServerEffect *server_effect);
+
+AnimationsDbusServerSurface * animations_dbus_server_surface_new_with_id (GDBusConnection                   *connection,
+                                                                          AnimationsDbusServer              *server,
+                                                                          AnimationsDbusServerSurfaceBridge *bridge,
+                                                                          unsigned int                       id);
+
+void animations_dbus_server_surface_set_dispatch_target (AnimationsDbusServerSurface *server_surface,
+                                                         const char                  *object_path,
+                                                         GPtrArray                   *connections);
+
+GVariant * animations_dbus_server_surface_serialize_properties (AnimationsDbusServerSurface *server_surface);
+
+GVariant * animations_dbus_server_serialize_surfaces_with_properties (AnimationsDbusServer *server);
+
+void animations_dbus_server_queue_state_snapshot_update (AnimationsDbusServer *server,
+                                                         unsigned int          surface_id);
+
+int animations_dbus_server_open_state_snapshot_fd (AnimationsDbusServer  *server,
+                                                   GError               **error);
+
+unsigned int animations_dbus_server_get_effective_geometry_notify_interval (AnimationsDbusServer *server);
+
+void animations_dbus_server_update_geometry_notify_interval (AnimationsDbusServer *server);
+
+gboolean animations_dbus_server_animation_manager_get_requested_geometry_notify_interval (AnimationsDbusServerAnimationManager *server_animation_manager,
+                                                                                          unsigned int                         *out_interval);
+
+G_END_DECLS
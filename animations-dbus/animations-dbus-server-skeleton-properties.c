@@ -19,106 +19,442 @@
  */
 
 #include <glib.h>
+#include <string.h>
 
 #include "animations-dbus-errors.h"
 #include "animations-dbus-server-skeleton-properties.h"
 
-static gpointer
-alloc_gtype (GType type)
+/* How a property value is converted to and from a GVariant */
+typedef enum
 {
-  GType *ptr = g_new0 (GType, 1);
+  PROPERTY_KIND_BOOLEAN,
+  PROPERTY_KIND_UCHAR,
+  PROPERTY_KIND_INT,
+  PROPERTY_KIND_UINT,
+  PROPERTY_KIND_LONG,
+  PROPERTY_KIND_ULONG,
+  PROPERTY_KIND_INT64,
+  PROPERTY_KIND_UINT64,
+  PROPERTY_KIND_FLOAT,
+  PROPERTY_KIND_DOUBLE,
+  PROPERTY_KIND_STRING,
+  PROPERTY_KIND_STRV,
+  PROPERTY_KIND_ENUM,
+  PROPERTY_KIND_FLAGS,
+  PROPERTY_KIND_VARIANT
+} PropertyKind;
 
-  *ptr = type;
-  return ptr;
+static gboolean
+property_kind_for_value_type (GType                value_type,
+                              PropertyKind        *out_kind,
+                              const GVariantType **out_variant_type)
+{
+  /* G_TYPE_STRV is a boxed type, so check for it before
+   * switching on the fundamental type */
+  if (value_type == G_TYPE_STRV)
+    {
+      *out_kind = PROPERTY_KIND_STRV;
+      *out_variant_type = G_VARIANT_TYPE_STRING_ARRAY;
+      return TRUE;
+    }
+
+  switch (G_TYPE_FUNDAMENTAL (value_type))
+    {
+    case G_TYPE_BOOLEAN:
+      *out_kind = PROPERTY_KIND_BOOLEAN;
+      *out_variant_type = G_VARIANT_TYPE_BOOLEAN;
+      return TRUE;
+    case G_TYPE_UCHAR:
+      *out_kind = PROPERTY_KIND_UCHAR;
+      *out_variant_type = G_VARIANT_TYPE_BYTE;
+      return TRUE;
+    case G_TYPE_INT:
+      *out_kind = PROPERTY_KIND_INT;
+      *out_variant_type = G_VARIANT_TYPE_INT32;
+      return TRUE;
+    case G_TYPE_UINT:
+      *out_kind = PROPERTY_KIND_UINT;
+      *out_variant_type = G_VARIANT_TYPE_UINT32;
+      return TRUE;
+    case G_TYPE_LONG:
+      *out_kind = PROPERTY_KIND_LONG;
+      *out_variant_type = G_VARIANT_TYPE_INT64;
+      return TRUE;
+    case G_TYPE_ULONG:
+      *out_kind = PROPERTY_KIND_ULONG;
+      *out_variant_type = G_VARIANT_TYPE_UINT64;
+      return TRUE;
+    case G_TYPE_INT64:
+      *out_kind = PROPERTY_KIND_INT64;
+      *out_variant_type = G_VARIANT_TYPE_INT64;
+      return TRUE;
+    case G_TYPE_UINT64:
+      *out_kind = PROPERTY_KIND_UINT64;
+      *out_variant_type = G_VARIANT_TYPE_UINT64;
+      return TRUE;
+    case G_TYPE_FLOAT:
+      *out_kind = PROPERTY_KIND_FLOAT;
+      *out_variant_type = G_VARIANT_TYPE_DOUBLE;
+      return TRUE;
+    case G_TYPE_DOUBLE:
+      *out_kind = PROPERTY_KIND_DOUBLE;
+      *out_variant_type = G_VARIANT_TYPE_DOUBLE;
+      return TRUE;
+    case G_TYPE_STRING:
+      *out_kind = PROPERTY_KIND_STRING;
+      *out_variant_type = G_VARIANT_TYPE_STRING;
+      return TRUE;
+    case G_TYPE_ENUM:
+      /* Enums are represented by their nick */
+      *out_kind = PROPERTY_KIND_ENUM;
+      *out_variant_type = G_VARIANT_TYPE_STRING;
+      return TRUE;
+    case G_TYPE_FLAGS:
+      /* Flags are represented by the nicks of the set flags */
+      *out_kind = PROPERTY_KIND_FLAGS;
+      *out_variant_type = G_VARIANT_TYPE_STRING_ARRAY;
+      return TRUE;
+    case G_TYPE_VARIANT:
+      *out_kind = PROPERTY_KIND_VARIANT;
+      *out_variant_type = G_VARIANT_TYPE_VARIANT;
+      return TRUE;
+    default:
+      return FALSE;
+    }
 }
 
-static gpointer
-value_type_to_variant_type_ht (gpointer data G_GNUC_UNUSED)
-{
-  GHashTable *ht = g_hash_table_new_full (g_int_hash, g_int_equal, g_free, NULL);
-
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_STRING),
-                       (gpointer) G_VARIANT_TYPE_STRING);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_STRV),
-                       (gpointer) G_VARIANT_TYPE_STRING_ARRAY);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_BOOLEAN),
-                       (gpointer) G_VARIANT_TYPE_BOOLEAN);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_UCHAR),
-                       (gpointer) G_VARIANT_TYPE_BYTE);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_INT),
-                       (gpointer) G_VARIANT_TYPE_INT32);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_UINT),
-                       (gpointer) G_VARIANT_TYPE_UINT32);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_INT64),
-                       (gpointer) G_VARIANT_TYPE_INT64);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_UINT64),
-                       (gpointer) G_VARIANT_TYPE_UINT64);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_DOUBLE),
-                       (gpointer) G_VARIANT_TYPE_DOUBLE);
-  g_hash_table_insert (ht,
-                       alloc_gtype (G_TYPE_VARIANT),
-                       (gpointer) G_VARIANT_TYPE_VARIANT);
-
-  return ht;
+/* Returns a new, possibly floating, reference or %NULL if
+ * a variant property has no value. */
+static GVariant *
+property_value_to_variant (PropertyKind  kind,
+                           const GValue *value)
+{
+  switch (kind)
+    {
+    case PROPERTY_KIND_BOOLEAN:
+      return g_variant_new_boolean (g_value_get_boolean (value));
+    case PROPERTY_KIND_UCHAR:
+      return g_variant_new_byte (g_value_get_uchar (value));
+    case PROPERTY_KIND_INT:
+      return g_variant_new_int32 (g_value_get_int (value));
+    case PROPERTY_KIND_UINT:
+      return g_variant_new_uint32 (g_value_get_uint (value));
+    case PROPERTY_KIND_LONG:
+      return g_variant_new_int64 (g_value_get_long (value));
+    case PROPERTY_KIND_ULONG:
+      return g_variant_new_uint64 (g_value_get_ulong (value));
+    case PROPERTY_KIND_INT64:
+      return g_variant_new_int64 (g_value_get_int64 (value));
+    case PROPERTY_KIND_UINT64:
+      return g_variant_new_uint64 (g_value_get_uint64 (value));
+    case PROPERTY_KIND_FLOAT:
+      return g_variant_new_double (g_value_get_float (value));
+    case PROPERTY_KIND_DOUBLE:
+      return g_variant_new_double (g_value_get_double (value));
+    case PROPERTY_KIND_STRING:
+      {
+        const char *str = g_value_get_string (value);
+        return g_variant_new_string (str != NULL ? str : "");
+      }
+    case PROPERTY_KIND_STRV:
+      {
+        const char * const *strv = g_value_get_boxed (value);
+        return g_variant_new_strv (strv, strv != NULL ? -1 : 0);
+      }
+    case PROPERTY_KIND_ENUM:
+      {
+        GEnumClass *enum_class = g_type_class_peek (G_VALUE_TYPE (value));
+        GEnumValue *enum_value = g_enum_get_value (enum_class, g_value_get_enum (value));
+
+        return g_variant_new_string (enum_value != NULL ? enum_value->value_nick : "");
+      }
+    case PROPERTY_KIND_FLAGS:
+      {
+        GFlagsClass *flags_class = g_type_class_peek (G_VALUE_TYPE (value));
+        unsigned int flags = g_value_get_flags (value);
+        GVariantBuilder builder;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+
+        for (unsigned int i = 0; i < flags_class->n_values; ++i)
+          {
+            GFlagsValue *flags_value = &flags_class->values[i];
+
+            if (flags_value->value != 0 && (flags & flags_value->value) == flags_value->value)
+              g_variant_builder_add (&builder, "s", flags_value->value_nick);
+          }
+
+        return g_variant_builder_end (&builder);
+      }
+    case PROPERTY_KIND_VARIANT:
+      return g_value_dup_variant (value);
+    default:
+      g_assert_not_reached ();
+    }
+
+  return NULL;
 }
 
-static const GVariantType *
-value_type_to_variant_type (GType type)
+/* @value must already be initialized to the type of the property
+ * and @variant must be of the variant type for @kind. */
+static gboolean
+property_value_from_variant (PropertyKind   kind,
+                             GVariant      *variant,
+                             GValue        *value,
+                             GError       **error)
 {
-  static GOnce value_type_to_variant_type_once;
+  switch (kind)
+    {
+    case PROPERTY_KIND_BOOLEAN:
+      g_value_set_boolean (value, g_variant_get_boolean (variant));
+      return TRUE;
+    case PROPERTY_KIND_UCHAR:
+      g_value_set_uchar (value, g_variant_get_byte (variant));
+      return TRUE;
+    case PROPERTY_KIND_INT:
+      g_value_set_int (value, g_variant_get_int32 (variant));
+      return TRUE;
+    case PROPERTY_KIND_UINT:
+      g_value_set_uint (value, g_variant_get_uint32 (variant));
+      return TRUE;
+    case PROPERTY_KIND_LONG:
+      g_value_set_long (value, (long) g_variant_get_int64 (variant));
+      return TRUE;
+    case PROPERTY_KIND_ULONG:
+      g_value_set_ulong (value, (unsigned long) g_variant_get_uint64 (variant));
+      return TRUE;
+    case PROPERTY_KIND_INT64:
+      g_value_set_int64 (value, g_variant_get_int64 (variant));
+      return TRUE;
+    case PROPERTY_KIND_UINT64:
+      g_value_set_uint64 (value, g_variant_get_uint64 (variant));
+      return TRUE;
+    case PROPERTY_KIND_FLOAT:
+      g_value_set_float (value, (float) g_variant_get_double (variant));
+      return TRUE;
+    case PROPERTY_KIND_DOUBLE:
+      g_value_set_double (value, g_variant_get_double (variant));
+      return TRUE;
+    case PROPERTY_KIND_STRING:
+      g_value_set_string (value, g_variant_get_string (variant, NULL));
+      return TRUE;
+    case PROPERTY_KIND_STRV:
+      g_value_take_boxed (value, g_variant_dup_strv (variant, NULL));
+      return TRUE;
+    case PROPERTY_KIND_ENUM:
+      {
+        GEnumClass *enum_class = g_type_class_peek (G_VALUE_TYPE (value));
+        const char *nick = g_variant_get_string (variant, NULL);
+        GEnumValue *enum_value = g_enum_get_value_by_nick (enum_class, nick);
+
+        if (enum_value == NULL)
+          {
+            g_set_error (error,
+                         ANIMATIONS_DBUS_ERROR,
+                         ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
+                         "'%s' is not a valid value for %s",
+                         nick,
+                         G_VALUE_TYPE_NAME (value));
+            return FALSE;
+          }
+
+        g_value_set_enum (value, enum_value->value);
+        return TRUE;
+      }
+    case PROPERTY_KIND_FLAGS:
+      {
+        GFlagsClass *flags_class = g_type_class_peek (G_VALUE_TYPE (value));
+        unsigned int flags = 0;
+        GVariantIter iter;
+        const char *nick;
 
-  g_once (&value_type_to_variant_type_once, value_type_to_variant_type_ht, NULL);
+        g_variant_iter_init (&iter, variant);
+        while (g_variant_iter_next (&iter, "&s", &nick))
+          {
+            GFlagsValue *flags_value = g_flags_get_value_by_nick (flags_class, nick);
 
-  const GVariantType *variant_type =
-    g_hash_table_lookup (value_type_to_variant_type_once.retval, &type);
+            if (flags_value == NULL)
+              {
+                g_set_error (error,
+                             ANIMATIONS_DBUS_ERROR,
+                             ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
+                             "'%s' is not a valid flag for %s",
+                             nick,
+                             G_VALUE_TYPE_NAME (value));
+                return FALSE;
+              }
 
-  if (variant_type == NULL)
-    g_warning ("Cannot convert from GType %lu to GVariantType", type);
+            flags |= flags_value->value;
+          }
 
-  return variant_type;
+        g_value_set_flags (value, flags);
+        return TRUE;
+      }
+    case PROPERTY_KIND_VARIANT:
+      g_value_set_variant (value, variant);
+      return TRUE;
+    default:
+      g_assert_not_reached ();
+    }
+
+  return FALSE;
 }
 
-static GVariantDict *
-serialize_properties_to_variant_dict (GObject *object)
+/* An entry in the codec for a single property */
+typedef struct
 {
+  GParamSpec         *pspec;         /* (unowned) */
+  PropertyKind        kind;
+  const GVariantType *variant_type;
+} PropertyCodecEntry;
+
+/* Everything needed to convert the properties of a class to and
+ * from GVariants. The codec only depends on the class, so it is built
+ * once per GType, attached to the type and shared between all
+ * instances. It holds a reference on the class so that the class
+ * structure and its pspecs outlive it, which means that a codec is
+ * never freed or replaced once it has been looked up. */
+typedef struct
+{
+  GObjectClass       *object_class;     /* (owned) */
+  unsigned int        n_entries;
+  PropertyCodecEntry *entries;
+  GHashTable         *entries_by_name;  /* (key-type: utf8) (value-type: PropertyCodecEntry) */
+  GVariant           *schema;           /* (owned) (nullable) */
+} PropertyCodec;
+
+static PropertyCodec *
+property_codec_new (GType type)
+{
+  GObjectClass *object_class = g_type_class_ref (type);
   unsigned int n_pspecs = 0;
-  GParamSpec **pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_pspecs);
-  g_autoptr(GVariantDict) vardict = g_variant_dict_new (NULL);
+  g_autofree GParamSpec **pspecs = g_object_class_list_properties (object_class, &n_pspecs);
+  PropertyCodec *codec = g_new0 (PropertyCodec, 1);
 
-  g_variant_dict_init (vardict, NULL);
+  codec->object_class = object_class;
+  codec->entries = g_new0 (PropertyCodecEntry, n_pspecs);
+  codec->entries_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   for (unsigned int i = 0; i < n_pspecs; ++i)
     {
-      g_auto(GValue) value = G_VALUE_INIT;
+      PropertyCodecEntry *entry = &codec->entries[codec->n_entries];
 
-      g_value_init (&value, pspecs[i]->value_type);
-      g_object_get_property (object, pspecs[i]->name, &value);
+      if (!property_kind_for_value_type (pspecs[i]->value_type,
+                                         &entry->kind,
+                                         &entry->variant_type))
+        {
+          g_warning ("Cannot convert property '%s' of type %s on %s to a GVariant, ignoring it",
+                     pspecs[i]->name,
+                     g_type_name (pspecs[i]->value_type),
+                     G_OBJECT_CLASS_NAME (object_class));
+          continue;
+        }
 
-      /* Non-floating reference */
-      g_autoptr(GVariant) variant =
-        g_dbus_gvalue_to_gvariant (&value, value_type_to_variant_type (pspecs[i]->value_type));
-      g_variant_dict_insert_value (vardict, pspecs[i]->name, variant);
+      entry->pspec = pspecs[i];
+
+      /* Property names are canonicalized to use hyphens, but
+       * g_object_class_find_property also accepted underscores,
+       * so keep accepting those too. */
+      g_hash_table_insert (codec->entries_by_name, g_strdup (pspecs[i]->name), entry);
+
+      if (strchr (pspecs[i]->name, '-') != NULL)
+        g_hash_table_insert (codec->entries_by_name,
+                             g_strdelimit (g_strdup (pspecs[i]->name), "-", '_'),
+                             entry);
+
+      ++codec->n_entries;
+    }
+
+  return codec;
+}
+
+G_LOCK_DEFINE_STATIC (property_codecs);
+G_DEFINE_QUARK (animations-dbus-property-codec, property_codec)
+
+/* Called with the property_codecs lock held */
+static PropertyCodec *
+property_codec_for_class_unlocked (GObjectClass *object_class)
+{
+  GType type = G_OBJECT_CLASS_TYPE (object_class);
+  PropertyCodec *codec = g_type_get_qdata (type, property_codec_quark ());
+
+  if (codec == NULL)
+    {
+      codec = property_codec_new (type);
+      g_type_set_qdata (type, property_codec_quark (), codec);
     }
 
-  g_free (pspecs);
-  return g_steal_pointer (&vardict);
+  return codec;
+}
+
+/* The returned codec stays valid after the lock is released,
+ * since codecs are never freed. */
+static PropertyCodec *
+property_codec_for_object (GObject *object)
+{
+  PropertyCodec *codec = NULL;
+
+  G_LOCK (property_codecs);
+  codec = property_codec_for_class_unlocked (G_OBJECT_GET_CLASS (object));
+  G_UNLOCK (property_codecs);
+
+  return codec;
 }
 
 GVariant *
 animations_dbus_serialize_properties_to_variant (GObject *object)
 {
-  g_autoptr(GVariantDict) vardict = serialize_properties_to_variant_dict (object);
+  PropertyCodec *codec = property_codec_for_object (object);
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (unsigned int i = 0; i < codec->n_entries; ++i)
+    {
+      const PropertyCodecEntry *entry = &codec->entries[i];
+      g_auto(GValue) value = G_VALUE_INIT;
+
+      if ((entry->pspec->flags & G_PARAM_READABLE) == 0)
+        continue;
+
+      g_value_init (&value, entry->pspec->value_type);
+      g_object_get_property (object, entry->pspec->name, &value);
+
+      g_autoptr(GVariant) variant = property_value_to_variant (entry->kind, &value);
+
+      if (variant == NULL)
+        continue;
+
+      g_variant_take_ref (variant);
+      g_variant_builder_add (&builder, "{sv}", entry->pspec->name, variant);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Names of the properties of @object that can be changed with a
+ * double, in the order that the settings channel refers to them. */
+GStrv
+animations_dbus_list_double_property_names (GObject *object)
+{
+  PropertyCodec *codec = property_codec_for_object (object);
+  g_autoptr(GPtrArray) names = g_ptr_array_new_with_free_func (g_free);
+
+  for (unsigned int i = 0; i < codec->n_entries; ++i)
+    {
+      const PropertyCodecEntry *entry = &codec->entries[i];
+
+      if ((entry->pspec->flags & G_PARAM_WRITABLE) == 0 ||
+          (entry->pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0 ||
+          !g_variant_type_equal (entry->variant_type, G_VARIANT_TYPE_DOUBLE))
+        continue;
+
+      g_ptr_array_add (names, g_strdup (entry->pspec->name));
+    }
+
+  g_ptr_array_add (names, NULL);
 
-  return g_variant_dict_end (vardict);
+  return (GStrv) g_ptr_array_free (g_steal_pointer (&names), FALSE);
 }
 
 static void
@@ -162,6 +498,20 @@ get_range_variants_from_pspec (GParamSpec *pspec,
         *out_max_variant = g_variant_new_uint64 (pspec_ulong->maximum);
       }
       break;
+    case G_TYPE_INT64:
+      {
+        GParamSpecInt64 *pspec_int64 = G_PARAM_SPEC_INT64 (pspec);
+        *out_min_variant = g_variant_new_int64 (pspec_int64->minimum);
+        *out_max_variant = g_variant_new_int64 (pspec_int64->maximum);
+      }
+      break;
+    case G_TYPE_UINT64:
+      {
+        GParamSpecUInt64 *pspec_uint64 = G_PARAM_SPEC_UINT64 (pspec);
+        *out_min_variant = g_variant_new_uint64 (pspec_uint64->minimum);
+        *out_max_variant = g_variant_new_uint64 (pspec_uint64->maximum);
+      }
+      break;
     case G_TYPE_FLOAT:
       {
         GParamSpecFloat *pspec_float = G_PARAM_SPEC_FLOAT (pspec);
@@ -179,39 +529,40 @@ get_range_variants_from_pspec (GParamSpec *pspec,
     }
 }
 
-GVariant *
-animations_dbus_serialize_pspecs_to_variant (GObject *object)
+static GVariant *
+serialize_codec_entries_to_schema_variant (PropertyCodec *codec)
 {
-  unsigned int n_pspecs = 0;
-  GParamSpec **pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (object), &n_pspecs);
   g_auto(GVariantDict) vardict;
 
   g_variant_dict_init (&vardict, NULL);
 
-  for (unsigned int i = 0; i < n_pspecs; ++i)
+  for (unsigned int i = 0; i < codec->n_entries; ++i)
     {
-      const GVariantType *prop_variant_type = value_type_to_variant_type (pspecs[i]->value_type);
+      const PropertyCodecEntry *entry = &codec->entries[i];
       GVariantDict prop_dict;
 
       g_variant_dict_init (&prop_dict, NULL);
       g_variant_dict_insert (&prop_dict,
                              "type",
                              "s",
-                             g_variant_type_peek_string (prop_variant_type));
+                             g_variant_type_peek_string (entry->variant_type));
 
       const GValue *default_value =
-        g_param_spec_get_default_value (pspecs[i]);
-      /* Non-floating reference */
+        g_param_spec_get_default_value (entry->pspec);
       g_autoptr(GVariant) default_value_variant =
-        g_dbus_gvalue_to_gvariant (default_value, prop_variant_type);
+        property_value_to_variant (entry->kind, default_value);
 
-      g_variant_dict_insert_value (&prop_dict,
-                                   "default",
-                                   default_value_variant);
+      if (default_value_variant != NULL)
+        {
+          g_variant_take_ref (default_value_variant);
+          g_variant_dict_insert_value (&prop_dict,
+                                       "default",
+                                       default_value_variant);
+        }
 
       g_autoptr(GVariant) min_variant = NULL;
       g_autoptr(GVariant) max_variant = NULL;
-      get_range_variants_from_pspec (pspecs[i], &min_variant, &max_variant);
+      get_range_variants_from_pspec (entry->pspec, &min_variant, &max_variant);
 
       /* Need to sink the floating reference on the outparam variants
        * as they are owned by autoptr */
@@ -228,50 +579,231 @@ animations_dbus_serialize_pspecs_to_variant (GObject *object)
         }
 
       g_variant_dict_insert_value (&vardict,
-                                   pspecs[i]->name,
+                                   entry->pspec->name,
                                    g_variant_dict_end (&prop_dict));
     }
 
-  g_free (pspecs);
   return g_variant_dict_end (&vardict);
 }
 
-gboolean
-animations_dbus_validate_property_from_variant (GObject     *object,
-                                                const char  *name,
-                                                GVariant    *variant,
-                                                GError     **error)
+/**
+ * animations_dbus_serialize_pspecs_to_variant:
+ * @object: A #GObject
+ *
+ * Serialize the type, default value and range of every property of
+ * the class of @object to an a{sv}. The result is cached per #GType,
+ * so the returned #GVariant is shared and must not be modified.
+ *
+ * Returns: (transfer full): The schema for the class of @object.
+ */
+GVariant *
+animations_dbus_serialize_pspecs_to_variant (GObject *object)
+{
+  PropertyCodec *codec = NULL;
+  GVariant *schema = NULL;
+
+  G_LOCK (property_codecs);
+
+  codec = property_codec_for_class_unlocked (G_OBJECT_GET_CLASS (object));
+
+  if (codec->schema == NULL)
+    codec->schema = g_variant_ref_sink (serialize_codec_entries_to_schema_variant (codec));
+
+  schema = g_variant_ref (codec->schema);
+
+  G_UNLOCK (property_codecs);
+
+  return schema;
+}
+
+/* Integer variant types that can be converted to each numeric
+ * variant type without losing precision */
+static const struct
+{
+  char        type_char;
+  const char *widened_from;
+} numeric_widenings[] = {
+  { 'n', "y" },
+  { 'q', "y" },
+  { 'i', "ynq" },
+  { 'u', "yq" },
+  { 'x', "ynqiu" },
+  { 't', "yqu" },
+  { 'd', "ynqiuxt" }
+};
+
+/* Returns a new floating variant holding the value of the integer
+ * @variant as @variant_type, or %NULL if @variant cannot be widened
+ * to it. This keeps accepting integers for settings that older
+ * clients were allowed to send them for. */
+static GVariant *
+widen_numeric_variant (GVariant           *variant,
+                       const GVariantType *variant_type)
 {
-  GParamSpec *pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (object), name);
+  const char *type_string = g_variant_get_type_string (variant);
+  char target_char = g_variant_type_peek_string (variant_type)[0];
+  gboolean is_signed = FALSE;
+  gint64 signed_value = 0;
+  guint64 unsigned_value = 0;
+  gboolean widenable = FALSE;
 
-  if (pspec == NULL)
+  if (!g_variant_type_is_basic (variant_type) || type_string[1] != '\0')
+    return NULL;
+
+  for (unsigned int i = 0; i < G_N_ELEMENTS (numeric_widenings); ++i)
+    {
+      if (numeric_widenings[i].type_char == target_char &&
+          strchr (numeric_widenings[i].widened_from, type_string[0]) != NULL)
+        widenable = TRUE;
+    }
+
+  if (!widenable)
+    return NULL;
+
+  switch (type_string[0])
+    {
+    case 'y':
+      unsigned_value = g_variant_get_byte (variant);
+      break;
+    case 'n':
+      is_signed = TRUE;
+      signed_value = g_variant_get_int16 (variant);
+      break;
+    case 'q':
+      unsigned_value = g_variant_get_uint16 (variant);
+      break;
+    case 'i':
+      is_signed = TRUE;
+      signed_value = g_variant_get_int32 (variant);
+      break;
+    case 'u':
+      unsigned_value = g_variant_get_uint32 (variant);
+      break;
+    case 'x':
+      is_signed = TRUE;
+      signed_value = g_variant_get_int64 (variant);
+      break;
+    case 't':
+      unsigned_value = g_variant_get_uint64 (variant);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+
+  if (!is_signed)
+    signed_value = (gint64) unsigned_value;
+
+  switch (target_char)
+    {
+    case 'n':
+      return g_variant_new_int16 ((gint16) signed_value);
+    case 'q':
+      return g_variant_new_uint16 ((guint16) unsigned_value);
+    case 'i':
+      return g_variant_new_int32 ((gint32) signed_value);
+    case 'u':
+      return g_variant_new_uint32 ((guint32) unsigned_value);
+    case 'x':
+      return g_variant_new_int64 (signed_value);
+    case 't':
+      return g_variant_new_uint64 (unsigned_value);
+    case 'd':
+      return g_variant_new_double (is_signed ? (double) signed_value : (double) unsigned_value);
+    default:
+      g_assert_not_reached ();
+    }
+
+  return NULL;
+}
+
+/* Look up the codec entry for @name and convert @variant to a
+ * validated #GValue for it in @out_value. */
+static const PropertyCodecEntry *
+property_value_from_variant_for_name (GObject     *object,
+                                      const char  *name,
+                                      GVariant    *variant,
+                                      GValue      *out_value,
+                                      GError     **error)
+{
+  PropertyCodec *codec = property_codec_for_object (object);
+  const PropertyCodecEntry *entry = g_hash_table_lookup (codec->entries_by_name, name);
+  g_autoptr(GVariant) widened_variant = NULL;
+
+  if (entry == NULL)
     {
       g_set_error (error,
                    ANIMATIONS_DBUS_ERROR,
                    ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
                    "Animation does not have a setting name '%s'",
                    name);
-      return FALSE;
+      return NULL;
     }
 
-  g_auto(GValue) value = G_VALUE_INIT;
-  g_dbus_gvariant_to_gvalue (variant, &value);
+  if ((entry->pspec->flags & G_PARAM_WRITABLE) == 0 ||
+      (entry->pspec->flags & G_PARAM_CONSTRUCT_ONLY) != 0)
+    {
+      g_set_error (error,
+                   ANIMATIONS_DBUS_ERROR,
+                   ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
+                   "Setting '%s' cannot be changed",
+                   name);
+      return NULL;
+    }
+
+  if (entry->kind != PROPERTY_KIND_VARIANT &&
+      !g_variant_is_of_type (variant, entry->variant_type))
+    widened_variant = widen_numeric_variant (variant, entry->variant_type);
+
+  if (widened_variant != NULL)
+    variant = g_variant_ref_sink (widened_variant);
+  else if (entry->kind != PROPERTY_KIND_VARIANT &&
+           !g_variant_is_of_type (variant, entry->variant_type))
+    {
+      g_set_error (error,
+                   ANIMATIONS_DBUS_ERROR,
+                   ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
+                   "Expected value of type '%s' for setting '%s', but got '%s'",
+                   g_variant_type_peek_string (entry->variant_type),
+                   name,
+                   g_variant_get_type_string (variant));
+      return NULL;
+    }
+
+  g_value_init (out_value, entry->pspec->value_type);
+
+  if (!property_value_from_variant (entry->kind, variant, out_value, error))
+    return NULL;
 
   /* Return value is whether modifying the value
    * was necessary to ensure compliance with the
    * constraints, we want to return an error in
    * that case. */
-  if (g_param_value_validate (pspec, &value))
+  if (g_param_value_validate (entry->pspec, out_value))
     {
       g_set_error (error,
                    ANIMATIONS_DBUS_ERROR,
                    ANIMATIONS_DBUS_ERROR_INVALID_SETTING,
                    "Invalid value for setting '%s'",
                    name);
-      return FALSE;
+      return NULL;
     }
 
-  return TRUE;
+  return entry;
+}
+
+gboolean
+animations_dbus_validate_property_from_variant (GObject     *object,
+                                                const char  *name,
+                                                GVariant    *variant,
+                                                GError     **error)
+{
+  g_auto(GValue) value = G_VALUE_INIT;
+
+  return property_value_from_variant_for_name (object,
+                                               name,
+                                               variant,
+                                               &value,
+                                               error) != NULL;
 }
 
 gboolean
@@ -280,52 +812,226 @@ animations_dbus_set_property_from_variant (GObject     *object,
                                            GVariant    *variant,
                                            GError     **error)
 {
-  if (!animations_dbus_validate_property_from_variant (object,
-                                                       name,
-                                                       variant,
-                                                       error))
+  g_auto(GValue) value = G_VALUE_INIT;
+  const PropertyCodecEntry *entry = property_value_from_variant_for_name (object,
+                                                                          name,
+                                                                          variant,
+                                                                          &value,
+                                                                          error);
+
+  if (entry == NULL)
     return FALSE;
 
-  g_auto(GValue) value = G_VALUE_INIT;
-  g_dbus_gvariant_to_gvalue (variant, &value);
+  g_object_set_property (object, entry->pspec->name, &value);
+  return TRUE;
+}
+
+/* A converted value waiting to be set by
+ * animations_dbus_set_properties_from_variant */
+typedef struct
+{
+  const PropertyCodecEntry *entry;  /* (unowned) */
+  GValue                    value;
+} PendingPropertyValue;
+
+static void
+pending_property_value_clear (PendingPropertyValue *pending)
+{
+  /* The value is not initialized if the conversion failed early */
+  if (G_IS_VALUE (&pending->value))
+    g_value_unset (&pending->value);
+}
+
+/* Sets all the properties in the a{sv} dictionary @properties on @object,
+ * or none of them if any of the values cannot be converted or is not
+ * valid for its property. Notifications are emitted once all the
+ * properties have been set. */
+gboolean
+animations_dbus_set_properties_from_variant (GObject     *object,
+                                             GVariant    *properties,
+                                             GError     **error)
+{
+  g_autoptr(GArray) pending_values = g_array_sized_new (FALSE,
+                                                        TRUE,
+                                                        sizeof (PendingPropertyValue),
+                                                        g_variant_n_children (properties));
+  GVariantIter iter;
+  const char *name;
+  GVariant *variant;
+
+  g_array_set_clear_func (pending_values, (GDestroyNotify) pending_property_value_clear);
+
+  g_variant_iter_init (&iter, properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, &variant))
+    {
+      g_autoptr(GVariant) owned_variant = variant;
+      PendingPropertyValue *pending = NULL;
+
+      g_array_set_size (pending_values, pending_values->len + 1);
+      pending = &g_array_index (pending_values, PendingPropertyValue, pending_values->len - 1);
+      pending->entry = property_value_from_variant_for_name (object,
+                                                             name,
+                                                             owned_variant,
+                                                             &pending->value,
+                                                             error);
+
+      if (pending->entry == NULL)
+        return FALSE;
+    }
+
+  g_object_freeze_notify (object);
+
+  for (unsigned int i = 0; i < pending_values->len; ++i)
+    {
+      PendingPropertyValue *pending = &g_array_index (pending_values, PendingPropertyValue, i);
+
+      g_object_set_property (object, pending->entry->pspec->name, &pending->value);
+    }
+
+  g_object_thaw_notify (object);
 
-  g_object_set_property (object, name, &value);
   return TRUE;
 }
 
-/* XXX: Borrowing this struct from GDBus-Codegen is not ideal,
- *      but it does not appear that there is a method
- *      to get a D-Bus property name for a hyphenated name. */
+/* The entries for the D-Bus properties of a skeleton class, in the
+ * order of its generated property table. Like the property codecs,
+ * they are resolved once per GType so that emitting PropertiesChanged
+ * never has to look a property up by name, and hold a reference on
+ * the class so that they are never freed or replaced. The first
+ * entries resolved for a table are also kept in the cache of the
+ * table, so that the common case of a single skeleton class per
+ * interface needs neither the lock nor the lookup by GType. */
 typedef struct
 {
-  GDBusPropertyInfo parent_struct;
-  const gchar *hyphen_name;
-  gboolean use_gvariant;
-} ExtendedGDBusPropertyInfo;
+  GObjectClass                      *object_class;  /* (owned) */
+  const AnimationsDbusPropertyTable *table;         /* (unowned) */
+  PropertyCodecEntry                *entries;       /* indexed like table->properties */
+} SkeletonPropertyEntries;
 
-static const char *
-lookup_dbus_prop_name_on_interface (GDBusInterfaceInfo *info,
-                                    const char         *name)
+static SkeletonPropertyEntries *
+skeleton_property_entries_new (GType                              type,
+                               const AnimationsDbusPropertyTable *table)
 {
-  GDBusPropertyInfo **properties = info->properties;
+  SkeletonPropertyEntries *skeleton_entries = g_new0 (SkeletonPropertyEntries, 1);
+  GObjectClass *object_class = g_type_class_ref (type);
+
+  skeleton_entries->object_class = object_class;
+  skeleton_entries->table = table;
+  skeleton_entries->entries = g_new0 (PropertyCodecEntry, table->n_properties);
 
-  for (GDBusPropertyInfo **property_info_iter = properties;
-       *property_info_iter != NULL;
-       ++property_info_iter)
+  for (unsigned int i = 0; i < table->n_properties; ++i)
     {
-      ExtendedGDBusPropertyInfo *extended_info = (ExtendedGDBusPropertyInfo *) *property_info_iter;
+      PropertyCodecEntry *entry = &skeleton_entries->entries[i];
+      GParamSpec *pspec = g_object_class_find_property (object_class,
+                                                        table->properties[i].hyphen_name);
+      const GVariantType *value_variant_type = NULL;
+      gboolean convertible = FALSE;
+
+      g_assert (pspec != NULL);
 
-      if (g_strcmp0 (name, extended_info->hyphen_name) == 0)
-        return (*property_info_iter)->name;
+      convertible = property_kind_for_value_type (pspec->value_type,
+                                                  &entry->kind,
+                                                  &value_variant_type);
+      g_assert (convertible);
+
+      entry->pspec = pspec;
+      entry->variant_type = G_VARIANT_TYPE (table->properties[i].signature);
     }
 
-  g_assert_not_reached ();
-  return NULL;
+  return skeleton_entries;
+}
+
+G_LOCK_DEFINE_STATIC (skeleton_property_entries);
+G_DEFINE_QUARK (animations-dbus-skeleton-property-entries, skeleton_property_entries)
+
+static SkeletonPropertyEntries *
+skeleton_property_entries_for_object (GObject                           *object,
+                                      const AnimationsDbusPropertyTable *table)
+{
+  GObjectClass *object_class = G_OBJECT_GET_CLASS (object);
+  GType type = G_OBJECT_CLASS_TYPE (object_class);
+  SkeletonPropertyEntries *skeleton_entries = g_atomic_pointer_get (table->cache);
+
+  /* The class of cached entries cannot be unloaded, so no other
+   * class can end up at the same address. */
+  if (skeleton_entries != NULL &&
+      skeleton_entries->object_class == object_class)
+    return skeleton_entries;
+
+  G_LOCK (skeleton_property_entries);
+
+  skeleton_entries = g_type_get_qdata (type, skeleton_property_entries_quark ());
+
+  if (skeleton_entries == NULL)
+    {
+      skeleton_entries = skeleton_property_entries_new (type, table);
+      g_type_set_qdata (type, skeleton_property_entries_quark (), skeleton_entries);
+    }
+
+  g_atomic_pointer_compare_and_exchange (table->cache, NULL, skeleton_entries);
+
+  G_UNLOCK (skeleton_property_entries);
+
+  g_assert (skeleton_entries->table == table);
+
+  return skeleton_entries;
+}
+
+/* Where the PropertiesChanged signals of a skeleton that is dispatched
+ * from a registered subtree go, since it is not exported itself. */
+typedef struct
+{
+  char      *object_path;  /* (owned) */
+  GPtrArray *connections;  /* (owned) (element-type: GDBusConnection) */
+} SkeletonDispatchTarget;
+
+G_DEFINE_QUARK (animations-dbus-skeleton-dispatch-target, skeleton_dispatch_target)
+
+static void
+skeleton_dispatch_target_free (SkeletonDispatchTarget *target)
+{
+  g_clear_pointer (&target->object_path, g_free);
+  g_clear_pointer (&target->connections, g_ptr_array_unref);
+
+  g_free (target);
 }
 
 void
-animations_dbus_emit_properties_changed_for_skeleton_properties (GDBusInterfaceSkeleton *skeleton,
-                                                                 const char * const     *props)
+animations_dbus_set_skeleton_dispatch_target (GDBusInterfaceSkeleton *skeleton,
+                                              const char             *object_path,
+                                              GPtrArray              *connections)
+{
+  SkeletonDispatchTarget *target = NULL;
+
+  if (object_path != NULL)
+    {
+      target = g_new0 (SkeletonDispatchTarget, 1);
+      target->object_path = g_strdup (object_path);
+      target->connections = g_ptr_array_ref (connections);
+    }
+
+  g_object_set_qdata_full (G_OBJECT (skeleton),
+                           skeleton_dispatch_target_quark (),
+                           target,
+                           (GDestroyNotify) skeleton_dispatch_target_free);
+}
+
+const char *
+animations_dbus_get_skeleton_object_path (GDBusInterfaceSkeleton *skeleton)
+{
+  SkeletonDispatchTarget *target = g_object_get_qdata (G_OBJECT (skeleton),
+                                                       skeleton_dispatch_target_quark ());
+
+  if (target != NULL)
+    return target->object_path;
+
+  return g_dbus_interface_skeleton_get_object_path (skeleton);
+}
+
+static void
+emit_properties_changed_now (GDBusInterfaceSkeleton            *skeleton,
+                             const AnimationsDbusPropertyTable *table,
+                             guint32                            changed_properties)
 {
   g_auto(GVariantBuilder) changed_builder;
   g_auto(GVariantBuilder) invalidated_builder;
@@ -334,37 +1040,52 @@ animations_dbus_emit_properties_changed_for_skeleton_properties (GDBusInterfaceS
   g_variant_builder_init (&invalidated_builder, G_VARIANT_TYPE("as"));
 
   /* No work to do, return early */
-  if (*props == NULL)
+  if (changed_properties == 0)
     return;
 
-  GObjectClass *object_class = G_OBJECT_GET_CLASS (G_OBJECT (skeleton));
-  GDBusInterfaceInfo *interface_info = g_dbus_interface_skeleton_get_info (skeleton);
+  SkeletonPropertyEntries *skeleton_entries =
+    skeleton_property_entries_for_object (G_OBJECT (skeleton), table);
 
-  for (const char * const *props_iter = props; *props_iter != NULL; ++props_iter)
+  for (unsigned int i = 0; i < table->n_properties; ++i)
     {
-      GParamSpec *pspec = g_object_class_find_property (object_class, *props_iter);
-
-      g_assert (pspec != NULL);
+      const PropertyCodecEntry *entry = &skeleton_entries->entries[i];
       g_auto(GValue) value = G_VALUE_INIT;
 
-      g_value_init (&value, pspec->value_type);
-      g_object_get_property (G_OBJECT (skeleton), *props_iter, &value);
+      if ((changed_properties & ANIMATIONS_DBUS_PROPERTY_BIT (i)) == 0)
+        continue;
+
+      g_value_init (&value, entry->pspec->value_type);
+      g_object_get_property (G_OBJECT (skeleton), entry->pspec->name, &value);
 
       /* Non-floating reference */
-      g_autoptr(GVariant) variant =
-        g_dbus_gvalue_to_gvariant (&value, value_type_to_variant_type (pspec->value_type));
+      g_autoptr(GVariant) variant = g_dbus_gvalue_to_gvariant (&value, entry->variant_type);
       g_variant_builder_add (&changed_builder,
                              "{sv}",
-                             lookup_dbus_prop_name_on_interface (interface_info,
-                                                                 *props_iter),
+                             table->properties[i].dbus_name,
                              variant);
     }
 
   g_autoptr(GVariant) properties_changed_variant =
     g_variant_ref_sink (g_variant_new ("(sa{sv}as)",
-                                       interface_info->name,
+                                       table->interface_name,
                                        &changed_builder,
                                        &invalidated_builder));
+  SkeletonDispatchTarget *target = g_object_get_qdata (G_OBJECT (skeleton),
+                                                       skeleton_dispatch_target_quark ());
+
+  if (target != NULL)
+    {
+      for (unsigned int i = 0; i < target->connections->len; ++i)
+        g_dbus_connection_emit_signal (g_ptr_array_index (target->connections, i),
+                                       NULL,
+                                       target->object_path,
+                                       "org.freedesktop.DBus.Properties",
+                                       "PropertiesChanged",
+                                       properties_changed_variant,
+                                       NULL);
+      return;
+    }
+
   g_autoptr(GList) connections = g_dbus_interface_skeleton_get_connections (skeleton);
 
   for (GList *l = connections; l != NULL; l = l->next)
@@ -381,3 +1102,195 @@ animations_dbus_emit_properties_changed_for_skeleton_properties (GDBusInterfaceS
     }
 }
 
+/* PropertiesChanged signals are coalesced: changed properties are
+ * only recorded against their skeleton, and the values are serialized
+ * and sent in a single signal per skeleton when the queue is flushed.
+ * That happens on the next iteration of the main context that the
+ * queue was created for, or when its owner calls
+ * animations_dbus_properties_changed_queue_flush() (through
+ * animations_dbus_server_flush()), whichever comes first. Method
+ * handlers flush the changes of their own skeleton before replying
+ * with animations_dbus_properties_changed_queue_flush_skeleton(). */
+typedef struct
+{
+  GDBusInterfaceSkeleton            *skeleton;            /* (owned) */
+  const AnimationsDbusPropertyTable *table;               /* (unowned) */
+  guint32                            changed_properties;
+} PendingPropertiesChanged;
+
+static void
+pending_properties_changed_free (PendingPropertiesChanged *pending)
+{
+  g_clear_object (&pending->skeleton);
+
+  g_free (pending);
+}
+
+struct _AnimationsDbusPropertiesChangedQueue
+{
+  GMainContext *context;  /* (owned) */
+  GHashTable   *pending;  /* (key-type: GDBusInterfaceSkeleton) (value-type: PendingPropertiesChanged) */
+  GSource      *source;
+};
+
+AnimationsDbusPropertiesChangedQueue *
+animations_dbus_properties_changed_queue_new (GMainContext *context)
+{
+  AnimationsDbusPropertiesChangedQueue *queue = g_new0 (AnimationsDbusPropertiesChangedQueue, 1);
+
+  queue->context = g_main_context_ref (context);
+  queue->pending = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) pending_properties_changed_free);
+
+  return queue;
+}
+
+/* Pending changes are dropped, not sent. */
+void
+animations_dbus_properties_changed_queue_free (AnimationsDbusPropertiesChangedQueue *queue)
+{
+  if (queue->source != NULL)
+    {
+      g_source_destroy (queue->source);
+      g_clear_pointer (&queue->source, g_source_unref);
+    }
+
+  g_clear_pointer (&queue->pending, g_hash_table_unref);
+  g_clear_pointer (&queue->context, g_main_context_unref);
+
+  g_free (queue);
+}
+
+static gboolean
+on_flush_pending_properties_changed (gpointer user_data)
+{
+  AnimationsDbusPropertiesChangedQueue *queue = user_data;
+
+  animations_dbus_properties_changed_queue_flush (queue);
+  return G_SOURCE_REMOVE;
+}
+
+void
+animations_dbus_emit_properties_changed_for_skeleton_properties (AnimationsDbusPropertiesChangedQueue *queue,
+                                                                 GDBusInterfaceSkeleton               *skeleton,
+                                                                 const AnimationsDbusPropertyTable    *table,
+                                                                 guint32                               changed_properties)
+{
+  PendingPropertiesChanged *pending = NULL;
+
+  /* No work to do, return early */
+  if (changed_properties == 0)
+    return;
+
+  /* Nobody can be listening to a skeleton that is not exported or
+   * dispatched anywhere, so there is nothing to queue. */
+  if (animations_dbus_get_skeleton_object_path (skeleton) == NULL)
+    return;
+
+  if (queue == NULL)
+    {
+      emit_properties_changed_now (skeleton, table, changed_properties);
+      return;
+    }
+
+  pending = g_hash_table_lookup (queue->pending, skeleton);
+
+  if (pending == NULL)
+    {
+      pending = g_new0 (PendingPropertiesChanged, 1);
+      pending->skeleton = g_object_ref (skeleton);
+      pending->table = table;
+
+      g_hash_table_insert (queue->pending, skeleton, pending);
+    }
+
+  g_assert (pending->table == table);
+  pending->changed_properties |= changed_properties;
+
+  if (queue->source == NULL)
+    {
+      queue->source = g_idle_source_new ();
+      g_source_set_priority (queue->source, G_PRIORITY_DEFAULT);
+      g_source_set_callback (queue->source,
+                             on_flush_pending_properties_changed,
+                             queue,
+                             NULL);
+      g_source_attach (queue->source, queue->context);
+    }
+}
+
+/**
+ * animations_dbus_properties_changed_queue_flush:
+ * @queue: An #AnimationsDbusPropertiesChangedQueue
+ *
+ * Serialize the current values of all properties that were marked as
+ * changed in @queue with animations_dbus_emit_properties_changed_for_skeleton_properties()
+ * and send one PropertiesChanged signal for each skeleton that has changes.
+ */
+void
+animations_dbus_properties_changed_queue_flush (AnimationsDbusPropertiesChangedQueue *queue)
+{
+  g_autoptr(GHashTable) pending = NULL;
+  gpointer value;
+  GHashTableIter iter;
+
+  if (queue->source != NULL)
+    {
+      g_source_destroy (queue->source);
+      g_clear_pointer (&queue->source, g_source_unref);
+    }
+
+  if (g_hash_table_size (queue->pending) == 0)
+    return;
+
+  /* Emitting can queue up more changes, which are sent on the next flush */
+  pending = g_steal_pointer (&queue->pending);
+  queue->pending = g_hash_table_new_full (g_direct_hash,
+                                          g_direct_equal,
+                                          NULL,
+                                          (GDestroyNotify) pending_properties_changed_free);
+
+  g_hash_table_iter_init (&iter, pending);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      PendingPropertiesChanged *pending_for_skeleton = value;
+
+      emit_properties_changed_now (pending_for_skeleton->skeleton,
+                                   pending_for_skeleton->table,
+                                   pending_for_skeleton->changed_properties);
+    }
+}
+
+/**
+ * animations_dbus_properties_changed_queue_flush_skeleton:
+ * @queue: (nullable): An #AnimationsDbusPropertiesChangedQueue
+ * @skeleton: A #GDBusInterfaceSkeleton
+ *
+ * Send the PropertiesChanged signal queued up for @skeleton in @queue
+ * straight away, if there is one. Method handlers call this before
+ * returning their reply, so that a client sees the properties that
+ * its call changed by the time the call completes.
+ */
+void
+animations_dbus_properties_changed_queue_flush_skeleton (AnimationsDbusPropertiesChangedQueue *queue,
+                                                         GDBusInterfaceSkeleton               *skeleton)
+{
+  PendingPropertiesChanged *pending = NULL;
+
+  if (queue == NULL)
+    return;
+
+  pending = g_hash_table_lookup (queue->pending, skeleton);
+
+  if (pending == NULL)
+    return;
+
+  g_hash_table_steal (queue->pending, skeleton);
+
+  emit_properties_changed_now (pending->skeleton,
+                               pending->table,
+                               pending->changed_properties);
+  pending_properties_changed_free (pending);
+}
@@ -24,10 +24,45 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "animations-dbus-property-tables.h"
+
 G_BEGIN_DECLS
 
-void animations_dbus_emit_properties_changed_for_skeleton_properties (GDBusInterfaceSkeleton *skeleton,
-                                                                      const char * const     *properties);
+#define ANIMATIONS_DBUS_PROPERTY_BIT(index) (1u << (index))
+
+/* Changes queued up for PropertiesChanged signals, which are sent from
+ * an idle source on the main context that the queue was created for. */
+typedef struct _AnimationsDbusPropertiesChangedQueue AnimationsDbusPropertiesChangedQueue;
+
+AnimationsDbusPropertiesChangedQueue * animations_dbus_properties_changed_queue_new (GMainContext *context);
+
+void animations_dbus_properties_changed_queue_free (AnimationsDbusPropertiesChangedQueue *queue);
+
+void animations_dbus_properties_changed_queue_flush (AnimationsDbusPropertiesChangedQueue *queue);
+
+void animations_dbus_properties_changed_queue_flush_skeleton (AnimationsDbusPropertiesChangedQueue *queue,
+                                                              GDBusInterfaceSkeleton               *skeleton);
+
+/* Queues a PropertiesChanged signal on @skeleton for the properties
+ * of @table whose bits are set in @changed_properties, merged with
+ * any other changes queued for @skeleton in @queue until it is next
+ * flushed. If @queue is %NULL, the signal is sent straight away. */
+void animations_dbus_emit_properties_changed_for_skeleton_properties (AnimationsDbusPropertiesChangedQueue *queue,
+                                                                      GDBusInterfaceSkeleton               *skeleton,
+                                                                      const AnimationsDbusPropertyTable    *table,
+                                                                      guint32                               changed_properties);
+
+/* A skeleton that is dispatched from a subtree registered with
+ * g_dbus_connection_register_subtree() is not exported itself, so it
+ * has no object path or connections of its own. This sets the object
+ * path that it is dispatched at and the connections that its
+ * PropertiesChanged signals are sent on, or unsets them if
+ * @object_path is %NULL. */
+void animations_dbus_set_skeleton_dispatch_target (GDBusInterfaceSkeleton *skeleton,
+                                                   const char             *object_path,
+                                                   GPtrArray              *connections);
+
+const char * animations_dbus_get_skeleton_object_path (GDBusInterfaceSkeleton *skeleton);
 
 gboolean
 animations_dbus_set_property_from_variant (GObject     *object,
@@ -35,6 +70,11 @@ animations_dbus_set_property_from_variant (GObject     *object,
                                            GVariant    *variant,
                                            GError     **error);
 
+gboolean
+animations_dbus_set_properties_from_variant (GObject     *object,
+                                             GVariant    *properties,
+                                             GError     **error);
+
 gboolean
 animations_dbus_validate_property_from_variant (GObject     *object,
                                                 const char  *name,
@@ -44,6 +84,9 @@ animations_dbus_validate_property_from_variant (GObject     *object,
 GVariant *
 animations_dbus_serialize_properties_to_variant (GObject *object);
 
+GStrv
+animations_dbus_list_double_property_names (GObject *object);
+
 GVariant *
 animations_dbus_serialize_pspecs_to_variant (GObject *object);
 
@@ -24,6 +24,7 @@
 #include "animations-dbus-objects.h"
 #include "animations-dbus-server-effect.h"
 #include "animations-dbus-server-object.h"
+#include "animations-dbus-server-private.h"
 #include "animations-dbus-server-skeleton-properties.h"
 #include "animations-dbus-server-surface.h"
 #include "animations-dbus-server-surface-attached-effect-interface.h"
@@ -34,13 +35,43 @@ struct _AnimationsDbusServerSurface
   AnimationsDbusAnimatableSurfaceSkeleton parent_instance;
 };
 
+/* Properties of the surface whose serialized values are cached */
+typedef enum
+{
+  SURFACE_CACHED_PROPERTY_TITLE    = 1 << 0,
+  SURFACE_CACHED_PROPERTY_GEOMETRY = 1 << 1,
+  SURFACE_CACHED_PROPERTY_EFFECTS  = 1 << 2,
+  SURFACE_CACHED_PROPERTY_ALL      = SURFACE_CACHED_PROPERTY_TITLE |
+                                     SURFACE_CACHED_PROPERTY_GEOMETRY |
+                                     SURFACE_CACHED_PROPERTY_EFFECTS
+} SurfaceCachedProperty;
+
 typedef struct _AnimationsDbusServerSurfacePrivate
 {
   GDBusConnection                   *connection;
   AnimationsDbusServer              *server;
   AnimationsDbusServerSurfaceBridge *bridge;
-
-  GHashTable *attached_effects_for_events;  /* (key-type: utf8) (value-type: GQueue) */
+  unsigned int                       id;
+
+  /* Indexed by event id, see animations_dbus_server_surface_event_id_from_string().
+   * Entries are %NULL for events that nothing was ever attached to. */
+  GPtrArray *attached_effects_for_events;  /* (element-type: GQueue) */
+
+  /* The values of the Title, Geometry and Effects properties are
+   * cached, so that Get, GetAll and PropertiesChanged do not need to
+   * query the bridge or serialize the attached effects each time.
+   * A cached value is refreshed on the next read once its bit is set
+   * in dirty_properties. */
+  char                  *cached_title;
+  GVariant              *cached_geometry;
+  GVariant              *cached_effects;
+  SurfaceCachedProperty  dirty_properties;
+
+  /* Geometry change notifications are rate limited. The first change
+   * is sent straight away and starts geometry_notify_source. Changes
+   * made while it is running are only sent when it fires. */
+  GSource               *geometry_notify_source;
+  gboolean               geometry_notify_pending;
 } AnimationsDbusServerSurfacePrivate;
 
 static void animations_dbus_animatable_surface_interface_init (AnimationsDbusAnimatableSurfaceIface *iface);
@@ -57,6 +88,7 @@ enum {
   PROP_CONNECTION,
   PROP_SERVER,
   PROP_BRIDGE,
+  PROP_ID,
   PROP_TITLE,
   PROP_GEOMETRY,
   PROP_EFFECTS
@@ -66,118 +98,238 @@ enum {
 
 static GParamSpec *animations_dbus_server_surface_props[N_OWN_PROPS];
 
-typedef struct {
+/* Event names are interned into a process-wide registry of small,
+ * dense ids. This lets each surface index its attached effects by
+ * event id, so that looking up the effect for an event on the
+ * compositor's hot path does not need to hash the event name.
+ * Id 0 is never allocated and means "no such event". */
+G_LOCK_DEFINE_STATIC (event_ids);
+static GHashTable *event_ids_for_names = NULL;  /* (key-type: utf8) (value-type: guint) */
+static GPtrArray *event_names_for_ids = NULL;   /* (element-type: utf8) */
+
+static unsigned int
+lookup_event_id (const char *event)
+{
+  unsigned int event_id = 0;
+
+  G_LOCK (event_ids);
+  if (event_ids_for_names != NULL)
+    event_id = GPOINTER_TO_UINT (g_hash_table_lookup (event_ids_for_names, event));
+  G_UNLOCK (event_ids);
+
+  return event_id;
+}
+
+/**
+ * animations_dbus_server_surface_event_id_from_string:
+ * @event: An event name, for instance "move".
+ *
+ * Get the id for @event, allocating a new one if this is the first
+ * time @event has been seen. Ids are shared by all surfaces and stay
+ * valid for the lifetime of the process, so they can be looked up
+ * once and then passed to
+ * animations_dbus_server_surface_highest_priority_attached_effect_for_event_id().
+ *
+ * Returns: A non-zero id for @event.
+ */
+unsigned int
+animations_dbus_server_surface_event_id_from_string (const char *event)
+{
+  unsigned int event_id = 0;
+
+  g_return_val_if_fail (event != NULL, 0);
+
+  G_LOCK (event_ids);
+
+  if (event_ids_for_names == NULL)
+    {
+      event_ids_for_names = g_hash_table_new (g_str_hash, g_str_equal);
+      event_names_for_ids = g_ptr_array_new ();
+
+      /* Reserve id 0 */
+      g_ptr_array_add (event_names_for_ids, NULL);
+    }
+
+  event_id = GPOINTER_TO_UINT (g_hash_table_lookup (event_ids_for_names, event));
+
+  if (event_id == 0)
+    {
+      const char *interned_event = g_intern_string (event);
+
+      event_id = event_names_for_ids->len;
+      g_ptr_array_add (event_names_for_ids, (gpointer) interned_event);
+      g_hash_table_insert (event_ids_for_names,
+                           (gpointer) interned_event,
+                           GUINT_TO_POINTER (event_id));
+    }
+
+  G_UNLOCK (event_ids);
+
+  return event_id;
+}
+
+/**
+ * animations_dbus_server_surface_event_id_to_string:
+ * @event_id: An id returned by animations_dbus_server_surface_event_id_from_string().
+ *
+ * Get the event name that @event_id was allocated for.
+ *
+ * Returns: (transfer none) (nullable): The interned event name for @event_id,
+ *          or %NULL if no such id was allocated.
+ */
+const char *
+animations_dbus_server_surface_event_id_to_string (unsigned int event_id)
+{
+  const char *event = NULL;
+
+  G_LOCK (event_ids);
+  if (event_names_for_ids != NULL && event_id < event_names_for_ids->len)
+    event = g_ptr_array_index (event_names_for_ids, event_id);
+  G_UNLOCK (event_ids);
+
+  return event;
+}
+
+static void
+queue_state_snapshot_update (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->server != NULL)
+    animations_dbus_server_queue_state_snapshot_update (priv->server, priv->id);
+}
+
+static AnimationsDbusPropertiesChangedQueue *
+properties_changed_queue_for_surface (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->server == NULL)
+    return NULL;
+
+  return animations_dbus_server_get_properties_changed_queue (priv->server);
+}
+
+static GQueue *
+attached_effects_for_event_id (AnimationsDbusServerSurfacePrivate *priv,
+                               unsigned int                        event_id)
+{
+  if (event_id >= priv->attached_effects_for_events->len)
+    return NULL;
+
+  return g_ptr_array_index (priv->attached_effects_for_events, event_id);
+}
+
+struct _AnimationsDbusServerSurfaceAttachment {
+  AnimationsDbusServerSurface               *server_surface;   /* (unowned) */
+  const char                                *event;            /* (unowned) */
+  GQueue                                    *event_queue;      /* (unowned) */
+  GList                                      event_link;
+  GList                                      effect_link;
+
   AnimationsDbusServerEffect                *server_effect;
   AnimationsDbusServerSurfaceAttachedEffect *attached_effect;
-} AttachedEffectInfo;
+};
 
-AttachedEffectInfo *
-attached_effect_info_new (AnimationsDbusServerEffect                *server_effect,
+typedef AnimationsDbusServerSurfaceAttachment AttachedEffectInfo;
+
+static AttachedEffectInfo *
+attached_effect_info_new (AnimationsDbusServerSurface               *server_surface,
+                          const char                                *event,
+                          GQueue                                    *event_queue,
+                          AnimationsDbusServerEffect                *server_effect,
                           AnimationsDbusServerSurfaceAttachedEffect *attached_effect)
 {
   AttachedEffectInfo *info = g_new0 (AttachedEffectInfo, 1);
 
+  info->server_surface = server_surface;
+  info->event = event;
+  info->event_queue = event_queue;
+  info->event_link.data = info;
+  info->effect_link.data = info;
   info->server_effect = g_object_ref (server_effect);
   info->attached_effect = g_object_ref (attached_effect);
 
+  animations_dbus_server_effect_track_attachment (server_effect, &info->effect_link);
+
   return info;
 }
 
-void
+static void
 attached_effect_info_free (AttachedEffectInfo *info)
 {
+  animations_dbus_server_effect_untrack_attachment (info->server_effect, &info->effect_link);
+
   g_clear_object (&info->server_effect);
   g_clear_object (&info->attached_effect);
 
   g_free (info);
 }
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (AttachedEffectInfo, attached_effect_info_free)
-
-static void
-animations_dbus_server_surface_detach_animation_effect_from_all_events (AnimationsDbusServerSurface *server_surface,
-                                                                        AnimationsDbusServerEffect  *server_animation_effect)
+/**
+ * animations_dbus_server_surface_remove_attachment: (skip)
+ * @attachment: An #AnimationsDbusServerSurfaceAttachment
+ *
+ * Detach the effect in @attachment from its event on its surface,
+ * notifying the bridge and emitting a change to the Effects property,
+ * then free @attachment. This is O(1) in the number of attached effects.
+ */
+void
+animations_dbus_server_surface_remove_attachment (AnimationsDbusServerSurfaceAttachment *attachment)
 {
+  AnimationsDbusServerSurface *server_surface = attachment->server_surface;
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
-  gpointer key, value;
-  GHashTableIter iter;
-
-  g_hash_table_iter_init (&iter, priv->attached_effects_for_events);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      const char *event = key;
-      GQueue *effects = value;
-      GList *link = g_queue_peek_head_link (effects);
 
-      for (; link != NULL; link = link->next)
-        {
-          AttachedEffectInfo *info = link->data;
+  animations_dbus_server_surface_bridge_detach_effect (priv->bridge,
+                                                       attachment->event,
+                                                       attachment->attached_effect);
+  g_queue_unlink (attachment->event_queue, &attachment->event_link);
+  attached_effect_info_free (attachment);
 
-          if (info->server_effect == server_animation_effect)
-            {
-              animations_dbus_server_surface_bridge_detach_effect (priv->bridge,
-                                                                   event,
-                                                                   info->attached_effect);
-
-              /* Notify listeners that we've dettached the effect from this
-               * event and that the effects property has changed now. */
-              const char *props[] = { "effects", NULL };
-              animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (server_surface),
-                                                                               props);
-
-              g_queue_delete_link (effects, link);
-              attached_effect_info_free (info);
-              break;
-            }
-        }
-    }
-}
+  priv->dirty_properties |= SURFACE_CACHED_PROPERTY_EFFECTS;
+  queue_state_snapshot_update (server_surface);
 
-static void
-on_server_animation_effect_destroyed (AnimationsDbusServerEffect *server_animation_effect,
-                                      gpointer                    user_data)
-{
-  AnimationsDbusServerSurface *server_surface = user_data;
-
-  animations_dbus_server_surface_detach_animation_effect_from_all_events (server_surface,
-                                                                          server_animation_effect);
+  /* Notify listeners that we've dettached the effect from this
+   * event and that the effects property has changed now. */
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_surface (server_surface),
+                                                                   G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                                   &animations_dbus_animatable_surface_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_EFFECTS));
 }
 
-typedef void (*QueuePushFunc) (GQueue *, gpointer);
+typedef void (*QueuePushLinkFunc) (GQueue *, GList *);
 
 static gboolean
 animations_dbus_server_surface_attach_effect_with_queue_func (AnimationsDbusServerSurface  *server_surface,
                                                               const char                   *event,
                                                               AnimationsDbusServerEffect   *server_animation_effect,
-                                                              QueuePushFunc                 push_func,
+                                                              QueuePushLinkFunc             push_link_func,
                                                               GError                      **error)
 {
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+  /* The event name comes from the client, so it is only looked up
+   * here. It is only interned once the bridge accepted it below, so
+   * that clients cannot grow the event registry or the per-surface
+   * index with names that no bridge supports. */
+  unsigned int event_id = lookup_event_id (event);
+  GQueue *attached_effects_for_event = attached_effects_for_event_id (priv, event_id);
 
-  g_assert (push_func != NULL);
+  g_assert (push_link_func != NULL);
 
   /* Look for the event in the queue first to ensure that we don't
    * try and attach the same effect twice. O(N) for the number of
    * attached effects but N should be quite small. */
-  GQueue *attached_effects_for_event = g_hash_table_lookup (priv->attached_effects_for_events, event);
-
-  if (attached_effects_for_event == NULL)
+  if (attached_effects_for_event != NULL)
     {
-      attached_effects_for_event = g_queue_new ();
-
-      g_hash_table_insert (priv->attached_effects_for_events,
-                           g_strdup (event),
-                           attached_effects_for_event);
-    }
-
-  for (GList *link = g_queue_peek_head_link (attached_effects_for_event);
-       link != NULL;
-       link = link->next)
-    {
-      AttachedEffectInfo *info = link->data;
+      for (GList *link = g_queue_peek_head_link (attached_effects_for_event);
+           link != NULL;
+           link = link->next)
+        {
+          AttachedEffectInfo *info = link->data;
 
-      if (info->server_effect == server_animation_effect)
-        return TRUE;
+          if (info->server_effect == server_animation_effect)
+            return TRUE;
+        }
     }
 
   /* Now create an AttachedEffect struct, which represents our attempt
@@ -193,23 +345,36 @@ animations_dbus_server_surface_attach_effect_with_queue_func (AnimationsDbusServ
   if (attached_effect == NULL)
     return FALSE;
 
-  push_func (attached_effects_for_event,
-             attached_effect_info_new (server_animation_effect,
-                                       attached_effect));
+  if (attached_effects_for_event == NULL)
+    {
+      event_id = animations_dbus_server_surface_event_id_from_string (event);
+      attached_effects_for_event = g_queue_new ();
+
+      if (event_id >= priv->attached_effects_for_events->len)
+        g_ptr_array_set_size (priv->attached_effects_for_events, event_id + 1);
+
+      g_ptr_array_index (priv->attached_effects_for_events, event_id) = attached_effects_for_event;
+    }
+
+  /* The info is also tracked by the effect, so that when it is
+   * destroyed it can be detached from this surface directly. The
+   * interned event name and queue live as long as the surface does. */
+  AttachedEffectInfo *info = attached_effect_info_new (server_surface,
+                                                       animations_dbus_server_surface_event_id_to_string (event_id),
+                                                       attached_effects_for_event,
+                                                       server_animation_effect,
+                                                       attached_effect);
+  push_link_func (attached_effects_for_event, &info->event_link);
+
+  priv->dirty_properties |= SURFACE_CACHED_PROPERTY_EFFECTS;
+  queue_state_snapshot_update (server_surface);
 
   /* Notify listeners that we've attached the effect to this
    * event and that the effects property has changed now. */
-  const char *props[] = { "effects", NULL };
-  animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (server_surface),
-                                                                   props);
-
-  /* Watch for the effect to be destroyed. When it is deleted
-   * we'll need to detach it from the surface too */
-  g_signal_connect_object (server_animation_effect,
-                           "destroyed",
-                           G_CALLBACK (on_server_animation_effect_destroyed),
-                           server_surface,
-                           G_CONNECT_AFTER);
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_surface (server_surface),
+                                                                   G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                                   &animations_dbus_animatable_surface_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_EFFECTS));
 
   return TRUE;
 }
@@ -221,6 +386,12 @@ animations_dbus_server_surface_export (AnimationsDbusServerSurface  *server_surf
 {
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
 
+  if (priv->server != NULL)
+    return animations_dbus_server_export_object (priv->server,
+                                                 G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                 object_path,
+                                                 error);
+
   return g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (server_surface),
                                            priv->connection,
                                            object_path,
@@ -231,10 +402,68 @@ void
 animations_dbus_server_surface_unexport (AnimationsDbusServerSurface *server_surface)
 {
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->server != NULL)
+    {
+      animations_dbus_server_unexport_object (priv->server,
+                                              G_DBUS_INTERFACE_SKELETON (server_surface));
+      return;
+    }
+
   g_dbus_interface_skeleton_unexport_from_connection (G_DBUS_INTERFACE_SKELETON (server_surface),
                                                       priv->connection);
 }
 
+/* Surfaces registered with the server are not exported themselves,
+ * they are dispatched from the AnimatableSurface subtree of the server
+ * instead. This records the @object_path that @server_surface is
+ * dispatched at and the @connections that its PropertiesChanged
+ * signals are sent on, or unsets them if @object_path is %NULL. */
+void
+animations_dbus_server_surface_set_dispatch_target (AnimationsDbusServerSurface *server_surface,
+                                                    const char                  *object_path,
+                                                    GPtrArray                   *connections)
+{
+  animations_dbus_set_skeleton_dispatch_target (G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                object_path,
+                                                connections);
+}
+
+/**
+ * animations_dbus_server_surface_get_object_path:
+ * @server_surface: An #AnimationsDbusServerSurface
+ *
+ * Get the object path that clients can reach @server_surface at on the
+ * bus. This is only set while the surface is exported by its
+ * #AnimationsDbusServer, which might not be the case yet if the server
+ * was created with #AnimationsDbusServer:lazy-surface-export.
+ *
+ * Returns: (nullable): The object path of @server_surface, or %NULL if
+ *          it is not currently exported.
+ */
+const char *
+animations_dbus_server_surface_get_object_path (AnimationsDbusServerSurface *server_surface)
+{
+  return animations_dbus_get_skeleton_object_path (G_DBUS_INTERFACE_SKELETON (server_surface));
+}
+
+/**
+ * animations_dbus_server_surface_get_id:
+ * @server_surface: An #AnimationsDbusServerSurface
+ *
+ * Get the id that the #AnimationsDbusServer allocated for this surface
+ * when it was registered. The id is unique for the lifetime of the server.
+ *
+ * Returns: The id of @server_surface.
+ */
+unsigned int
+animations_dbus_server_surface_get_id (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  return priv->id;
+}
+
 gboolean
 animations_dbus_server_surface_attach_animation_effect_with_server_priority (AnimationsDbusServerSurface  *server_surface,
                                                                              const char                   *event,
@@ -246,10 +475,44 @@ animations_dbus_server_surface_attach_animation_effect_with_server_priority (Ani
   return animations_dbus_server_surface_attach_effect_with_queue_func (server_surface,
                                                                        event,
                                                                        server_animation_effect,
-                                                                       g_queue_push_tail,
+                                                                       g_queue_push_tail_link,
                                                                        error);
 }
 
+/**
+ * animations_dbus_server_surface_highest_priority_attached_effect_for_event_id:
+ * @server_surface: The #AnimationsDbusServerSurface with the attached effects.
+ * @event_id: The id of the event to get the highest priority effect on, from
+ *            animations_dbus_server_surface_event_id_from_string().
+ *
+ * Like animations_dbus_server_surface_highest_priority_attached_effect_for_event(),
+ * but without having to look up the event name. This is O(1) and is what
+ * should be used when starting an animation.
+ *
+ * Returns: (transfer none): The #AnimationsDbusServerSurfaceAttachedEffect for the highest
+ *          priority effect on @surface for @event_id, or %NULL if no events are attached to
+ *          @effect.
+ */
+AnimationsDbusServerSurfaceAttachedEffect *
+animations_dbus_server_surface_highest_priority_attached_effect_for_event_id (AnimationsDbusServerSurface *server_surface,
+                                                                              unsigned int                 event_id)
+{
+  AnimationsDbusServerSurfacePrivate *priv =
+    animations_dbus_server_surface_get_instance_private (server_surface);
+  GQueue *attached_effects_for_event = attached_effects_for_event_id (priv, event_id);
+  AttachedEffectInfo *info = NULL;
+
+  if (attached_effects_for_event == NULL)
+    return NULL;
+
+  info = g_queue_peek_head (attached_effects_for_event);
+
+  if (info == NULL)
+    return NULL;
+
+  return info->attached_effect;
+}
+
 /**
  * animations_dbus_server_surface_highest_priority_attached_effect_for_event:
  * @server_surface: The #AnimationsDbusServerSurface with the attached effects.
@@ -267,112 +530,109 @@ AnimationsDbusServerSurfaceAttachedEffect *
 animations_dbus_server_surface_highest_priority_attached_effect_for_event (AnimationsDbusServerSurface *server_surface,
                                                                            const char                  *event)
 {
-  AnimationsDbusServerSurfacePrivate *priv =
-    animations_dbus_server_surface_get_instance_private (server_surface);
-  GQueue *attached_effects_for_event = g_hash_table_lookup (priv->attached_effects_for_events, event);
+  return animations_dbus_server_surface_highest_priority_attached_effect_for_event_id (server_surface,
+                                                                                       lookup_event_id (event));
+}
 
-  if (attached_effects_for_event)
-    {
-      AttachedEffectInfo *info = g_queue_peek_head (attached_effects_for_event);
+static void
+queue_geometry_properties_changed (AnimationsDbusServerSurface *server_surface)
+{
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_surface (server_surface),
+                                                                   G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                                   &animations_dbus_animatable_surface_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_GEOMETRY));
+}
 
-      if (info == NULL)
-        return NULL;
+static gboolean
+on_geometry_notify_interval_elapsed (gpointer user_data)
+{
+  AnimationsDbusServerSurface *server_surface = user_data;
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
 
-      return info->attached_effect;
+  /* Nothing changed during the interval, so the next change
+   * can be sent straight away again. */
+  if (!priv->geometry_notify_pending)
+    {
+      g_clear_pointer (&priv->geometry_notify_source, g_source_unref);
+      return G_SOURCE_REMOVE;
     }
 
-  return NULL;
+  /* Send the latest geometry and wait for another interval */
+  priv->geometry_notify_pending = FALSE;
+  queue_geometry_properties_changed (server_surface);
+
+  return G_SOURCE_CONTINUE;
 }
 
+/**
+ * animations_dbus_server_surface_emit_geometry_changed:
+ * @server_surface: An #AnimationsDbusServerSurface
+ *
+ * Notify clients that the geometry of the surface has changed. The
+ * geometry is cached after it is first read from the bridge, so this
+ * must be called whenever it changes.
+ *
+ * Notifications are rate limited to the #AnimationsDbusServer:effective-geometry-notify-interval
+ * of the server. That is the #AnimationsDbusServer:geometry-notify-interval,
+ * or a longer interval if all clients requested one, and 0 by default,
+ * in which case every change is sent. Otherwise the first change is
+ * sent straight away and the final geometry is always sent once the
+ * interval has elapsed, so it is fine to call this on every motion
+ * event.
+ */
 void
 animations_dbus_server_surface_emit_geometry_changed (AnimationsDbusServerSurface *server_surface)
 {
-  const char *props[] = { "geometry", NULL };
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+  unsigned int interval = 0;
 
-  animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (server_surface),
-                                                                   props);
-}
+  priv->dirty_properties |= SURFACE_CACHED_PROPERTY_GEOMETRY;
+  queue_state_snapshot_update (server_surface);
 
-void
-animations_dbus_server_surface_emit_title_changed (AnimationsDbusServerSurface *server_surface)
-{
-  const char *props[] = { "title", NULL };
+  if (priv->geometry_notify_source != NULL)
+    {
+      priv->geometry_notify_pending = TRUE;
+      return;
+    }
 
-  animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (server_surface),
-                                                                   props);
-}
+  queue_geometry_properties_changed (server_surface);
 
-/* /com/endlessm/Libanimation/AnimationManager/N/AnimationEffect/M */
-#define EFFECT_PATH_EXPECTED_COMPONENTS 8
-#define EFFECT_PATH_ANIMATION_MANAGER_INDEX 5
-#define EFFECT_PATH_ANIMATION_EFFECT_INDEX 7
+  if (priv->server != NULL)
+    interval = animations_dbus_server_get_effective_geometry_notify_interval (priv->server);
 
-static gboolean
-parse_effect_path (const char    *effect_path,
-                   unsigned int  *out_animation_manager_id,
-                   unsigned int  *out_animation_effect_id,
-                   GError       **error)
-{
-  g_return_val_if_fail (out_animation_manager_id != NULL, FALSE);
-  g_return_val_if_fail (out_animation_effect_id != NULL, FALSE);
-
-  g_auto(GStrv) effect_path_components = g_strsplit (effect_path, "/", 0);
-  unsigned int path_length = g_strv_length (effect_path_components);
-  guint64 animation_manager_id64 = 0;
-  guint64 animation_effect_id64 = 0;
-  g_autoptr(GError) local_error = NULL;
+  if (interval == 0)
+    return;
 
-  if (path_length != EFFECT_PATH_EXPECTED_COMPONENTS)
-    {
-      g_set_error (error,
-                   ANIMATIONS_DBUS_ERROR,
-                   ANIMATIONS_DBUS_ERROR_NO_SUCH_ANIMATION,
-                   "Expected animation path '%s' to have %u components, but "
-                   "had %u components",
-                   effect_path,
-                   EFFECT_PATH_EXPECTED_COMPONENTS,
-                   path_length);
-      return FALSE;
-    }
+  g_autoptr(GMainContext) context = g_main_context_ref_thread_default ();
 
-  if (!g_ascii_string_to_unsigned (effect_path_components[EFFECT_PATH_ANIMATION_MANAGER_INDEX],
-                                   10,
-                                   0,
-                                   G_MAXUINT,
-                                   &animation_manager_id64,
-                                   &local_error))
-    {
-      g_set_error (error,
-                   ANIMATIONS_DBUS_ERROR,
-                   ANIMATIONS_DBUS_ERROR_NO_SUCH_ANIMATION,
-                   "Expected animation path component '%s' to be an "
-                   "unsigned integer: %s",
-                   effect_path_components[EFFECT_PATH_ANIMATION_MANAGER_INDEX],
-                   local_error->message);
-      return FALSE;
-    }
+  priv->geometry_notify_source = g_timeout_source_new (interval);
+  g_source_set_callback (priv->geometry_notify_source,
+                         on_geometry_notify_interval_elapsed,
+                         server_surface,
+                         NULL);
+  g_source_attach (priv->geometry_notify_source, context);
+}
 
-  if (!g_ascii_string_to_unsigned (effect_path_components[EFFECT_PATH_ANIMATION_EFFECT_INDEX],
-                                   10,
-                                   0,
-                                   G_MAXUINT,
-                                   &animation_effect_id64,
-                                   &local_error))
-    {
-      g_set_error (error,
-                   ANIMATIONS_DBUS_ERROR,
-                   ANIMATIONS_DBUS_ERROR_NO_SUCH_ANIMATION,
-                   "Expected animation path component '%s' to be an "
-                   "unsigned integer: %s",
-                   effect_path_components[EFFECT_PATH_ANIMATION_EFFECT_INDEX],
-                   local_error->message);
-      return FALSE;
-    }
+/**
+ * animations_dbus_server_surface_emit_title_changed:
+ * @server_surface: An #AnimationsDbusServerSurface
+ *
+ * Notify clients that the title of the surface has changed. The
+ * title is cached after it is first read from the bridge, so this
+ * must be called whenever it changes.
+ */
+void
+animations_dbus_server_surface_emit_title_changed (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
 
-  *out_animation_manager_id = (unsigned int) animation_manager_id64;
-  *out_animation_effect_id = (unsigned int) animation_effect_id64;
+  priv->dirty_properties |= SURFACE_CACHED_PROPERTY_TITLE;
+  queue_state_snapshot_update (server_surface);
 
-  return TRUE;
+  animations_dbus_emit_properties_changed_for_skeleton_properties (properties_changed_queue_for_surface (server_surface),
+                                                                   G_DBUS_INTERFACE_SKELETON (server_surface),
+                                                                   &animations_dbus_animatable_surface_property_table,
+                                                                   ANIMATIONS_DBUS_PROPERTY_BIT (ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_TITLE));
 }
 
 static gboolean
@@ -384,26 +644,13 @@ animations_dbus_server_surface_attach_animation_effect (AnimationsDbusAnimatable
   AnimationsDbusServerSurface *server_surface = ANIMATIONS_DBUS_SERVER_SURFACE (animatable_surface);
   AnimationsDbusServerSurfacePrivate *priv =
     animations_dbus_server_surface_get_instance_private (server_surface);
-  unsigned int animation_manager_id = 0;
-  unsigned int animation_effect_id = 0;
   g_autoptr(GError) local_error = NULL;
 
-  /* Validate that the passed in effect_path is a valid object path */
-  if (!parse_effect_path (effect_path,
-                          &animation_manager_id,
-                          &animation_effect_id,
-                          &local_error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation,
-                                              g_steal_pointer (&local_error));
-      return TRUE;
-    }
-
+  /* Validates the effect_path too, if it is not exported */
   AnimationsDbusServerEffect *server_animation_effect =
-    animations_dbus_server_lookup_animation_effect_by_ids (priv->server,
-                                                           animation_manager_id,
-                                                           animation_effect_id,
-                                                           &local_error);
+    animations_dbus_server_lookup_animation_effect_by_path (priv->server,
+                                                            effect_path,
+                                                            &local_error);
 
   /* Insert the animation effect into the table */
   if (server_animation_effect == NULL)
@@ -417,7 +664,7 @@ animations_dbus_server_surface_attach_animation_effect (AnimationsDbusAnimatable
   if (!animations_dbus_server_surface_attach_effect_with_queue_func (server_surface,
                                                                      event,
                                                                      server_animation_effect,
-                                                                     g_queue_push_head,
+                                                                     g_queue_push_head_link,
                                                                      &local_error))
     {
       g_dbus_method_invocation_return_gerror (invocation,
@@ -425,6 +672,10 @@ animations_dbus_server_surface_attach_animation_effect (AnimationsDbusAnimatable
       return TRUE;
     }
 
+  /* Make sure the client sees the new effect by the time the call returns */
+  animations_dbus_properties_changed_queue_flush_skeleton (properties_changed_queue_for_surface (server_surface),
+                                                           G_DBUS_INTERFACE_SKELETON (server_surface));
+
   animations_dbus_animatable_surface_complete_attach_animation_effect (animatable_surface,
                                                                        invocation);
   return TRUE;
@@ -438,27 +689,14 @@ animations_dbus_server_surface_detach_animation_effect (AnimationsDbusAnimatable
 {
   AnimationsDbusServerSurface *server_surface = ANIMATIONS_DBUS_SERVER_SURFACE (animatable_surface);
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
-  unsigned int animation_manager_id = 0;
-  unsigned int animation_effect_id = 0;
   GQueue *attached_effects_for_events = NULL;
   g_autoptr(GError) local_error = NULL;
 
-  /* Validate that the passed in effect_path is a valid object path */
-  if (!parse_effect_path (effect_path,
-                          &animation_manager_id,
-                          &animation_effect_id,
-                          &local_error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation,
-                                              g_steal_pointer (&local_error));
-      return TRUE;
-    }
-
+  /* Validates the effect_path too, if it is not exported */
   AnimationsDbusServerEffect *server_animation_effect =
-    animations_dbus_server_lookup_animation_effect_by_ids (priv->server,
-                                                           animation_manager_id,
-                                                           animation_effect_id,
-                                                           &local_error);
+    animations_dbus_server_lookup_animation_effect_by_path (priv->server,
+                                                            effect_path,
+                                                            &local_error);
 
   /* Remove the animation effect from the table */
   if (server_animation_effect == NULL)
@@ -468,7 +706,7 @@ animations_dbus_server_surface_detach_animation_effect (AnimationsDbusAnimatable
       return TRUE;
     }
 
-  attached_effects_for_events = g_hash_table_lookup (priv->attached_effects_for_events, event);
+  attached_effects_for_events = attached_effects_for_event_id (priv, lookup_event_id (event));
 
   /* Not attached, do nothing */
   if (attached_effects_for_events == NULL)
@@ -488,22 +726,14 @@ animations_dbus_server_surface_detach_animation_effect (AnimationsDbusAnimatable
 
       if (info->server_effect == server_animation_effect)
         {
-          animations_dbus_server_surface_bridge_detach_effect (priv->bridge,
-                                                               event,
-                                                               info->attached_effect);
-
-          /* Notify listeners that we've dettached the effect from this
-           * event and that the effects property has changed now. */
-          const char *props[] = { "effects", NULL };
-          animations_dbus_emit_properties_changed_for_skeleton_properties (G_DBUS_INTERFACE_SKELETON (server_surface),
-                                                                           props);
-
-          g_queue_delete_link (attached_effects_for_events, link);
-          attached_effect_info_free (info);
+          animations_dbus_server_surface_remove_attachment (info);
           break;
         }
     }
 
+  animations_dbus_properties_changed_queue_flush_skeleton (properties_changed_queue_for_surface (server_surface),
+                                                           G_DBUS_INTERFACE_SKELETON (server_surface));
+
   animations_dbus_animatable_surface_complete_detach_animation_effect (animatable_surface,
                                                                        invocation);
   return TRUE;
@@ -554,6 +784,9 @@ animations_dbus_server_surface_set_property (GObject      *object,
     case PROP_BRIDGE:
       priv->bridge = g_value_dup_object (value);
       break;
+    case PROP_ID:
+      priv->id = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -561,21 +794,21 @@ animations_dbus_server_surface_set_property (GObject      *object,
 }
 
 static GVariant *
-serialize_attached_effects_to_variant (GHashTable *effects_for_events)
+serialize_attached_effects_to_variant (GPtrArray *effects_for_events)
 {
   g_auto(GVariantDict) vardict;
-  gpointer key, value;
-  GHashTableIter iter;
 
   g_variant_dict_init (&vardict, NULL);
 
-  g_hash_table_iter_init (&iter, effects_for_events);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (unsigned int event_id = 0; event_id < effects_for_events->len; ++event_id)
     {
-      const char *event = key;
-      GQueue *effects = value;
+      GQueue *effects = g_ptr_array_index (effects_for_events, event_id);
       g_auto(GVariantBuilder) builder;
-      g_autoptr(GPtrArray) names = g_ptr_array_new_full (g_queue_get_length (effects), NULL);
+
+      if (effects == NULL)
+        continue;
+
+      const char *event = animations_dbus_server_surface_event_id_to_string (event_id);
 
       g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
 
@@ -586,7 +819,7 @@ serialize_attached_effects_to_variant (GHashTable *effects_for_events)
           AttachedEffectInfo *info = link->data;
           g_variant_builder_add (&builder,
                                  "s",
-                                 g_dbus_interface_skeleton_get_object_path (G_DBUS_INTERFACE_SKELETON (info->server_effect)));
+                                 animations_dbus_server_effect_get_object_path (info->server_effect));
         }
 
       g_variant_dict_insert_value (&vardict,
@@ -597,6 +830,85 @@ serialize_attached_effects_to_variant (GHashTable *effects_for_events)
   return g_variant_dict_end (&vardict);
 }
 
+static const char *
+animations_dbus_server_surface_get_cached_title (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->dirty_properties & SURFACE_CACHED_PROPERTY_TITLE)
+    {
+      g_free (priv->cached_title);
+      priv->cached_title = g_strdup (animations_dbus_server_surface_bridge_get_title (priv->bridge));
+      priv->dirty_properties &= ~SURFACE_CACHED_PROPERTY_TITLE;
+    }
+
+  return priv->cached_title;
+}
+
+static GVariant *
+animations_dbus_server_surface_get_cached_geometry (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->dirty_properties & SURFACE_CACHED_PROPERTY_GEOMETRY)
+    {
+      GVariant *geometry = animations_dbus_server_surface_bridge_get_geometry (priv->bridge);
+
+      g_clear_pointer (&priv->cached_geometry, g_variant_unref);
+      priv->cached_geometry = geometry != NULL ? g_variant_ref_sink (geometry) : NULL;
+      priv->dirty_properties &= ~SURFACE_CACHED_PROPERTY_GEOMETRY;
+    }
+
+  return priv->cached_geometry;
+}
+
+static GVariant *
+animations_dbus_server_surface_get_cached_effects (AnimationsDbusServerSurface *server_surface)
+{
+  AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
+
+  if (priv->dirty_properties & SURFACE_CACHED_PROPERTY_EFFECTS)
+    {
+      g_clear_pointer (&priv->cached_effects, g_variant_unref);
+      priv->cached_effects =
+        g_variant_ref_sink (serialize_attached_effects_to_variant (priv->attached_effects_for_events));
+      priv->dirty_properties &= ~SURFACE_CACHED_PROPERTY_EFFECTS;
+    }
+
+  return priv->cached_effects;
+}
+
+/* Serializes the current values of the D-Bus properties of
+ * @server_surface into a new floating "a{sv}" dictionary keyed
+ * by their D-Bus names, as sent by ListSurfacesWithProperties. */
+GVariant *
+animations_dbus_server_surface_serialize_properties (AnimationsDbusServerSurface *server_surface)
+{
+  const AnimationsDbusPropertyTableEntry *properties = animations_dbus_animatable_surface_property_table.properties;
+  GVariant *geometry = animations_dbus_server_surface_get_cached_geometry (server_surface);
+  const char *title = animations_dbus_server_surface_get_cached_title (server_surface);
+  g_auto(GVariantDict) vardict;
+
+  g_variant_dict_init (&vardict, NULL);
+
+  if (title != NULL)
+    g_variant_dict_insert (&vardict,
+                           properties[ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_TITLE].dbus_name,
+                           "s",
+                           title);
+
+  if (geometry != NULL)
+    g_variant_dict_insert_value (&vardict,
+                                 properties[ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_GEOMETRY].dbus_name,
+                                 geometry);
+
+  g_variant_dict_insert_value (&vardict,
+                               properties[ANIMATIONS_DBUS_ANIMATABLE_SURFACE_PROPERTY_EFFECTS].dbus_name,
+                               animations_dbus_server_surface_get_cached_effects (server_surface));
+
+  return g_variant_dict_end (&vardict);
+}
+
 static void
 animations_dbus_server_surface_get_property (GObject    *object,
                                              guint       prop_id,
@@ -618,17 +930,20 @@ animations_dbus_server_surface_get_property (GObject    *object,
     case PROP_BRIDGE:
       g_value_set_object (value, priv->bridge);
       break;
+    case PROP_ID:
+      g_value_set_uint (value, priv->id);
+      break;
     case PROP_TITLE:
       g_value_set_string (value,
-                          animations_dbus_server_surface_bridge_get_title (priv->bridge));
+                          animations_dbus_server_surface_get_cached_title (server_surface));
       break;
     case PROP_GEOMETRY:
       g_value_set_variant (value,
-                           animations_dbus_server_surface_bridge_get_geometry (priv->bridge));
+                           animations_dbus_server_surface_get_cached_geometry (server_surface));
       break;
     case PROP_EFFECTS:
       g_value_set_variant (value,
-                           serialize_attached_effects_to_variant (priv->attached_effects_for_events));
+                           animations_dbus_server_surface_get_cached_effects (server_surface));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -645,6 +960,12 @@ animations_dbus_server_surface_dispose (GObject *object)
   priv->server = NULL;
   g_clear_object (&priv->bridge);
 
+  if (priv->geometry_notify_source != NULL)
+    {
+      g_source_destroy (priv->geometry_notify_source);
+      g_clear_pointer (&priv->geometry_notify_source, g_source_unref);
+    }
+
   G_OBJECT_CLASS (animations_dbus_server_surface_parent_class)->dispose (object);
 }
 
@@ -654,7 +975,10 @@ animations_dbus_server_surface_finalize (GObject *object)
   AnimationsDbusServerSurface *server_surface = ANIMATIONS_DBUS_SERVER_SURFACE (object);
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
 
-  g_clear_pointer (&priv->attached_effects_for_events, g_hash_table_unref);
+  g_clear_pointer (&priv->attached_effects_for_events, g_ptr_array_unref);
+  g_clear_pointer (&priv->cached_title, g_free);
+  g_clear_pointer (&priv->cached_geometry, g_variant_unref);
+  g_clear_pointer (&priv->cached_effects, g_variant_unref);
 
   G_OBJECT_CLASS (animations_dbus_server_surface_parent_class)->finalize (object);
 }
@@ -662,7 +986,17 @@ animations_dbus_server_surface_finalize (GObject *object)
 static void
 attached_effect_info_queue_free (GQueue *queue)
 {
-  g_queue_free_full (queue, (GDestroyNotify) attached_effect_info_free);
+  GList *link = NULL;
+
+  if (queue == NULL)
+    return;
+
+  /* The links are embedded in the infos, so g_queue_free_full
+   * cannot be used here. */
+  while ((link = g_queue_pop_head_link (queue)) != NULL)
+    attached_effect_info_free (link->data);
+
+  g_queue_free (queue);
 }
 
 static void
@@ -670,10 +1004,9 @@ animations_dbus_server_surface_init (AnimationsDbusServerSurface *server_surface
 {
   AnimationsDbusServerSurfacePrivate *priv = animations_dbus_server_surface_get_instance_private (server_surface);
 
-  priv->attached_effects_for_events = g_hash_table_new_full (g_str_hash,
-                                                             g_str_equal,
-                                                             g_free,
-                                                             (GDestroyNotify) attached_effect_info_queue_free);
+  priv->attached_effects_for_events =
+    g_ptr_array_new_with_free_func ((GDestroyNotify) attached_effect_info_queue_free);
+  priv->dirty_properties = SURFACE_CACHED_PROPERTY_ALL;
 }
 
 static void
@@ -704,6 +1037,14 @@ animations_dbus_server_surface_class_init (AnimationsDbusServerSurfaceClass *kla
                          "An AnimationsDbusServerSurfaceBridge used to communicate with the underlying surface",
                          ANIMATIONS_DBUS_TYPE_SERVER_SURFACE_BRIDGE,
                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+  animations_dbus_server_surface_props[PROP_ID] =
+    g_param_spec_uint ("id",
+                       "Id",
+                       "The id allocated to this surface by the AnimationsDbusServer",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
 
   g_object_class_install_properties (object_class,
                                      N_OWN_PROPS,
@@ -731,3 +1072,19 @@ animations_dbus_server_surface_new (GDBusConnection                   *connectio
                        "bridge", bridge,
                        NULL);
 }
+
+/* Like animations_dbus_server_surface_new, but for surfaces registered
+ * with @server, which allocates their @id. */
+AnimationsDbusServerSurface *
+animations_dbus_server_surface_new_with_id (GDBusConnection                   *connection,
+                                            AnimationsDbusServer              *server,
+                                            AnimationsDbusServerSurfaceBridge *bridge,
+                                            unsigned int                       id)
+{
+  return g_object_new (ANIMATIONS_DBUS_TYPE_SERVER_SURFACE,
+                       "connection", connection,
+                       "server", server,
+                       "bridge", bridge,
+                       "id", id,
+                       NULL);
+}
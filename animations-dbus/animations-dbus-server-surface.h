@@ -39,6 +39,10 @@ gboolean animations_dbus_server_surface_export (AnimationsDbusServerSurface  *se
 
 void animations_dbus_server_surface_unexport (AnimationsDbusServerSurface *server_surface);
 
+unsigned int animations_dbus_server_surface_get_id (AnimationsDbusServerSurface *server_surface);
+
+const char * animations_dbus_server_surface_get_object_path (AnimationsDbusServerSurface *server_surface);
+
 gboolean animations_dbus_server_surface_attach_animation_effect_with_server_priority (AnimationsDbusServerSurface  *server_surface,
                                                                                       const char                   *event,
                                                                                       AnimationsDbusServerEffect   *server_animation_effect,
@@ -47,6 +51,13 @@ gboolean animations_dbus_server_surface_attach_animation_effect_with_server_prio
 AnimationsDbusServerSurfaceAttachedEffect * animations_dbus_server_surface_highest_priority_attached_effect_for_event (AnimationsDbusServerSurface *server_surface,
                                                                                                                        const char                  *event);
 
+AnimationsDbusServerSurfaceAttachedEffect * animations_dbus_server_surface_highest_priority_attached_effect_for_event_id (AnimationsDbusServerSurface *server_surface,
+                                                                                                                          unsigned int                 event_id);
+
+unsigned int animations_dbus_server_surface_event_id_from_string (const char *event);
+
+const char * animations_dbus_server_surface_event_id_to_string (unsigned int event_id);
+
 void animations_dbus_server_surface_emit_geometry_changed (AnimationsDbusServerSurface *server_surface);
 
 void animations_dbus_server_surface_emit_title_changed (AnimationsDbusServerSurface *server_surface);
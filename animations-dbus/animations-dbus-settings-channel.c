@@ -0,0 +1,271 @@
+/* Copyright 2018 Endless Mobile, Inc.
+ *
+ * libanimation-dbus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * libanimation-dbus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with eos-discovery-feed.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ * - Sam Spilsbury <sam@endlessm.com>
+ */
+
+/* For memfd_create and file sealing */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "animations-dbus-settings-channel.h"
+
+#define SETTINGS_CHANNEL_MAGIC 0x41445343  /* "ADSC" */
+
+/* Must be a power of two, so that the free running head and tail
+ * counters can be masked into an index and may wrap around. */
+#define SETTINGS_CHANNEL_CAPACITY 1024
+
+typedef struct
+{
+  guint32 key;
+  guint32 reserved;
+  double  value;
+} SettingsChannelEntry;
+
+/* The head is only written by the producer and the tail only by the
+ * consumer. They are kept on separate cache lines so that the two
+ * sides do not keep invalidating each other's cache line. */
+typedef struct
+{
+  guint32              magic;
+  guint32              capacity;
+  char                 padding_after_header[56];
+  volatile gint        head;
+  char                 padding_after_head[60];
+  volatile gint        tail;
+  char                 padding_after_tail[60];
+  SettingsChannelEntry entries[];
+} SettingsChannelLayout;
+
+#define SETTINGS_CHANNEL_SIZE (sizeof (SettingsChannelLayout) + \
+                               SETTINGS_CHANNEL_CAPACITY * sizeof (SettingsChannelEntry))
+
+struct _AnimationsDbusSettingsChannel
+{
+  int                    fd;
+  SettingsChannelLayout *layout;  /* (owned) mapping of SETTINGS_CHANNEL_SIZE bytes */
+};
+
+static AnimationsDbusSettingsChannel *
+settings_channel_new_for_mapped_fd (int      fd,
+                                    GError **error)
+{
+  gpointer mapping = mmap (NULL,
+                           SETTINGS_CHANNEL_SIZE,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED,
+                           fd,
+                           0);
+  AnimationsDbusSettingsChannel *channel = NULL;
+
+  if (mapping == MAP_FAILED)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (saved_errno),
+                   "Could not map settings channel: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  channel = g_new0 (AnimationsDbusSettingsChannel, 1);
+  channel->fd = fd;
+  channel->layout = mapping;
+
+  return channel;
+}
+
+/* Create the shared memory for a new channel. The memory is sealed
+ * against being resized, so that the client cannot make accesses
+ * to it fault on the server side by truncating it. */
+AnimationsDbusSettingsChannel *
+animations_dbus_settings_channel_new (GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+  int fd = memfd_create ("animations-dbus-settings-channel",
+                         MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  AnimationsDbusSettingsChannel *channel = NULL;
+
+  if (fd < 0 ||
+      ftruncate (fd, SETTINGS_CHANNEL_SIZE) < 0 ||
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+      int saved_errno = errno;
+
+      if (fd >= 0)
+        g_close (fd, NULL);
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (saved_errno),
+                   "Could not create settings channel: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  channel = settings_channel_new_for_mapped_fd (fd, error);
+
+  if (channel == NULL)
+    {
+      g_close (fd, NULL);
+      return NULL;
+    }
+
+  /* The memory is zero filled, so head and tail already start at 0 */
+  channel->layout->magic = SETTINGS_CHANNEL_MAGIC;
+  channel->layout->capacity = SETTINGS_CHANNEL_CAPACITY;
+
+  return channel;
+#else
+  g_set_error_literal (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_NOT_SUPPORTED,
+                       "Settings channels are not supported on this platform");
+  return NULL;
+#endif
+}
+
+/* Map the channel created by animations_dbus_settings_channel_new()
+ * from @fd, which the returned channel takes ownership of. */
+AnimationsDbusSettingsChannel *
+animations_dbus_settings_channel_new_for_fd (int      fd,
+                                             GError **error)
+{
+  struct stat stat_buf;
+  g_autoptr(AnimationsDbusSettingsChannel) channel = NULL;
+
+  if (fstat (fd, &stat_buf) < 0 || (gsize) stat_buf.st_size < SETTINGS_CHANNEL_SIZE)
+    {
+      g_close (fd, NULL);
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Settings channel is too small");
+      return NULL;
+    }
+
+  channel = settings_channel_new_for_mapped_fd (fd, error);
+
+  if (channel == NULL)
+    {
+      g_close (fd, NULL);
+      return NULL;
+    }
+
+  if (channel->layout->magic != SETTINGS_CHANNEL_MAGIC ||
+      channel->layout->capacity != SETTINGS_CHANNEL_CAPACITY)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Settings channel has an unexpected layout");
+      return NULL;
+    }
+
+  return g_steal_pointer (&channel);
+}
+
+int
+animations_dbus_settings_channel_get_fd (AnimationsDbusSettingsChannel *channel)
+{
+  return channel->fd;
+}
+
+/* Append an update of the setting at @key to @value. Returns %FALSE if
+ * the consumer has not caught up and the ring is full. */
+gboolean
+animations_dbus_settings_channel_push (AnimationsDbusSettingsChannel *channel,
+                                       guint32                        key,
+                                       double                         value)
+{
+  SettingsChannelLayout *layout = channel->layout;
+  guint32 head = (guint32) layout->head;
+  guint32 tail = (guint32) g_atomic_int_get (&layout->tail);
+  SettingsChannelEntry *entry = NULL;
+
+  if (head - tail >= SETTINGS_CHANNEL_CAPACITY)
+    return FALSE;
+
+  entry = &layout->entries[head & (SETTINGS_CHANNEL_CAPACITY - 1)];
+  entry->key = key;
+  entry->value = value;
+
+  /* Publish the entry only once it has been written */
+  g_atomic_int_set (&layout->head, (gint) (head + 1));
+
+  return TRUE;
+}
+
+/* Call @func for every update that was pushed since the last drain,
+ * in the order that they were pushed, and return how many there were.
+ * The other end is not trusted: entries with non-finite values are
+ * skipped, and if the head is further ahead than the capacity of the
+ * ring, all pending entries are dropped. */
+unsigned int
+animations_dbus_settings_channel_drain (AnimationsDbusSettingsChannel     *channel,
+                                        AnimationsDbusSettingsChannelFunc  func,
+                                        gpointer                           user_data)
+{
+  SettingsChannelLayout *layout = channel->layout;
+  guint32 head = (guint32) g_atomic_int_get (&layout->head);
+  guint32 tail = (guint32) layout->tail;
+  unsigned int n_drained = 0;
+
+  if (head - tail > SETTINGS_CHANNEL_CAPACITY)
+    {
+      g_atomic_int_set (&layout->tail, (gint) head);
+      return 0;
+    }
+
+  for (; tail != head; ++tail)
+    {
+      /* Copy the entry out before looking at it, so that the other
+       * end cannot change it between validating and using it. */
+      SettingsChannelEntry entry = layout->entries[tail & (SETTINGS_CHANNEL_CAPACITY - 1)];
+
+      if (!isfinite (entry.value))
+        continue;
+
+      func (entry.key, entry.value, user_data);
+      ++n_drained;
+    }
+
+  g_atomic_int_set (&layout->tail, (gint) tail);
+
+  return n_drained;
+}
+
+void
+animations_dbus_settings_channel_free (AnimationsDbusSettingsChannel *channel)
+{
+  munmap (channel->layout, SETTINGS_CHANNEL_SIZE);
+  g_close (channel->fd, NULL);
+
+  g_free (channel);
+}
@@ -0,0 +1,61 @@
+/* Copyright 2018 Endless Mobile, Inc.
+ *
+ * libanimation-dbus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * libanimation-dbus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with eos-discovery-feed.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ * - Sam Spilsbury <sam@endlessm.com>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A single producer, single consumer ring of numeric setting updates
+ * in shared memory. The server creates the memory with
+ * animations_dbus_settings_channel_new() and consumes updates with
+ * animations_dbus_settings_channel_drain(). The client maps the file
+ * descriptor that it received over D-Bus with
+ * animations_dbus_settings_channel_new_for_fd() and produces updates
+ * with animations_dbus_settings_channel_push(). Settings are referred
+ * to by their index in the list of keys negotiated over D-Bus. */
+typedef struct _AnimationsDbusSettingsChannel AnimationsDbusSettingsChannel;
+
+typedef void (*AnimationsDbusSettingsChannelFunc) (guint32  key,
+                                                   double   value,
+                                                   gpointer user_data);
+
+AnimationsDbusSettingsChannel * animations_dbus_settings_channel_new (GError **error);
+
+AnimationsDbusSettingsChannel * animations_dbus_settings_channel_new_for_fd (int      fd,
+                                                                            GError **error);
+
+int animations_dbus_settings_channel_get_fd (AnimationsDbusSettingsChannel *channel);
+
+gboolean animations_dbus_settings_channel_push (AnimationsDbusSettingsChannel *channel,
+                                                guint32                        key,
+                                                double                         value);
+
+unsigned int animations_dbus_settings_channel_drain (AnimationsDbusSettingsChannel     *channel,
+                                                     AnimationsDbusSettingsChannelFunc  func,
+                                                     gpointer                           user_data);
+
+void animations_dbus_settings_channel_free (AnimationsDbusSettingsChannel *channel);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AnimationsDbusSettingsChannel, animations_dbus_settings_channel_free)
+
+G_END_DECLS
@@ -0,0 +1,626 @@
+/* Copyright 2018 Endless Mobile, Inc.
+ *
+ * libanimation-dbus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * libanimation-dbus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with eos-discovery-feed.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ * - Sam Spilsbury <sam@endlessm.com>
+ */
+
+/* For memfd_create and file sealing */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "animations-dbus-state-snapshot.h"
+
+#define STATE_SNAPSHOT_MAGIC 0x41445353  /* "ADSS" */
+
+/* The memory cannot grow once it is shared, so surfaces that are
+ * registered once every record is in use are not published. Readers
+ * are told about that through the overflowed flag. */
+#define STATE_SNAPSHOT_CAPACITY 1024
+
+/* Titles and event names longer than these are cut short, and
+ * effects attached beyond the first STATE_SNAPSHOT_MAX_EFFECTS on a
+ * surface are left out. */
+#define STATE_SNAPSHOT_TITLE_SIZE 128
+#define STATE_SNAPSHOT_EVENT_SIZE 32
+#define STATE_SNAPSHOT_MAX_EFFECTS 16
+
+/* The snapshot refers to objects by their ids, and readers rebuild
+ * the object paths from them. */
+#define STATE_SNAPSHOT_SURFACE_PATH_TEMPLATE "/com/endlessm/Libanimation/AnimatableSurface/%u"
+#define STATE_SNAPSHOT_EFFECT_PATH_TEMPLATE "/com/endlessm/Libanimation/AnimationManager/%u/AnimationEffect/%u"
+
+/* How many times a reader retries when an update was in progress
+ * while it was copying the records out. */
+#define STATE_SNAPSHOT_MAX_READ_ATTEMPTS 100
+
+typedef enum
+{
+  STATE_SNAPSHOT_RECORD_IN_USE       = 1 << 0,
+  STATE_SNAPSHOT_RECORD_HAS_TITLE    = 1 << 1,
+  STATE_SNAPSHOT_RECORD_HAS_GEOMETRY = 1 << 2
+} StateSnapshotRecordFlags;
+
+typedef struct
+{
+  char    event[STATE_SNAPSHOT_EVENT_SIZE];
+  guint32 animation_manager_id;
+  guint32 animation_effect_id;
+} StateSnapshotEffect;
+
+/* Effects attached to the same event are stored next to each
+ * other, in order of priority. */
+typedef struct
+{
+  guint32             flags;
+  guint32             surface_id;
+  gint32              geometry[4];
+  guint32             n_effects;
+  char                title[STATE_SNAPSHOT_TITLE_SIZE];
+  StateSnapshotEffect effects[STATE_SNAPSHOT_MAX_EFFECTS];
+} StateSnapshotRecord;
+
+/* Every record below n_records may be in use. Records that are not
+ * have STATE_SNAPSHOT_RECORD_IN_USE unset and are reused by the next
+ * surface that is published. */
+typedef struct
+{
+  guint32             magic;
+  guint32             capacity;
+  guint32             record_size;
+  guint32             n_records;
+  volatile gint       sequence;
+  guint32             overflowed;
+  char                padding[40];
+  StateSnapshotRecord records[];
+} StateSnapshotLayout;
+
+#define STATE_SNAPSHOT_SIZE (sizeof (StateSnapshotLayout) + \
+                             STATE_SNAPSHOT_CAPACITY * sizeof (StateSnapshotRecord))
+
+struct _AnimationsDbusStateSnapshot
+{
+  int                  fd;
+  StateSnapshotLayout *layout;  /* (owned) mapping of STATE_SNAPSHOT_SIZE bytes */
+
+  /* Only used by the server, to find the record of a surface */
+  GHashTable          *records_by_surface_id;  /* (key-type: guint) (value-type: guint) index plus one */
+  GArray              *free_records;           /* (element-type: guint) */
+
+  /* Only used by readers, to copy records out of the shared memory */
+  StateSnapshotRecord *read_buffer;
+};
+
+static AnimationsDbusStateSnapshot *
+state_snapshot_new_for_mapped_fd (int      fd,
+                                  int      prot,
+                                  GError **error)
+{
+  gpointer mapping = mmap (NULL, STATE_SNAPSHOT_SIZE, prot, MAP_SHARED, fd, 0);
+  AnimationsDbusStateSnapshot *snapshot = NULL;
+
+  if (mapping == MAP_FAILED)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (saved_errno),
+                   "Could not map state snapshot: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  snapshot = g_new0 (AnimationsDbusStateSnapshot, 1);
+  snapshot->fd = fd;
+  snapshot->layout = mapping;
+
+  return snapshot;
+}
+
+/* Create the shared memory for a new snapshot. The memory is sealed
+ * against being resized, so that readers can trust its size. */
+AnimationsDbusStateSnapshot *
+animations_dbus_state_snapshot_new (GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+  int fd = memfd_create ("animations-dbus-state-snapshot",
+                         MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  AnimationsDbusStateSnapshot *snapshot = NULL;
+
+  if (fd < 0 ||
+      ftruncate (fd, STATE_SNAPSHOT_SIZE) < 0 ||
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    {
+      int saved_errno = errno;
+
+      if (fd >= 0)
+        g_close (fd, NULL);
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (saved_errno),
+                   "Could not create state snapshot: %s",
+                   g_strerror (saved_errno));
+      return NULL;
+    }
+
+  snapshot = state_snapshot_new_for_mapped_fd (fd, PROT_READ | PROT_WRITE, error);
+
+  if (snapshot == NULL)
+    {
+      g_close (fd, NULL);
+      return NULL;
+    }
+
+  snapshot->records_by_surface_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  snapshot->free_records = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  /* The memory is zero filled, so there are no records yet */
+  snapshot->layout->magic = STATE_SNAPSHOT_MAGIC;
+  snapshot->layout->capacity = STATE_SNAPSHOT_CAPACITY;
+  snapshot->layout->record_size = sizeof (StateSnapshotRecord);
+
+  return snapshot;
+#else
+  g_set_error_literal (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_NOT_SUPPORTED,
+                       "State snapshots are not supported on this platform");
+  return NULL;
+#endif
+}
+
+/* Map the snapshot created by animations_dbus_state_snapshot_new()
+ * for reading from @fd, which the returned snapshot takes ownership of. */
+AnimationsDbusStateSnapshot *
+animations_dbus_state_snapshot_new_for_fd (int      fd,
+                                           GError **error)
+{
+  struct stat stat_buf;
+  g_autoptr(AnimationsDbusStateSnapshot) snapshot = NULL;
+
+  if (fstat (fd, &stat_buf) < 0 || (gsize) stat_buf.st_size < STATE_SNAPSHOT_SIZE)
+    {
+      g_close (fd, NULL);
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "State snapshot is too small");
+      return NULL;
+    }
+
+  snapshot = state_snapshot_new_for_mapped_fd (fd, PROT_READ, error);
+
+  if (snapshot == NULL)
+    {
+      g_close (fd, NULL);
+      return NULL;
+    }
+
+  if (snapshot->layout->magic != STATE_SNAPSHOT_MAGIC ||
+      snapshot->layout->capacity != STATE_SNAPSHOT_CAPACITY ||
+      snapshot->layout->record_size != sizeof (StateSnapshotRecord))
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "State snapshot has an unexpected layout");
+      return NULL;
+    }
+
+  return g_steal_pointer (&snapshot);
+}
+
+/* Get a new file descriptor for the snapshot that can only be used
+ * to read it, so that it can be handed out to monitors that are not
+ * trusted to write to it. */
+int
+animations_dbus_state_snapshot_open_read_only_fd (AnimationsDbusStateSnapshot  *snapshot,
+                                                  GError                      **error)
+{
+  g_autofree char *path = g_strdup_printf ("/proc/self/fd/%d", snapshot->fd);
+  int fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+
+  if (fd < 0)
+    {
+      int saved_errno = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (saved_errno),
+                   "Could not open state snapshot for reading: %s",
+                   g_strerror (saved_errno));
+      return -1;
+    }
+
+  return fd;
+}
+
+/* Start rewriting records. Readers retry until the matching
+ * animations_dbus_state_snapshot_end_update() call. */
+void
+animations_dbus_state_snapshot_begin_update (AnimationsDbusStateSnapshot *snapshot)
+{
+  g_assert ((g_atomic_int_get (&snapshot->layout->sequence) & 1) == 0);
+
+  g_atomic_int_inc (&snapshot->layout->sequence);
+}
+
+void
+animations_dbus_state_snapshot_end_update (AnimationsDbusStateSnapshot *snapshot)
+{
+  g_assert ((g_atomic_int_get (&snapshot->layout->sequence) & 1) == 1);
+
+  g_atomic_int_inc (&snapshot->layout->sequence);
+}
+
+/* Copy @str into @dest, cutting it short at a character boundary
+ * if it does not fit. */
+static void
+copy_truncated_utf8 (char       *dest,
+                     gsize       dest_size,
+                     const char *str)
+{
+  const char *end = NULL;
+
+  g_strlcpy (dest, str, dest_size);
+
+  if (!g_utf8_validate (dest, -1, &end))
+    dest[end - dest] = '\0';
+}
+
+static gboolean
+parse_effect_path (const char *path,
+                   guint32    *out_animation_manager_id,
+                   guint32    *out_animation_effect_id)
+{
+  unsigned int animation_manager_id = 0;
+  unsigned int animation_effect_id = 0;
+  int n_parsed = 0;
+
+  if (sscanf (path,
+              STATE_SNAPSHOT_EFFECT_PATH_TEMPLATE "%n",
+              &animation_manager_id,
+              &animation_effect_id,
+              &n_parsed) != 2 ||
+      path[n_parsed] != '\0')
+    return FALSE;
+
+  *out_animation_manager_id = animation_manager_id;
+  *out_animation_effect_id = animation_effect_id;
+
+  return TRUE;
+}
+
+static void
+write_record (StateSnapshotRecord *record,
+              guint32              surface_id,
+              GVariant            *properties)
+{
+  const char *title = NULL;
+  g_autoptr(GVariant) effects = NULL;
+
+  memset (record, 0, sizeof (StateSnapshotRecord));
+
+  record->flags = STATE_SNAPSHOT_RECORD_IN_USE;
+  record->surface_id = surface_id;
+
+  if (g_variant_lookup (properties, "Title", "&s", &title))
+    {
+      record->flags |= STATE_SNAPSHOT_RECORD_HAS_TITLE;
+      copy_truncated_utf8 (record->title, sizeof (record->title), title);
+    }
+
+  if (g_variant_lookup (properties,
+                        "Geometry",
+                        "(iiii)",
+                        &record->geometry[0],
+                        &record->geometry[1],
+                        &record->geometry[2],
+                        &record->geometry[3]))
+    record->flags |= STATE_SNAPSHOT_RECORD_HAS_GEOMETRY;
+
+  effects = g_variant_lookup_value (properties, "Effects", G_VARIANT_TYPE_VARDICT);
+
+  if (effects != NULL)
+    {
+      GVariantIter events_iter;
+      const char *event = NULL;
+      GVariant *paths = NULL;
+
+      g_variant_iter_init (&events_iter, effects);
+      while (g_variant_iter_loop (&events_iter, "{&sv}", &event, &paths))
+        {
+          GVariantIter paths_iter;
+          const char *path = NULL;
+
+          if (!g_variant_is_of_type (paths, G_VARIANT_TYPE_STRING_ARRAY))
+            continue;
+
+          g_variant_iter_init (&paths_iter, paths);
+          while (g_variant_iter_next (&paths_iter, "&s", &path) &&
+                 record->n_effects < STATE_SNAPSHOT_MAX_EFFECTS)
+            {
+              StateSnapshotEffect *effect = &record->effects[record->n_effects];
+
+              if (!parse_effect_path (path,
+                                      &effect->animation_manager_id,
+                                      &effect->animation_effect_id))
+                continue;
+
+              copy_truncated_utf8 (effect->event, sizeof (effect->event), event);
+              ++record->n_effects;
+            }
+        }
+    }
+}
+
+/* Publish the current @properties of the surface with @surface_id,
+ * serialized the same way as for ListSurfacesWithProperties. Returns
+ * %FALSE if there is no room left for a newly published surface. */
+gboolean
+animations_dbus_state_snapshot_update_surface (AnimationsDbusStateSnapshot *snapshot,
+                                               guint32                      surface_id,
+                                               GVariant                    *properties)
+{
+  StateSnapshotLayout *layout = snapshot->layout;
+  guint index_plus_one = GPOINTER_TO_UINT (g_hash_table_lookup (snapshot->records_by_surface_id,
+                                                                GUINT_TO_POINTER (surface_id)));
+
+  if (index_plus_one == 0)
+    {
+      if (snapshot->free_records->len > 0)
+        {
+          index_plus_one = g_array_index (snapshot->free_records,
+                                          guint,
+                                          snapshot->free_records->len - 1) + 1;
+          g_array_set_size (snapshot->free_records, snapshot->free_records->len - 1);
+        }
+      else if (layout->n_records < STATE_SNAPSHOT_CAPACITY)
+        {
+          index_plus_one = ++layout->n_records;
+        }
+      else
+        {
+          layout->overflowed = TRUE;
+          return FALSE;
+        }
+
+      g_hash_table_insert (snapshot->records_by_surface_id,
+                           GUINT_TO_POINTER (surface_id),
+                           GUINT_TO_POINTER (index_plus_one));
+    }
+
+  write_record (&layout->records[index_plus_one - 1], surface_id, properties);
+
+  return TRUE;
+}
+
+void
+animations_dbus_state_snapshot_remove_surface (AnimationsDbusStateSnapshot *snapshot,
+                                               guint32                      surface_id)
+{
+  guint index_plus_one = GPOINTER_TO_UINT (g_hash_table_lookup (snapshot->records_by_surface_id,
+                                                                GUINT_TO_POINTER (surface_id)));
+  guint index = index_plus_one - 1;
+
+  if (index_plus_one == 0)
+    return;
+
+  g_hash_table_remove (snapshot->records_by_surface_id, GUINT_TO_POINTER (surface_id));
+  snapshot->layout->records[index].flags = 0;
+  g_array_append_val (snapshot->free_records, index);
+}
+
+/* The sequence only changes when the snapshot is updated, so readers
+ * can compare it against the sequence of their last read to find out
+ * whether reading again is worth it. */
+guint32
+animations_dbus_state_snapshot_get_sequence (AnimationsDbusStateSnapshot *snapshot)
+{
+  return (guint32) g_atomic_int_get (&snapshot->layout->sequence);
+}
+
+static int
+compare_records_by_surface_id (gconstpointer a,
+                               gconstpointer b)
+{
+  const StateSnapshotRecord *record_a = *(const StateSnapshotRecord **) a;
+  const StateSnapshotRecord *record_b = *(const StateSnapshotRecord **) b;
+
+  if (record_a->surface_id < record_b->surface_id)
+    return -1;
+
+  return record_a->surface_id > record_b->surface_id ? 1 : 0;
+}
+
+static GVariant *
+serialize_effects (const StateSnapshotRecord *record)
+{
+  g_auto(GVariantDict) vardict;
+  GVariantBuilder builder;
+  const char *event = NULL;
+
+  g_variant_dict_init (&vardict, NULL);
+
+  for (guint i = 0; i < MIN (record->n_effects, STATE_SNAPSHOT_MAX_EFFECTS); ++i)
+    {
+      const StateSnapshotEffect *effect = &record->effects[i];
+      g_autofree char *path = NULL;
+
+      if (event == NULL || g_strcmp0 (event, effect->event) != 0)
+        {
+          if (event != NULL)
+            g_variant_dict_insert_value (&vardict, event, g_variant_builder_end (&builder));
+
+          event = effect->event;
+          g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+        }
+
+      path = g_strdup_printf (STATE_SNAPSHOT_EFFECT_PATH_TEMPLATE,
+                              effect->animation_manager_id,
+                              effect->animation_effect_id);
+      g_variant_builder_add (&builder, "s", path);
+    }
+
+  if (event != NULL)
+    g_variant_dict_insert_value (&vardict, event, g_variant_builder_end (&builder));
+
+  return g_variant_dict_end (&vardict);
+}
+
+static GVariant *
+serialize_records (StateSnapshotRecord *records,
+                   guint32              n_records)
+{
+  g_autoptr(GPtrArray) in_use = g_ptr_array_sized_new (n_records);
+  g_auto(GVariantBuilder) builder;
+
+  for (guint32 i = 0; i < n_records; ++i)
+    {
+      StateSnapshotRecord *record = &records[i];
+
+      if ((record->flags & STATE_SNAPSHOT_RECORD_IN_USE) == 0)
+        continue;
+
+      /* The strings were copied out of memory that the server writes
+       * to, so make sure that they are terminated and valid. */
+      record->title[STATE_SNAPSHOT_TITLE_SIZE - 1] = '\0';
+      record->n_effects = MIN (record->n_effects, STATE_SNAPSHOT_MAX_EFFECTS);
+
+      for (guint j = 0; j < record->n_effects; ++j)
+        {
+          record->effects[j].event[STATE_SNAPSHOT_EVENT_SIZE - 1] = '\0';
+
+          if (!g_utf8_validate (record->effects[j].event, -1, NULL))
+            record->effects[j].event[0] = '\0';
+        }
+
+      g_ptr_array_add (in_use, record);
+    }
+
+  /* Surface ids are allocated in increasing order, so this lists the
+   * surfaces in the same order as ListSurfacesWithProperties does. */
+  g_ptr_array_sort (in_use, compare_records_by_surface_id);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(oa{sv})"));
+
+  for (guint i = 0; i < in_use->len; ++i)
+    {
+      const StateSnapshotRecord *record = g_ptr_array_index (in_use, i);
+      g_autofree char *path = g_strdup_printf (STATE_SNAPSHOT_SURFACE_PATH_TEMPLATE,
+                                               record->surface_id);
+      g_auto(GVariantDict) vardict;
+
+      g_variant_dict_init (&vardict, NULL);
+
+      if ((record->flags & STATE_SNAPSHOT_RECORD_HAS_TITLE) != 0 &&
+          g_utf8_validate (record->title, -1, NULL))
+        g_variant_dict_insert (&vardict, "Title", "s", record->title);
+
+      if ((record->flags & STATE_SNAPSHOT_RECORD_HAS_GEOMETRY) != 0)
+        g_variant_dict_insert (&vardict,
+                               "Geometry",
+                               "(iiii)",
+                               record->geometry[0],
+                               record->geometry[1],
+                               record->geometry[2],
+                               record->geometry[3]);
+
+      g_variant_dict_insert_value (&vardict, "Effects", serialize_effects (record));
+
+      g_variant_builder_add (&builder, "(o@a{sv})", path, g_variant_dict_end (&vardict));
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Copy out a consistent view of all the published surfaces, in the
+ * same format as the reply to ListSurfacesWithProperties. */
+GVariant *
+animations_dbus_state_snapshot_read (AnimationsDbusStateSnapshot  *snapshot,
+                                     GError                      **error)
+{
+  StateSnapshotLayout *layout = snapshot->layout;
+
+  if (snapshot->read_buffer == NULL)
+    snapshot->read_buffer = g_new (StateSnapshotRecord, STATE_SNAPSHOT_CAPACITY);
+
+  for (unsigned int attempt = 0; attempt < STATE_SNAPSHOT_MAX_READ_ATTEMPTS; ++attempt)
+    {
+      guint32 sequence = (guint32) g_atomic_int_get (&layout->sequence);
+      guint32 n_records = 0;
+      gboolean overflowed = FALSE;
+
+      /* An update is in progress */
+      if ((sequence & 1) != 0)
+        {
+          g_thread_yield ();
+          continue;
+        }
+
+      n_records = MIN (layout->n_records, STATE_SNAPSHOT_CAPACITY);
+      overflowed = layout->overflowed;
+      memcpy (snapshot->read_buffer, layout->records, n_records * sizeof (StateSnapshotRecord));
+
+      /* The copy has to be finished before the sequence is checked again */
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+      if ((guint32) g_atomic_int_get (&layout->sequence) != sequence)
+        continue;
+
+      if (overflowed)
+        {
+          g_set_error_literal (error,
+                               G_IO_ERROR,
+                               G_IO_ERROR_NO_SPACE,
+                               "Too many surfaces to publish all of them in the state snapshot");
+          return NULL;
+        }
+
+      return serialize_records (snapshot->read_buffer, n_records);
+    }
+
+  g_set_error_literal (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_BUSY,
+                       "State snapshot kept changing while it was being read");
+  return NULL;
+}
+
+void
+animations_dbus_state_snapshot_free (AnimationsDbusStateSnapshot *snapshot)
+{
+  munmap (snapshot->layout, STATE_SNAPSHOT_SIZE);
+  g_close (snapshot->fd, NULL);
+
+  g_clear_pointer (&snapshot->records_by_surface_id, g_hash_table_unref);
+  g_clear_pointer (&snapshot->free_records, g_array_unref);
+  g_clear_pointer (&snapshot->read_buffer, g_free);
+
+  g_free (snapshot);
+}
@@ -0,0 +1,72 @@
+/* Copyright 2018 Endless Mobile, Inc.
+ *
+ * libanimation-dbus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 2.1 of the
+ * License, or (at your option) any later version.
+ *
+ * libanimation-dbus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with eos-discovery-feed.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ * - Sam Spilsbury <sam@endlessm.com>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A read-only view of the surfaces on the server, published in shared
+ * memory for monitors that would otherwise keep calling
+ * ListSurfacesWithProperties and reading the Geometry and Effects
+ * properties just to render them.
+ *
+ * The server creates the memory with animations_dbus_state_snapshot_new()
+ * and rewrites the records of the surfaces that changed between
+ * animations_dbus_state_snapshot_begin_update() and
+ * animations_dbus_state_snapshot_end_update(). A monitor maps the file
+ * descriptor returned by animations_dbus_state_snapshot_open_read_only_fd()
+ * with animations_dbus_state_snapshot_new_for_fd() and copies out a
+ * consistent view with animations_dbus_state_snapshot_read(). Updates
+ * are guarded by a sequence counter that is odd while an update is in
+ * progress, so the server never waits for readers. */
+typedef struct _AnimationsDbusStateSnapshot AnimationsDbusStateSnapshot;
+
+AnimationsDbusStateSnapshot * animations_dbus_state_snapshot_new (GError **error);
+
+AnimationsDbusStateSnapshot * animations_dbus_state_snapshot_new_for_fd (int      fd,
+                                                                        GError **error);
+
+int animations_dbus_state_snapshot_open_read_only_fd (AnimationsDbusStateSnapshot  *snapshot,
+                                                      GError                      **error);
+
+void animations_dbus_state_snapshot_begin_update (AnimationsDbusStateSnapshot *snapshot);
+
+gboolean animations_dbus_state_snapshot_update_surface (AnimationsDbusStateSnapshot *snapshot,
+                                                        guint32                      surface_id,
+                                                        GVariant                    *properties);
+
+void animations_dbus_state_snapshot_remove_surface (AnimationsDbusStateSnapshot *snapshot,
+                                                    guint32                      surface_id);
+
+void animations_dbus_state_snapshot_end_update (AnimationsDbusStateSnapshot *snapshot);
+
+guint32 animations_dbus_state_snapshot_get_sequence (AnimationsDbusStateSnapshot *snapshot);
+
+GVariant * animations_dbus_state_snapshot_read (AnimationsDbusStateSnapshot  *snapshot,
+                                                GError                      **error);
+
+void animations_dbus_state_snapshot_free (AnimationsDbusStateSnapshot *snapshot);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AnimationsDbusStateSnapshot, animations_dbus_state_snapshot_free)
+
+G_END_DECLS
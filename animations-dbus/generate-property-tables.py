@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+# Copyright 2018 Endless Mobile, Inc.
+#
+# Generates tables mapping the index of each D-Bus property on the
+# interfaces in a D-Bus introspection file to its D-Bus name, hyphenated
+# GObject property name and signature, so that PropertiesChanged signals
+# can be built without looking properties up by name.
+#
+# Usage: generate-property-tables.py INPUT.xml INTERFACE_PREFIX C_NAMESPACE
+#                                    OUTPUT.h OUTPUT.c
+
+import os
+import sys
+import xml.parsers.expat
+
+
+def camel_case_to_uscore(name):
+    # Same rules as gdbus-codegen, so that the hyphenated names
+    # match the properties that it installs on the skeletons.
+    if name.upper() == name:
+        return name.lower()
+
+    out = ''
+    for n, c in enumerate(name):
+        if c.isupper() and n > 0:
+            if not name[n - 1].isupper() or (n + 1 < len(name) and
+                                             name[n + 1].islower()):
+                out += '_'
+        out += c.lower()
+    return out
+
+
+class Interface(object):
+    def __init__(self, name):
+        self.name = name
+        self.properties = []
+
+
+class IntrospectionParser(object):
+    def __init__(self):
+        self.interfaces = []
+        self._interface = None
+
+    def _start_element(self, name, attrs):
+        if name == 'interface':
+            self._interface = Interface(attrs['name'])
+            self.interfaces.append(self._interface)
+        elif name == 'property' and self._interface is not None:
+            self._interface.properties.append((attrs['name'], attrs['type']))
+
+    def _end_element(self, name):
+        if name == 'interface':
+            self._interface = None
+
+    def parse(self, data):
+        parser = xml.parsers.expat.ParserCreate()
+        parser.StartElementHandler = self._start_element
+        parser.EndElementHandler = self._end_element
+        # Like gdbus-codegen, do not insist on the document being
+        # terminated, since that is all that it validates.
+        parser.Parse(data)
+        return self.interfaces
+
+
+def interface_c_names(interface, prefix, namespace):
+    short_name = interface.name
+    if short_name.startswith(prefix):
+        short_name = short_name[len(prefix):].lstrip('.')
+    short_name = short_name.replace('.', '')
+
+    lower = '{}_{}'.format(camel_case_to_uscore(namespace),
+                           camel_case_to_uscore(short_name))
+    return lower, lower.upper(), namespace + short_name
+
+
+def generate(interfaces, prefix, namespace, header_name):
+    header = []
+    source = []
+    banner = ('/* Generated by generate-property-tables.py from the D-Bus '
+              'introspection data.\n * Do not edit. */\n')
+    table_type = '{}PropertyTable'.format(namespace)
+    entry_type = '{}PropertyTableEntry'.format(namespace)
+
+    header.append(banner)
+    header.append('#pragma once\n')
+    header.append('#include <glib.h>\n')
+    header.append('G_BEGIN_DECLS\n')
+    header.append('typedef struct\n'
+                  '{{\n'
+                  '  const char *dbus_name;\n'
+                  '  const char *hyphen_name;\n'
+                  '  const char *signature;\n'
+                  '}} {};\n'.format(entry_type))
+    header.append('typedef struct\n'
+                  '{{\n'
+                  '  const char *interface_name;\n'
+                  '  unsigned int n_properties;\n'
+                  '  const {} *properties;\n'
+                  '  /* Where the pspecs of the properties are cached once\n'
+                  '   * they have been looked up, so that emitting\n'
+                  '   * PropertiesChanged does not have to look them up\n'
+                  '   * again */\n'
+                  '  gpointer *cache;\n'
+                  '}} {};\n'.format(entry_type, table_type))
+
+    source.append(banner)
+    source.append('#include "{}"\n'.format(header_name))
+
+    for interface in interfaces:
+        if not interface.properties:
+            continue
+
+        if len(interface.properties) > 32:
+            sys.exit('{} has more than 32 properties, which do not fit '
+                     'in a changed properties mask'.format(interface.name))
+
+        lower, upper, camel = interface_c_names(interface, prefix, namespace)
+
+        enum_lines = []
+        entry_lines = []
+        for dbus_name, signature in interface.properties:
+            uscore = camel_case_to_uscore(dbus_name)
+            enum_lines.append('  {}_PROPERTY_{},'.format(upper, uscore.upper()))
+            entry_lines.append('  {{ "{}", "{}", "{}" }},'.format(
+                dbus_name, uscore.replace('_', '-'), signature))
+
+        header.append('/* Indices into {}_property_table, one less than the\n'
+                      ' * property ids that gdbus-codegen gives the properties '
+                      'of {} */\n'
+                      'typedef enum\n'
+                      '{{\n'
+                      '{}\n'
+                      '  {}_N_PROPERTIES\n'
+                      '}} {}PropertyIndex;\n'.format(lower,
+                                                     interface.name,
+                                                     '\n'.join(enum_lines),
+                                                     upper,
+                                                     camel))
+        header.append('extern const {} {}_property_table;\n'.format(table_type,
+                                                                    lower))
+
+        source.append('static const {} {}_property_entries[] =\n'
+                      '{{\n'
+                      '{}\n'
+                      '}};\n'.format(entry_type, lower, '\n'.join(entry_lines)))
+        source.append('static gpointer {}_property_cache = NULL;\n'.format(
+            lower))
+        source.append('const {} {}_property_table =\n'
+                      '{{\n'
+                      '  "{}",\n'
+                      '  G_N_ELEMENTS ({}_property_entries),\n'
+                      '  {}_property_entries,\n'
+                      '  &{}_property_cache\n'
+                      '}};\n'.format(table_type, lower, interface.name, lower,
+                                     lower, lower))
+
+    header.append('G_END_DECLS\n')
+
+    return '\n'.join(header), '\n'.join(source)
+
+
+def main(argv):
+    if len(argv) != 6:
+        sys.exit('Usage: {} INPUT.xml INTERFACE_PREFIX C_NAMESPACE '
+                 'OUTPUT.h OUTPUT.c'.format(argv[0]))
+
+    input_path, prefix, namespace, header_path, source_path = argv[1:]
+
+    with open(input_path, 'rb') as input_file:
+        interfaces = IntrospectionParser().parse(input_file.read())
+
+    header, source = generate(interfaces, prefix, namespace,
+                              os.path.basename(header_path))
+
+    with open(header_path, 'w') as header_file:
+        header_file.write(header)
+
+    with open(source_path, 'w') as source_file:
+        source_file.write(source)
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -73,7 +73,15 @@ const FakeAnimationEffectBridge = new Lang.Class({
                                              GObject.ParamFlags.CONSTRUCT,
                                              0,
                                              10,
-                                             5)
+                                             5),
+        some_float_property: GObject.ParamSpec.float('some-float-property',
+                                                     'Some Float Property',
+                                                     'Some float property description',
+                                                     GObject.ParamFlags.READWRITE |
+                                                     GObject.ParamFlags.CONSTRUCT,
+                                                     0.0,
+                                                     1.0,
+                                                     0.5)
     },
 
     vfunc_get_name: function() {
@@ -232,6 +240,32 @@ describe('Animations DBus', function() {
                 }));
             });
 
+            it('sends every geometry change by default', function() {
+                expect(server.geometry_notify_interval).toBe(0);
+                expect(server.effective_geometry_notify_interval).toBe(0);
+            });
+
+            it('uses the server geometry notify interval if the client did not request one', function() {
+                server.geometry_notify_interval = 100;
+                expect(server.effective_geometry_notify_interval).toBe(100);
+            });
+
+            it('can request a geometry notify interval', function(done) {
+                client.set_geometry_notify_interval_async(500, null, doneHandler(done, function(source, result) {
+                    expect(source.set_geometry_notify_interval_finish(result)).toBeTruthy();
+                    expect(server.geometry_notify_interval).toBe(0);
+                    expect(server.effective_geometry_notify_interval).toBe(500);
+                }));
+            });
+
+            it('never waits less than the server geometry notify interval', function(done) {
+                server.geometry_notify_interval = 1000;
+                client.set_geometry_notify_interval_async(500, null, doneHandler(done, function(source, result) {
+                    expect(source.set_geometry_notify_interval_finish(result)).toBeTruthy();
+                    expect(server.effective_geometry_notify_interval).toBe(1000);
+                }));
+            });
+
             it('can create a known animation effect', function(done) {
                 client.create_animation_effect_async('My cool effect',
                                                      'fake-effect',
@@ -351,6 +385,10 @@ describe('Animations DBus', function() {
                          expect(clientSurface.title).toBe('Default Title');
                      });
 
+                     it('has no attached effects', function() {
+                         expect(clientSurface.effects.deep_unpack()).toEqual({});
+                     });
+
                      it('changed title is not reflected in properties if changed after querying', function() {
                          surface.title = 'New Title';
                          expect(clientSurface.title).not.toEqual('newTitle');
@@ -382,6 +420,114 @@ describe('Animations DBus', function() {
                          surface.geometry = new GLib.Variant('(iiii)', [100, 100, 200, 200]);
                          serverSurface.emit_geometry_changed();
                      });
+
+                     it('final geometry is reflected in properties after several quick changes', function(done) {
+                         let conn = clientSurface.proxy.connect('notify::geometry', function() {
+                             if (clientSurface.geometry.deep_unpack()[0] !== 300)
+                                 return;
+
+                             clientSurface.proxy.disconnect(conn);
+                             done();
+                         });
+
+                         for (let x of [100, 200, 300]) {
+                             surface.geometry = new GLib.Variant('(iiii)', [x, 100, 200, 200]);
+                             serverSurface.emit_geometry_changed();
+                         }
+                     });
+
+                     it('coalesces geometry changes made within the notify interval', function(done) {
+                         let seen = [];
+                         let conn = clientSurface.proxy.connect('notify::geometry', function() {
+                             let x = clientSurface.geometry.deep_unpack()[0];
+                             seen.push(x);
+
+                             /* The first change is sent straight away. Make two more
+                              * changes, a while apart but well within the interval. */
+                             if (x === 100) {
+                                 surface.geometry = new GLib.Variant('(iiii)', [200, 100, 200, 200]);
+                                 serverSurface.emit_geometry_changed();
+
+                                 GLib.timeout_add(GLib.PRIORITY_DEFAULT, 20, function() {
+                                     surface.geometry = new GLib.Variant('(iiii)', [300, 100, 200, 200]);
+                                     serverSurface.emit_geometry_changed();
+                                     return GLib.SOURCE_REMOVE;
+                                 });
+                                 return;
+                             }
+
+                             if (x !== 300)
+                                 return;
+
+                             clientSurface.proxy.disconnect(conn);
+                             expect(seen).toEqual([100, 300]);
+                             done();
+                         });
+
+                         server.geometry_notify_interval = 500;
+                         surface.geometry = new GLib.Variant('(iiii)', [100, 100, 200, 200]);
+                         serverSurface.emit_geometry_changed();
+                     });
+                });
+            });
+
+            describe('with several surfaces registered at once', function() {
+                let serverSurfaces = null;
+                let addedPaths = null;
+                let removedPaths = null;
+
+                beforeEach(function() {
+                    addedPaths = [];
+                    removedPaths = [];
+                    client.connect('surfaces-added', (client, paths) => addedPaths.push(paths));
+                    client.connect('surfaces-removed', (client, paths) => removedPaths.push(paths));
+
+                    serverSurfaces = server.register_surfaces([
+                        new FakeServerSurfaceBridge({}),
+                        new FakeServerSurfaceBridge({}),
+                        new FakeServerSurfaceBridge({}),
+                    ]);
+                });
+
+                it('shows all of them up in the client surface listing', function(done) {
+                    client.list_surfaces_async(null, doneHandler(done, function(source, result) {
+                        expect(source.list_surfaces_finish(result).length).toBe(3);
+                    }));
+                });
+
+                it('lists all of them on the server in registration order', function() {
+                    expect(server.list_surfaces().map(s => s.get_id())).toEqual(serverSurfaces.map(s => s.get_id()));
+                });
+
+                it('announces all of them in a single SurfacesAdded signal', function(done) {
+                    // The reply comes in after any signal emitted before it
+                    client.list_surfaces_async(null, doneHandler(done, function(source, result) {
+                        source.list_surfaces_finish(result);
+
+                        expect(addedPaths.length).toBe(1);
+                        expect(addedPaths[0].sort()).toEqual(serverSurfaces.map(s => s.get_object_path()).sort());
+                    }));
+                });
+
+                it('removes all of them from the client surface listing when unregistered at once', function(done) {
+                    expect(server.unregister_surfaces(serverSurfaces)).toBeTruthy();
+
+                    client.list_surfaces_async(null, doneHandler(done, function(source, result) {
+                        expect(source.list_surfaces_finish(result).length).toBe(0);
+                    }));
+                });
+
+                it('announces all of them in a single SurfacesRemoved signal when unregistered at once', function(done) {
+                    let paths = serverSurfaces.map(s => s.get_object_path()).sort();
+
+                    expect(server.unregister_surfaces(serverSurfaces)).toBeTruthy();
+
+                    client.list_surfaces_async(null, doneHandler(done, function(source, result) {
+                        source.list_surfaces_finish(result);
+
+                        expect(removedPaths.length).toBe(1);
+                        expect(removedPaths[0].sort()).toEqual(paths);
+                    }));
                 });
             });
 
@@ -469,6 +615,43 @@ describe('Animations DBus', function() {
                     }));
                 });
 
+                it('the type of some-float-property is d', function() {
+                    expect(effect.schema.deep_unpack()['some-float-property'].deep_unpack().type.deep_unpack()).toBe(
+                        'd'
+                    );
+                });
+
+                it('can change float settings on that effect', function(done) {
+                    effect.change_setting_async('some-float-property',
+                                                new GLib.Variant('d', 0.25),
+                                                null,
+                                                doneHandler(done, function(source, result) {
+                        expect(source.change_setting_finish(result)).toBeTruthy();
+                    }));
+                });
+
+                it('can change float settings on that effect with an integer', function(done) {
+                    effect.change_setting_async('some-float-property',
+                                                new GLib.Variant('i', 1),
+                                                null,
+                                                doneHandler(done, function(source, result) {
+                        expect(source.change_setting_finish(result)).toBeTruthy();
+                        let serverEffect = server.lookup_animation_effect_by_path(effect.proxy.get_object_path());
+                        expect(serverEffect.bridge.some_float_property).toBe(1);
+                    }));
+                });
+
+                it('changing setting to a value of the wrong type throws', function(done) {
+                    effect.change_setting_async('some-property',
+                                                new GLib.Variant('s', 'two'),
+                                                null,
+                                                doneHandler(done, function(source, result) {
+                        expect(function() {
+                            source.change_setting_finish(result);
+                        }).toThrow();
+                    }));
+                });
+
                 it('changing setting to invalid value throws', function(done) {
                     effect.change_setting_async('some-property',
                                                 new GLib.Variant('i', 100),
@@ -480,6 +663,50 @@ describe('Animations DBus', function() {
                     }));
                 });
 
+                it('can change several settings on that effect at once', function(done) {
+                    let conn = effect.proxy.connect('notify::settings', function() {
+                        let settings = effect.settings.deep_unpack();
+                        expect(settings['some-property'].deep_unpack()).toBe(2);
+                        expect(settings['some-float-property'].deep_unpack()).toBe(0.25);
+                        effect.proxy.disconnect(conn);
+                        done();
+                    });
+                    effect.change_settings_async(new GLib.Variant('a{sv}', {
+                        'some-property': new GLib.Variant('i', 2),
+                        'some-float-property': new GLib.Variant('d', 0.25),
+                    }), null, doneHandler(done, function(source, result) {
+                        expect(source.change_settings_finish(result)).toBeTruthy();
+                    }));
+                });
+
+                it('changing several settings with one invalid value throws and changes nothing', function(done) {
+                    effect.change_settings_async(new GLib.Variant('a{sv}', {
+                        'some-float-property': new GLib.Variant('d', 0.25),
+                        'some-property': new GLib.Variant('i', 100),
+                    }), null, doneHandler(done, function(source, result) {
+                        expect(function() {
+                            source.change_settings_finish(result);
+                        }).toThrow();
+                        let serverEffect = server.lookup_animation_effect_by_path(effect.proxy.get_object_path());
+                        expect(serverEffect.bridge.some_float_property).toBe(0.5);
+                    }));
+                });
+
+                it('settings pushed to the settings channel get reflected in the properties', function(done) {
+                    effect.open_settings_channel_async(null, doneHandlerExceptionOnly(done, function(source, result) {
+                        expect(source.open_settings_channel_finish(result)).toBeTruthy();
+
+                        let conn = effect.proxy.connect('notify::settings', function() {
+                            expect(effect.settings.deep_unpack()['some-float-property'].deep_unpack()).toBe(0.75);
+                            effect.proxy.disconnect(conn);
+                            done();
+                        });
+                        expect(effect.push_setting('some-float-property', 0.25)).toBeTruthy();
+                        expect(effect.push_setting('some-float-property', 0.75)).toBeTruthy();
+                        server.flush();
+                    }));
+                });
+
                 describe('with some attached surfaces', function() {
                     let serverSurface1 = null;
                     let serverSurface2 = null;
@@ -548,6 +775,13 @@ describe('Animations DBus', function() {
                             expect(attachedEffect).toBeA(FakeAttachedAnimationEffect);
                         });
 
+                        it('is the highest priority event on the server side when looked up by event id', function() {
+                            let moveEventId = AnimationsDbus.ServerSurface.event_id_from_string('move');
+                            let attachedEffect = serverSurface1.highest_priority_attached_effect_for_event_id(moveEventId);
+
+                            expect(attachedEffect).toBeA(FakeAttachedAnimationEffect);
+                        });
+
                         it('is removed when the server connection closes', function(done) {
                             server.connect('client-disconnected', doneHandler(done, function() {
                                 let attachedEffect = serverSurface1.highest_priority_attached_effect_for_event('move');
@@ -616,5 +850,277 @@ describe('Animations DBus', function() {
                 });
             });
         });
+
+        describe('with a Client connected after a surface was registered', function() {
+            let client = null;
+
+            beforeEach(function(done) {
+                let surface = new FakeServerSurfaceBridge({});
+                server.register_surface(surface);
+
+                AnimationsDbus.Client.new_with_connection_async(clientConnection,
+                                                                null,
+                                                                doneHandler(done, function(source, result) {
+                    client = AnimationsDbus.Client.new_finish(source, result);
+                }));
+            });
+
+            afterEach(function() {
+                client = null;
+            });
+
+            it('has the surface in its initial surfaces', function() {
+                let surfaces = client.get_initial_surfaces();
+
+                expect(surfaces.length).toBe(1);
+                expect(surfaces[0].title).toBe('Default Title');
+            });
+        });
+
+        describe('with a Client connected while a surface changes', function() {
+            let client = null;
+
+            beforeEach(function(done) {
+                let surface = new FakeServerSurfaceBridge({});
+                let serverSurface = server.register_surface(surface);
+
+                // Change the surface once the snapshot for the client
+                // was already taken, but before it can be delivered.
+                server.connect('client-connected', function() {
+                    GLib.idle_add(GLib.PRIORITY_HIGH, function() {
+                        surface.title = 'New Title';
+                        serverSurface.emit_title_changed();
+                        server.flush();
+                        return GLib.SOURCE_REMOVE;
+                    });
+                });
+
+                AnimationsDbus.Client.new_with_connection_async(clientConnection,
+                                                                null,
+                                                                doneHandler(done, function(source, result) {
+                    client = AnimationsDbus.Client.new_finish(source, result);
+                }));
+            });
+
+            afterEach(function() {
+                client = null;
+            });
+
+            it('sees the change in its initial surfaces', function(done) {
+                let clientSurface = client.get_initial_surfaces()[0];
+
+                if (clientSurface.title === 'New Title') {
+                    done();
+                    return;
+                }
+
+                let conn = clientSurface.proxy.connect('notify::title', doneHandler(done, function() {
+                    expect(clientSurface.title).toBe('New Title');
+                    clientSurface.proxy.disconnect(conn);
+                }));
+            });
+        });
+
+    });
+
+    describe('Server listening peer to peer', function() {
+        let server = null;
+        let connectedClientName = null;
+
+        beforeEach(function(done) {
+            server = new AnimationsDbus.Server({
+                connection: serverConnection,
+                effect_factory: new FakeAnimationEffectBridgeProvider({}),
+                listen_peer_to_peer: true,
+            });
+            server.connect('client-connected', function(server, name) {
+                connectedClientName = name;
+            });
+            server.init_async(GLib.PRIORITY_DEFAULT, null, doneHandler(done, function(source, result) {
+                expect(source.init_finish(result)).toBeTruthy();
+            }));
+        });
+
+        afterEach(function() {
+            server = null;
+            connectedClientName = null;
+        });
+
+        describe('with a connected Client', function() {
+            let client = null;
+
+            beforeEach(function(done) {
+                server.register_surface(new FakeServerSurfaceBridge({}));
+
+                AnimationsDbus.Client.new_with_connection_async(clientConnection,
+                                                                null,
+                                                                doneHandler(done, function(source, result) {
+                    client = AnimationsDbus.Client.new_finish(source, result);
+                }));
+            });
+
+            afterEach(function() {
+                client = null;
+            });
+
+            it('registers over the peer to peer connection', function() {
+                expect(connectedClientName).toMatch(/^peer:/);
+            });
+
+            it('lists surfaces over the peer to peer connection', function(done) {
+                client.list_surfaces_async(null, doneHandler(done, function(source, result) {
+                    let surfaces = source.list_surfaces_finish(result);
+
+                    expect(surfaces.length).toBe(1);
+                    expect(surfaces[0].title).toBe('Default Title');
+                }));
+            });
+
+            it('can create a known animation effect', function(done) {
+                client.create_animation_effect_async('My cool effect',
+                                                     'fake-effect',
+                                                     new GLib.Variant('a{sv}', {}),
+                                                     null,
+                                                     doneHandler(done, function(source, result) {
+                    let effect = source.create_animation_effect_finish(result);
+                    expect(effect.title).toBe('My cool effect');
+                }));
+            });
+        });
+    });
+
+    describe('Server with lazy surface export', function() {
+        let server = null;
+        let serverSurface = null;
+
+        beforeEach(function(done) {
+            server = new AnimationsDbus.Server({
+                connection: serverConnection,
+                effect_factory: new FakeAnimationEffectBridgeProvider({}),
+                lazy_surface_export: true,
+            });
+            server.init_async(GLib.PRIORITY_DEFAULT, null, doneHandler(done, function(source, result) {
+                expect(source.init_finish(result)).toBeTruthy();
+                serverSurface = server.register_surface(new FakeServerSurfaceBridge({}));
+            }));
+        });
+
+        afterEach(function() {
+            server.stop(null);
+            server = null;
+            serverSurface = null;
+        });
+
+        it('does not export surfaces before the first client registers', function() {
+            expect(serverSurface.get_object_path()).toBeNull();
+        });
+
+        describe('with a connected Client', function() {
+            let client = null;
+
+            beforeEach(function(done) {
+                AnimationsDbus.Client.new_with_connection_async(clientConnection,
+                                                                null,
+                                                                doneHandler(done, function(source, result) {
+                    client = AnimationsDbus.Client.new_finish(source, result);
+                }));
+            });
+
+            afterEach(function() {
+                client = null;
+            });
+
+            it('exports surfaces registered before the first client', function() {
+                let surfaces = client.get_initial_surfaces();
+
+                expect(serverSurface.get_object_path()).not.toBeNull();
+                expect(surfaces.length).toBe(1);
+                expect(surfaces[0].title).toBe('Default Title');
+            });
+
+            it('unexports surfaces once the last client leaves', function(done) {
+                let objectPath = serverSurface.get_object_path();
+                let otherConnection =
+                    Gio.DBusConnection.new_for_address_sync(testDBus.get_bus_address(),
+                                                            Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+                                                            Gio.DBusConnectionFlags.MESSAGE_BUS_CONNECTION,
+                                                            null,
+                                                            null);
+
+                server.connect('client-disconnected', function() {
+                    expect(serverSurface.get_object_path()).toBeNull();
+
+                    otherConnection.call(serverConnection.get_unique_name(),
+                                         objectPath,
+                                         'com.endlessm.Libanimation.AnimatableSurface',
+                                         'ListEffects',
+                                         null,
+                                         null,
+                                         Gio.DBusCallFlags.NONE,
+                                         -1,
+                                         null,
+                                         function(source, result) {
+                        expect(() => source.call_finish(result)).toThrow();
+                        done();
+                    });
+                });
+
+                client = null;
+                clientConnection.close_sync(null);
+            });
+        });
+    });
+
+    describe('Server publishing a state snapshot', function() {
+        let server = null;
+        let surface = null;
+        let serverSurface = null;
+        let client = null;
+
+        beforeEach(function(done) {
+            server = new AnimationsDbus.Server({
+                connection: serverConnection,
+                effect_factory: new FakeAnimationEffectBridgeProvider({}),
+                publish_state_snapshot: true,
+            });
+            server.init_async(GLib.PRIORITY_DEFAULT, null, doneHandlerExceptionOnly(done, function(source, result) {
+                expect(source.init_finish(result)).toBeTruthy();
+                surface = new FakeServerSurfaceBridge({});
+                serverSurface = server.register_surface(surface);
+
+                AnimationsDbus.Client.new_with_connection_async(clientConnection,
+                                                                null,
+                                                                doneHandler(done, function(source, result) {
+                    client = AnimationsDbus.Client.new_finish(source, result);
+                    expect(client.open_state_snapshot()).toBeTruthy();
+                }));
+            }));
+        });
+
+        afterEach(function() {
+            server = null;
+            surface = null;
+            serverSurface = null;
+            client = null;
+        });
+
+        it('lists the registered surfaces with their properties', function() {
+            let surfaces = client.read_state_snapshot().deep_unpack();
+
+            expect(surfaces.length).toBe(1);
+            expect(surfaces[0][0]).toBe(serverSurface.get_object_path());
+            expect(surfaces[0][1]['Title'].deep_unpack()).toBe('Default Title');
+        });
+
+        it('reflects changed titles after a flush', function() {
+            let sequence = client.get_state_snapshot_sequence();
+
+            surface.title = 'New Title';
+            serverSurface.emit_title_changed();
+            server.flush();
+
+            expect(client.get_state_snapshot_sequence()).not.toBe(sequence);
+            expect(client.read_state_snapshot().deep_unpack()[0][1]['Title'].deep_unpack()).toBe('New Title');
+        });
     });
 });